@@ -5,17 +5,30 @@
 
 
 #include "http_lib.h"
+#include "worker.h"
+#include "config.h"
+#include "router.h"
+#include "route_pattern.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include "task.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "response_cache.h"
+#include "static_files.h"
 #include <functional>
 #include <vector>
 #include <memory>
-#include <iostream>
 #include <atomic>
+#include <thread>
+#include <algorithm>
 #include <csignal>
-#include <regex>
 #include <map>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <unistd.h>
+#include <concepts>
+#include <deque>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <cstring>
 #include <stdexcept>
 
@@ -26,11 +39,8 @@ namespace fastapi_cpp {
 
     class Route {
     public:
-        virtual Response handle(const Request& request, const std::map<std::string, std::string>& params) const = 0;
-        virtual bool matches(const Method& method, const std::string& uri) const = 0;
-        virtual std::map<std::string, std::string> extract_params(const std::string& uri) const = 0;
+        virtual Response handle(const Request& request, const Params& params) const = 0;
         virtual const std::string& get_path_pattern() const = 0;
-        virtual const std::regex& get_regex() const = 0;
         virtual const std::vector<std::string>& get_param_names() const = 0;
         virtual Method get_method() const = 0;
         virtual ~Route() = default;
@@ -40,102 +50,168 @@ namespace fastapi_cpp {
     class FunctionRoute : public Route {
         Method method;
         std::string path_pattern;
-        std::regex path_regex;
         std::vector<std::string> param_names;
         Func handler;
 
     public:
         FunctionRoute(Method m, std::string p, Func h)
                 : method(m), path_pattern(std::move(p)), handler(std::move(h)) {
-            std::string pattern = "^";
-            std::regex param_regex(R"(\{([^}]+)\})");
-            std::string::const_iterator search_start(path_pattern.cbegin());
-            std::smatch match;
-
-            while (std::regex_search(search_start, path_pattern.cend(), match, param_regex)) {
-                pattern += std::string(search_start, match.prefix().second);
-                pattern += "([^/]+)";
-                param_names.push_back(match[1]);
-                search_start = match.suffix().first;
-            }
-
-            pattern += std::string(search_start, path_pattern.cend());
-            pattern += "(?:\\?.*)?$";
+            for_each_segment(path_pattern, [this](std::string_view segment) {
+                if (segment.size() >= 2 && segment.front() == '{' && segment.back() == '}') {
+                    param_names.emplace_back(segment.substr(1, segment.size() - 2));
+                }
+            });
+            FASTAPI_LOG_DEBUG("Route created: ", method_to_string(method), " ", path_pattern);
+        }
 
-            path_regex = std::regex(pattern);
-            std::cout << "Route created: " << method_to_string(method) << " " << path_pattern << std::endl;
-            std::cout << "Regex pattern: " << pattern << std::endl;
+        Response handle(const Request& request, const Params& params) const override {
+            return handler(request, params);
         }
 
-        bool matches(const Method& m, const std::string& uri) const override {
-            if (method != m) return false;
+        const std::string& get_path_pattern() const override {
+            return path_pattern;
+        }
 
-            auto query_pos = uri.find('?');
-            std::string path = (query_pos != std::string::npos) ? uri.substr(0, query_pos) : uri;
+        const std::vector<std::string>& get_param_names() const override {
+            return param_names;
+        }
 
-            return std::regex_match(path, path_regex);
+        Method get_method() const override {
+            return method;
         }
+    };
 
+    // Route whose handler takes the body as it arrives: handler(const Request&, const Params&)
+    // returns the http::BodyReader that receives it. The Request has no body and stays valid
+    // until on_end returns; copy what the reader needs out of the Params. Where the body has
+    // already been buffered (handle_request), the reader gets it as a single piece.
+    template<typename Func>
+    class BodyReaderRoute {
+        std::vector<std::string> param_names;
+        Func handler;
 
-        std::map<std::string, std::string> extract_params(const std::string& uri) const override {
-            std::map<std::string, std::string> params;
-            std::smatch match;
-            std::string uri_without_query = uri.substr(0, uri.find('?'));
-            if (std::regex_match(uri_without_query, match, path_regex)) {
-                for (size_t i = 0; i < param_names.size(); i++) {
-                    params[param_names[i]] = match[i + 1].str();
+    public:
+        BodyReaderRoute(const std::string& path_pattern, Func h) : handler(std::move(h)) {
+            for_each_segment(path_pattern, [this](std::string_view segment) {
+                if (segment.size() >= 2 && segment.front() == '{' && segment.back() == '}') {
+                    param_names.emplace_back(segment.substr(1, segment.size() - 2));
                 }
-            }
-            return params;
+            });
         }
 
-        Response handle(const Request& request, const std::map<std::string, std::string>& params) const override {
-            auto query_params = parse_query_string(request.uri);
+        static http::BodyReader open(const void* r, const Request& request, const PathParams& values) {
+            const auto* route = static_cast<const BodyReaderRoute*>(r);
+            return route->handler(request, Params(route->param_names, values, request.query_params));
+        }
+
+        static Response invoke(const void* route, const Request& request, const PathParams& values) {
+            http::BodyReader reader = open(route, request, values);
+            if (!request.body.empty()) reader.on_data(request.body);
+            return reader.on_end();
+        }
+    };
+
+    // Completed task, for async dispatch paths that already have their answer.
+    inline Task<Response> ready_task(Response response) {
+        co_return response;
+    }
 
-            auto all_params = params;
-            all_params.insert(query_params.begin(), query_params.end());
+    template<typename Func>
+    concept AsyncHandler = std::same_as<std::invoke_result_t<const Func&, const Request&>, Task<Response>>;
+
+    // Coroutine route on a plain path: handler(const Request&) -> Task<Response>.
+    template<typename Func>
+    class AsyncFunctionRoute {
+        Func handler;
 
-            return handler(request, all_params);
+    public:
+        explicit AsyncFunctionRoute(Func h) : handler(std::move(h)) {}
+
+        static Task<Response> async_invoke(const void* route, const Request& request, const PathParams&) {
+            return static_cast<const AsyncFunctionRoute*>(route)->handler(request);
         }
+    };
 
-        const std::string& get_path_pattern() const override {
-            return path_pattern;
+    // Route declared with a compile-time pattern such as "/users/{id:int}". The handler takes the
+    // request followed by one argument per parameter, typed as declared (int, long long, double,
+    // or std::string_view for {name} / {name:str}). Values are converted straight from the
+    // matched path segments; a segment that doesn't convert makes the route not match.
+    // A handler returning Task<Response> makes the route asynchronous.
+    template<FixedString Pattern, typename Func>
+    class TypedRoute {
+        using Spec = RoutePattern<Pattern>;
+        Method method;
+        Func handler;
+
+        template<size_t... I>
+        static constexpr bool returns_task(std::index_sequence<I...>) {
+            if constexpr (std::is_invocable_v<const Func&, const Request&, typename Spec::template arg_type<I>...>) {
+                return is_task<std::invoke_result_t<const Func&, const Request&, typename Spec::template arg_type<I>...>>::value;
+            } else {
+                return false;
+            }
         }
 
-        const std::regex& get_regex() const override {
-            return path_regex;
+    public:
+        static constexpr bool is_async = returns_task(std::make_index_sequence<Spec::param_count>{});
+
+        TypedRoute(Method m, Func h) : method(m), handler(std::move(h)) {
+            static_assert(invocable_with_params(std::make_index_sequence<Spec::param_count>{}),
+                          "Handler must be callable as handler(const Request&, <one argument per route parameter>)");
+            FASTAPI_LOG_DEBUG("Route created: ", method_to_string(method), " ", Spec::text);
         }
 
-        const std::vector<std::string>& get_param_names() const override {
-            return param_names;
+        static Response invoke(const void* route, const Request& request, const PathParams& values) requires (!is_async) {
+            return static_cast<const TypedRoute*>(route)->call(request, values, std::make_index_sequence<Spec::param_count>{});
         }
 
-        Method get_method() const override {
-            return method;
+        static Task<Response> async_invoke(const void* route, const Request& request, const PathParams& values) requires is_async {
+            return static_cast<const TypedRoute*>(route)->call(request, values, std::make_index_sequence<Spec::param_count>{});
         }
-    private:
-        std::map<std::string, std::string> parse_query_string(const std::string& uri) const {
-            std::map<std::string, std::string> query_params;
-            auto query_pos = uri.find('?');
-            if (query_pos != std::string::npos) {
-                std::string query = uri.substr(query_pos + 1);
-                std::istringstream iss(query);
-                std::string pair;
-                while (std::getline(iss, pair, '&')) {
-                    auto eq_pos = pair.find('=');
-                    if (eq_pos != std::string::npos) {
-                        std::string key = pair.substr(0, eq_pos);
-                        std::string value = pair.substr(eq_pos + 1);
-                        query_params[key] = value;
-                    }
-                }
+
+        // For the router: whether every value converts to its declared type. nullptr when all
+        // parameters are strings, which take any value.
+        static constexpr Endpoint::Accepts accepts() {
+            if constexpr (has_typed_params(std::make_index_sequence<Spec::param_count>{})) {
+                return [](const PathParams& values) { return converts(values, std::make_index_sequence<Spec::param_count>{}); };
+            } else {
+                return nullptr;
             }
-            return query_params;
+        }
+
+    private:
+        using Result = std::conditional_t<is_async, Task<Response>, Response>;
+
+        template<size_t... I>
+        static constexpr bool invocable_with_params(std::index_sequence<I...>) {
+            return std::is_invocable_r_v<Response, const Func&, const Request&, typename Spec::template arg_type<I>...> ||
+                   std::is_invocable_r_v<Task<Response>, const Func&, const Request&, typename Spec::template arg_type<I>...>;
+        }
+
+        template<size_t... I>
+        static constexpr bool has_typed_params(std::index_sequence<I...>) {
+            return ((Spec::params[I].type != ParamType::STRING) || ...);
+        }
+
+        template<size_t... I>
+        static bool converts(const PathParams& values, std::index_sequence<I...>) {
+            std::tuple<typename Spec::template arg_type<I>...> args;
+            return (convert_param(values[I], std::get<I>(args)) && ...);
+        }
+
+        // The router only picks this route once accepts() has, so every value converts.
+        template<size_t... I>
+        Result call(const Request& request, const PathParams& values, std::index_sequence<I...>) const {
+            std::tuple<typename Spec::template arg_type<I>...> args;
+            (convert_param(values[I], std::get<I>(args)), ...);
+            return handler(request, std::get<I>(args)...);
         }
     };
 
     class FastAPI {
     public:
+        using Handler = std::function<Response(const Request&, const Params&)>;
+
         FastAPI() {
             running = false;
             //server_fd = -1;
@@ -147,159 +223,427 @@ namespace fastapi_cpp {
         }
 
         template<typename Func>
-        void add_route(Method method, const std::string& path, Func handler) {
-            routes.push_back(std::make_unique<FunctionRoute<Func>>(method, path, std::move(handler)));
+        void add_route(Method method, const std::string& path, Func handler, Execution execution = Execution::INLINE) {
+            if constexpr (AsyncHandler<Func>) {
+                auto route = std::make_shared<AsyncFunctionRoute<Func>>(std::move(handler));
+                Endpoint& endpoint = endpoints.emplace_back();
+                endpoint.async_invoke = &AsyncFunctionRoute<Func>::async_invoke;
+                endpoint.route = route.get();
+                endpoint.pattern = path;
+                endpoint.execution = Execution::ASYNC;
+                endpoint.metrics_id = Metrics::instance().register_route(method, endpoint.pattern);
+                router.insert(method, endpoint.pattern, &endpoint);
+                typed_routes.push_back(std::move(route));
+            } else {
+                auto route = std::make_unique<FunctionRoute<Func>>(method, path, std::move(handler));
+                Endpoint& endpoint = endpoints.emplace_back();
+                endpoint.invoke = &invoke_route;
+                endpoint.route = route.get();
+                endpoint.pattern = route->get_path_pattern();
+                endpoint.execution = execution;
+                endpoint.metrics_id = Metrics::instance().register_route(method, endpoint.pattern);
+                router.insert(method, endpoint.pattern, &endpoint);
+                routes.push_back(std::move(route));
+            }
+        }
+
+        template<FixedString Pattern, typename Func>
+        void add_route(Method method, Func handler, Execution execution = Execution::INLINE) {
+            using RouteType = TypedRoute<Pattern, Func>;
+            auto route = std::make_shared<RouteType>(method, std::move(handler));
+            Endpoint& endpoint = endpoints.emplace_back();
+            if constexpr (RouteType::is_async) {
+                endpoint.async_invoke = &RouteType::async_invoke;
+                endpoint.execution = Execution::ASYNC;
+            } else {
+                endpoint.invoke = &RouteType::invoke;
+                endpoint.execution = execution;
+            }
+            endpoint.route = route.get();
+            endpoint.accepts = RouteType::accepts();
+            endpoint.pattern = std::string(Pattern.view());
+            endpoint.metrics_id = Metrics::instance().register_route(method, endpoint.pattern);
+            router.insert(method, endpoint.pattern, &endpoint);
+            typed_routes.push_back(std::move(route));
+        }
+
+        template<FixedString Pattern, typename Func>
+        void get(Func handler, Execution execution = Execution::INLINE) {
+            add_route<Pattern>(Method::GET, std::move(handler), execution);
+        }
+
+        template<FixedString Pattern, typename Func>
+        void post(Func handler, Execution execution = Execution::INLINE) {
+            add_route<Pattern>(Method::POST, std::move(handler), execution);
+        }
+
+        template<FixedString Pattern, typename Func>
+        void put(Func handler, Execution execution = Execution::INLINE) {
+            add_route<Pattern>(Method::PUT, std::move(handler), execution);
+        }
+
+        template<FixedString Pattern, typename Func>
+        void patch(Func handler, Execution execution = Execution::INLINE) {
+            add_route<Pattern>(Method::PATCH, std::move(handler), execution);
+        }
+
+        template<FixedString Pattern, typename Func>
+        void delete_(Func handler, Execution execution = Execution::INLINE) {
+            add_route<Pattern>(Method::DELETE, std::move(handler), execution);
         }
 
-        void get(const std::string& path, std::function<Response(const Request&, const std::map<std::string, std::string>&)> handler) {
+        template<AsyncHandler Func>
+        void get(const std::string& path, Func handler) {
             add_route(Method::GET, path, std::move(handler));
         }
 
-        void post(const std::string& path, std::function<Response(const Request&, const std::map<std::string, std::string>&)> handler) {
+        void get(const std::string& path, Handler handler,
+                Execution execution = Execution::INLINE) {
+            add_route(Method::GET, path, std::move(handler), execution);
+        }
+
+        // Caches the 200 response of each distinct path and query for up to `cache_ttl`
+        // (less if the response's Cache-Control says so). Hits skip the handler.
+        void get(const std::string& path, Handler handler, std::chrono::milliseconds cache_ttl) {
+            add_route(Method::GET, path, std::move(handler));
+            endpoints.back().cache_ttl = cache_ttl;
+        }
+
+        template<AsyncHandler Func>
+        void post(const std::string& path, Func handler) {
             add_route(Method::POST, path, std::move(handler));
         }
 
-        void put(const std::string& path, std::function<Response(const Request&, const std::map<std::string, std::string>&)> handler) {
+        void post(const std::string& path, Handler handler,
+                Execution execution = Execution::INLINE) {
+            add_route(Method::POST, path, std::move(handler), execution);
+        }
+
+        template<AsyncHandler Func>
+        void put(const std::string& path, Func handler) {
             add_route(Method::PUT, path, std::move(handler));
         }
 
-        void patch(const std::string& path, std::function<Response(const Request&, const std::map<std::string, std::string>&)> handler) {
+        void put(const std::string& path, Handler handler,
+                Execution execution = Execution::INLINE) {
+            add_route(Method::PUT, path, std::move(handler), execution);
+        }
+
+        template<AsyncHandler Func>
+        void patch(const std::string& path, Func handler) {
             add_route(Method::PATCH, path, std::move(handler));
         }
 
-        void delete_(const std::string& path, std::function<Response(const Request&, const std::map<std::string, std::string>&)> handler) {
+        void patch(const std::string& path, Handler handler,
+                Execution execution = Execution::INLINE) {
+            add_route(Method::PATCH, path, std::move(handler), execution);
+        }
+
+        template<AsyncHandler Func>
+        void delete_(const std::string& path, Func handler) {
             add_route(Method::DELETE, path, std::move(handler));
         }
 
-        Response handle_request(const Request& req) {
-            std::cout << "Handling request: " << method_to_string(req.method) << " " << req.uri << std::endl;
+        void delete_(const std::string& path, Handler handler,
+                Execution execution = Execution::INLINE) {
+            add_route(Method::DELETE, path, std::move(handler), execution);
+        }
 
-            for (const auto& route : routes) {
-                try {
-                    std::cout << "Checking route: " << method_to_string(route->get_method()) << " " << route->get_path_pattern() << std::endl;
+        // Registers a route that receives its request body as it arrives, in constant memory
+        // however large the upload (max_body_size does not apply). See BodyReaderRoute.
+        template<typename Func>
+        void add_upload_route(Method method, const std::string& path, Func handler) {
+            auto route = std::make_shared<BodyReaderRoute<Func>>(path, std::move(handler));
+            Endpoint& endpoint = endpoints.emplace_back();
+            endpoint.invoke = &BodyReaderRoute<Func>::invoke;
+            endpoint.open_reader = &BodyReaderRoute<Func>::open;
+            endpoint.route = route.get();
+            endpoint.pattern = path;
+            endpoint.metrics_id = Metrics::instance().register_route(method, endpoint.pattern);
+            router.insert(method, endpoint.pattern, &endpoint);
+            typed_routes.push_back(std::move(route));
+        }
 
-                    if (route->matches(req.method, req.uri)) {
-                        std::cout << "Route matched!" << std::endl;
-                        auto params = route->extract_params(req.uri);
+        template<typename Func>
+        void post_upload(const std::string& path, Func handler) {
+            add_upload_route(Method::POST, path, std::move(handler));
+        }
 
-                        for (const auto& [key, value] : params) {
-                            std::cout << "Param: " << key << " = " << value << std::endl;
-                        }
+        template<typename Func>
+        void put_upload(const std::string& path, Func handler) {
+            add_upload_route(Method::PUT, path, std::move(handler));
+        }
 
-                        return route->handle(req, params);
-                    } else {
-                        std::cout << "Route did not match" << std::endl;
-                    }
-                } catch (const std::exception& e) {
-                    std::cerr << "Error in route handling: " << e.what() << std::endl;
-                }
+        // Serves files under `directory` for GET requests below `url_prefix` that no route
+        // matches, e.g. static_files("/assets", "/var/www") maps /assets/app.js to
+        // /var/www/app.js. See StaticFiles.
+        void static_files(const std::string& url_prefix, const std::string& directory) {
+            static_mounts.push_back(std::make_unique<StaticFiles>(url_prefix, directory));
+        }
+
+        // Routes and runs an INLINE or BLOCKING handler on the calling thread.
+        Response handle_request(const Request& req) const {
+            PathParams values;
+            const Endpoint* endpoint = resolve(req, values);
+            if (!endpoint) return unrouted(req);
+            if (auto cached = cached_response(*endpoint, req)) return std::move(*cached);
+            if (endpoint->execution == Execution::ASYNC) {
+                throw std::runtime_error("Route " + endpoint->pattern + " is asynchronous; use handle_async");
             }
+            return respond(*endpoint, req, values);
+        }
 
-            std::cout << "No matching route found, returning 404" << std::endl;
-            return http::HTTP_404_NOT_FOUND();
+        // What the worker calls on its I/O thread: answers INLINE routes, and reports the
+        // others so the worker can hand them to the blocking pool or the coroutine runner.
+        Dispatch handle_inline(const Request& req) const {
+            PathParams values;
+            const Endpoint* endpoint = resolve(req, values);
+            if (!endpoint) return {Execution::INLINE, unrouted(req)};
+            if (auto cached = cached_response(*endpoint, req)) return {Execution::INLINE, std::move(*cached)};
+            if (endpoint->execution != Execution::INLINE) return {endpoint->execution, {}};
+            return {Execution::INLINE, respond(*endpoint, req, values)};
         }
 
-        void run(int port) {
-            int server_fd;
-            struct sockaddr_in address;
-            int addrlen = sizeof(address);
-            char buffer[4096] = {0};
+        // What the worker calls once a request's head is framed: the BodyReader for a request
+        // to an upload route, which then gets the body as it arrives; nullopt otherwise.
+        std::optional<http::BodyReader> open_body_reader(const Request& req) const {
+            std::string_view path = req.uri;
+            path = path.substr(0, path.find('?'));
+            PathParams values;
+            const Endpoint* endpoint = router.find(req.method, path, values);
+            if (!endpoint || !endpoint->open_reader) return std::nullopt;
+            Metrics::instance().count_route(endpoint->metrics_id);
+            return endpoint->open_reader(endpoint->route, req, values);
+        }
 
-            if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-                throw std::runtime_error("Socket creation failed");
+        // Runs any route as a coroutine. `req` must outlive the returned task.
+        Task<Response> handle_async(const Request& req) const {
+            PathParams values;
+            const Endpoint* endpoint = resolve(req, values);
+            if (!endpoint) return ready_task(unrouted(req));
+            if (endpoint->execution == Execution::ASYNC) {
+                Metrics::instance().count_route(endpoint->metrics_id);
+                uint64_t started = Metrics::instance().start();
+                Task<Response> task = endpoint->async_invoke(endpoint->route, req, values);
+                return started ? timed(std::move(task), started) : std::move(task);
             }
+            return ready_task(call(*endpoint, req, values));
+        }
 
-            address.sin_family = AF_INET;
-            address.sin_addr.s_addr = INADDR_ANY;
-            address.sin_port = htons(port);
+        // Serves the Prometheus text exposition of Metrics at `path` and starts recording.
+        void enable_metrics(const std::string& path = "/metrics") {
+            Metrics::instance().enable();
+            add_route(Method::GET, path, [](const Request&, const Params&) {
+                Response response{{1, 1}, http::HttpStatus::OK, {}, {}, "text/plain; version=0.0.4; charset=utf-8"};
+                Metrics::instance().render(response.body);
+                return response;
+            });
+        }
 
-            if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-                close(server_fd);
-                throw std::runtime_error("Bind failed");
+        // Samples requests slower than `slower_than` and serves them at `path` as Chrome trace
+        // JSON, or as one line per request with ?format=text.
+        void enable_tracing(std::chrono::microseconds slower_than, const std::string& path = "/debug/traces",
+                            size_t capacity = 1024) {
+            Tracer::instance().enable(slower_than, capacity);
+            add_route(Method::GET, path, [](const Request&, const Params& params) {
+                if (params.get("format", "") == "text") {
+                    Response response{{1, 1}, http::HttpStatus::OK, {}, {}, "text/plain; charset=utf-8"};
+                    Tracer::instance().dump(response.body);
+                    return response;
+                }
+                return Response{{1, 1}, http::HttpStatus::OK, {}, Tracer::instance().chrome_trace(), "application/json"};
+            });
+        }
+
+        // Serves on `port` with num_workers event loops, each on its own thread with its own
+        // SO_REUSEPORT listening socket. num_workers == 0 uses one worker per hardware thread.
+        // Routes must all be registered before calling run(); they are shared read-only.
+        void run(int port, unsigned num_workers = 1) {
+            if (num_workers == 0) {
+                num_workers = std::max(1u, std::thread::hardware_concurrency());
             }
 
-            if (listen(server_fd, 3) < 0) {
-                close(server_fd);
-                throw std::runtime_error("Listen failed");
+            auto handler = [this](const Request& req) { return handle_inline(req); };
+            std::vector<std::unique_ptr<Worker>> workers;
+            for (unsigned i = 0; i < num_workers; i++) {
+                workers.push_back(std::make_unique<Worker>(port, handler, config, running, num_workers > 1));
+                workers.back()->set_async_handler([this](const Request& req) { return handle_async(req); });
+                workers.back()->set_max_connections((config.max_connections + num_workers - 1) / num_workers);
+                if (std::any_of(endpoints.begin(), endpoints.end(), [](const Endpoint& e) { return e.open_reader != nullptr; })) {
+                    workers.back()->set_body_reader_handler([this](const Request& req) { return open_body_reader(req); });
+                }
             }
 
-            std::cout << "Server listening on port " << port << std::endl;
+            // Declared after the workers so it is destroyed, and its threads joined, first.
+            std::unique_ptr<ThreadPool> blocking_pool;
+            bool offloads_compression = config.compression_min_size > 0 &&
+                                        (http::encoding_available(http::ContentEncoding::GZIP) ||
+                                         http::encoding_available(http::ContentEncoding::BROTLI));
+            if (offloads_compression ||
+                std::any_of(endpoints.begin(), endpoints.end(), [](const Endpoint& e) { return e.execution == Execution::BLOCKING; })) {
+                unsigned threads = config.blocking_threads ? config.blocking_threads
+                                                           : std::max(1u, std::thread::hardware_concurrency());
+                blocking_pool = std::make_unique<ThreadPool>(threads, config.blocking_queue_capacity);
+                for (auto& worker : workers) {
+                    worker->set_blocking_pool(blocking_pool.get(), [this](const Request& req) { return handle_request(req); });
+                }
+                FASTAPI_LOG_INFO("Blocking handlers run on ", threads, " pool thread(s)");
+            }
+            FASTAPI_LOG_INFO("Server listening on port ", port, " with ", num_workers, " worker(s)");
 
             //std::signal(SIGINT, signal_handler);
             //std::signal(SIGTERM, signal_handler);
+            // sendfile() has no MSG_NOSIGNAL; a peer that resets mid-file must not kill the process.
+            std::signal(SIGPIPE, SIG_IGN);
 
             running = true;
 
-            while (running) {
-                fd_set readfds;
-                FD_ZERO(&readfds);
-                FD_SET(server_fd, &readfds);
+            std::vector<std::thread> threads;
+            for (unsigned i = 1; i < num_workers; i++) {
+                threads.emplace_back([this, worker = workers[i].get()] { run_worker(*worker); });
+            }
+            run_worker(*workers[0]);
 
-                struct timeval timeout;
-                timeout.tv_sec = 1;
-                timeout.tv_usec = 0;
+            for (auto& thread : threads) {
+                thread.join();
+            }
 
-                int activity = select(server_fd + 1, &readfds, NULL, NULL, &timeout);
+            FASTAPI_LOG_INFO("Server stopped");
+        }
 
-                if (activity < 0 && errno != EINTR) {
-                    std::cerr << "Select error" << std::endl;
-                    continue;
-                }
+        void stop() {
+            running = false;
+        }
 
-                if (!running) break;
+        void configure(const ServerConfig& server_config) {
+            config = server_config;
+            response_cache.set_capacity(config.response_cache_bytes);
+            Logger::instance().set_level(config.log_level);
+        }
 
-                if (activity == 0) continue;
+        const ServerConfig& get_config() const {
+            return config;
+        }
 
-                int new_socket;
-                if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-                    std::cerr << "Accept failed" << std::endl;
-                    continue;
-                }
+    private:
+        std::vector<std::unique_ptr<Route>> routes;
+        std::vector<std::shared_ptr<const void>> typed_routes;
+        std::deque<Endpoint> endpoints;
+        Router<Endpoint> router;
+        std::atomic<bool> running;
+        ServerConfig config;
+        mutable ResponseCache response_cache{ServerConfig().response_cache_bytes};
+        std::vector<std::unique_ptr<StaticFiles>> static_mounts;
+        static FastAPI* instance;
 
-                int valread = read(new_socket, buffer, 4096);
-                if (valread < 0) {
-                    std::cerr << "Read failed" << std::endl;
-                    close(new_socket);
-                    continue;
-                }
+        const Endpoint* resolve(const Request& req, PathParams& values) const {
+            FASTAPI_LOG_DEBUG("Handling request: ", method_to_string(req.method), " ", req.uri);
 
-                std::string request_str(buffer);
-                std::cout << "Received request:\n" << request_str << std::endl;
+            std::string_view path = req.uri;
+            path = path.substr(0, path.find('?'));
 
-                try {
-                    Request req = http::parse_request(request_str);
-                    Response resp = handle_request(req);
-                    std::string response_str = http::construct_response(resp);
+            Metrics& metrics = Metrics::instance();
+            uint64_t started = metrics.start();
+            const Endpoint* endpoint = router.find(req.method, path, values);
+            metrics.observe_since(Phase::ROUTE, started);
+            Tracer::mark(TracePoint::ROUTED);
+            if (!endpoint) return nullptr;
+            FASTAPI_LOG_DEBUG("Route matched: ", endpoint->pattern);
+            return endpoint;
+        }
 
-                    std::cout << "Sending response:\n" << response_str << std::endl;
+        // Deferred routes are resolved twice (on the I/O thread, then where they run), so
+        // requests are counted here, once the handler is actually invoked.
+        static Response call(const Endpoint& endpoint, const Request& req, const PathParams& values) {
+            Metrics::instance().count_route(endpoint.metrics_id);
+            uint64_t started = Metrics::instance().start();
+            Response response = endpoint(req, values);
+            Metrics::instance().observe_since(Phase::HANDLER, started);
+            Tracer::mark(TracePoint::HANDLED);
+            return response;
+        }
 
-                    if (send(new_socket, response_str.c_str(), response_str.length(), 0) < 0) {
-                        std::cerr << "Send failed" << std::endl;
-                    }
-                } catch (const std::exception& e) {
-                    std::cerr << "Error handling request: " << e.what() << std::endl;
+        Response respond(const Endpoint& endpoint, const Request& req, const PathParams& values) const {
+            Response response = call(endpoint, req, values);
+            if (endpoint.cache_ttl.count() == 0 || req.method != Method::GET) return response;
+            return store_in_cache(req, endpoint.cache_ttl, std::move(response));
+        }
+
+        // Only routes with a TTL are looked up, so other requests never pay for the key.
+        std::optional<Response> cached_response(const Endpoint& endpoint, const Request& req) const {
+            if (endpoint.cache_ttl.count() == 0 || req.method != Method::GET || response_cache.empty()) {
+                return std::nullopt;
+            }
+            std::string_view cache_control = http::find_header(req, http::HeaderId::CACHE_CONTROL);
+            if (cache_control_directive(cache_control, "no-cache") || cache_control_directive(cache_control, "no-store")) {
+                return std::nullopt;
+            }
+            auto entry = response_cache.find(cache_key(req), ResponseCache::Clock::now());
+            if (!entry) return std::nullopt;
+            return CachedResponse::respond(entry, http::find_header(req, http::HeaderId::IF_NONE_MATCH));
+        }
+
+        Response store_in_cache(const Request& req, std::chrono::milliseconds ttl, Response response) const {
+            if (response.status != http::HttpStatus::OK || response.prepared || response.stream) return response;
+            if (cache_control_directive(http::find_header(req, http::HeaderId::CACHE_CONTROL), "no-store")) return response;
+            if (const std::string* cache_control = response.headers.find("Cache-Control")) {
+                if (cache_control_directive(*cache_control, "no-store") || cache_control_directive(*cache_control, "no-cache") ||
+                    cache_control_directive(*cache_control, "private")) {
+                    return response;
+                }
+                if (auto max_age = cache_control_directive(*cache_control, "max-age")) {
+                    long long seconds = 0;
+                    std::from_chars(max_age->data(), max_age->data() + max_age->size(), seconds);
+                    if (seconds <= 0) return response;
+                    ttl = std::min(ttl, std::chrono::milliseconds(std::chrono::seconds(seconds)));
                 }
-                close(new_socket);
             }
+            auto entry = response_cache.store(cache_key(req), response, ttl, ResponseCache::Clock::now());
+            if (!entry) return response;
+            return CachedResponse::respond(entry, http::find_header(req, http::HeaderId::IF_NONE_MATCH));
+        }
 
-            std::cout << "Server stopped" << std::endl;
+        // The request target as sent: the path and the raw query, which no two distinct
+        // queries share.
+        static std::string_view cache_key(const Request& req) { return req.uri; }
+
+        static Task<Response> timed(Task<Response> task, uint64_t started) {
+            Response response = co_await std::move(task);
+            Metrics::instance().observe_since(Phase::HANDLER, started);
+            co_return response;
         }
-        void stop() {
-            running = false;
-            if (server_fd != -1) {
-                close(server_fd);
-                server_fd = -1;
+
+        // Requests no route matches: static files if a mount has one, otherwise 404.
+        Response unrouted(const Request& req) const {
+            for (const auto& mount : static_mounts) {
+                if (auto response = mount->serve(req)) return std::move(*response);
             }
+            FASTAPI_LOG_DEBUG("No matching route found, returning 404");
+            Metrics::instance().count_unmatched();
+            return not_found();
         }
 
-    private:
-        std::vector<std::unique_ptr<Route>> routes;
-        std::atomic<bool> running;
-        int server_fd;
-        static FastAPI* instance;
+        static Response not_found() {
+            static const http::PreparedResponse response(http::HTTP_404_NOT_FOUND());
+            return response;
+        }
+
+        static Response invoke_route(const void* r, const Request& req, const PathParams& values) {
+            const auto* route = static_cast<const Route*>(r);
+            return route->handle(req, Params(route->get_param_names(), values, req.query_params));
+        }
+
+        void run_worker(Worker& worker) {
+            try {
+                worker.run();
+            } catch (const std::exception& e) {
+                FASTAPI_LOG_ERROR("Worker stopped: ", e.what());
+                stop();
+            }
+        }
 
         static void signal_handler(int signal) {
-            std::cout << "Received signal " << signal << ". Shutting down..." << std::endl;
+            FASTAPI_LOG_INFO("Received signal ", signal, ". Shutting down...");
             if (instance) {
                 instance->stop();
             }
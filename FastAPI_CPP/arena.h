@@ -0,0 +1,121 @@
+// Tomas Costantino
+
+#ifndef HTTP_ARENA_H
+#define HTTP_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+
+namespace http {
+
+    // Monotonic bump allocator. Allocations are never freed individually; reset() releases
+    // everything at once and keeps the first block for reuse, so an arena that is reset per
+    // request stops touching malloc once it has grown to the working-set size.
+    class Arena {
+    public:
+        explicit Arena(size_t block_size = 4096) : default_block_size(block_size) {}
+
+        ~Arena() {
+            release(head);
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+            uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+            if (head == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(limit)) {
+                grow(bytes + alignment);
+                aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+            }
+            cursor = reinterpret_cast<char*>(aligned + bytes);
+            used += bytes;
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        template<typename T>
+        T* allocate_array(size_t count) {
+            if (count == 0) return nullptr;
+            return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        }
+
+        std::string_view copy_string(std::string_view text) {
+            if (text.empty()) return {};
+            char* out = allocate_array<char>(text.size());
+            std::memcpy(out, text.data(), text.size());
+            return {out, text.size()};
+        }
+
+        void reset() {
+            if (head == nullptr) return;
+            release(head->next);
+            head->next = nullptr;
+            cursor = head->data();
+            limit = head->data() + head->size;
+            used = 0;
+        }
+
+        size_t bytes_used() const { return used; }
+
+    private:
+        struct Block {
+            Block* next;
+            size_t size;
+            char* data() { return reinterpret_cast<char*>(this + 1); }
+        };
+
+        size_t default_block_size;
+        Block* head = nullptr;
+        char* cursor = nullptr;
+        char* limit = nullptr;
+        size_t used = 0;
+
+        // New blocks are pushed behind the first one so reset() can keep the first block.
+        void grow(size_t min_bytes) {
+            size_t size = default_block_size;
+            while (size < min_bytes) size *= 2;
+            auto* block = static_cast<Block*>(std::malloc(sizeof(Block) + size));
+            if (block == nullptr) throw std::bad_alloc();
+            block->size = size;
+            if (head == nullptr) {
+                block->next = nullptr;
+                head = block;
+            } else {
+                block->next = head->next;
+                head->next = block;
+                if (default_block_size < (size_t(1) << 20)) default_block_size *= 2;
+            }
+            cursor = block->data();
+            limit = block->data() + size;
+        }
+
+        static void release(Block* block) {
+            while (block) {
+                Block* next = block->next;
+                std::free(block);
+                block = next;
+            }
+        }
+    };
+
+    // Lets std::pmr containers allocate from an Arena. Deallocation is a no-op; memory comes
+    // back when the arena is reset, so containers using it must not outlive that reset.
+    class ArenaResource final : public std::pmr::memory_resource {
+    public:
+        explicit ArenaResource(Arena& backing) : arena(backing) {}
+
+    private:
+        Arena& arena;
+
+        void* do_allocate(size_t bytes, size_t alignment) override { return arena.allocate(bytes, alignment); }
+        void do_deallocate(void*, size_t, size_t) override {}
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+}
+
+#endif //HTTP_ARENA_H
@@ -0,0 +1,151 @@
+// Tomas Costantino
+
+#ifndef SERVERC___BUFFER_POOL_H
+#define SERVERC___BUFFER_POOL_H
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fastapi_cpp {
+
+    // Free list of fixed-size, cache-line aligned I/O slabs owned by one worker. Connections
+    // borrow a slab when bytes arrive and hand it back once everything received has been
+    // consumed, so an idle connection holds no receive memory and a busy worker stops
+    // calling malloc once the pool has warmed up.
+    class BufferPool {
+    public:
+        static constexpr size_t slab_size = 16 * 1024;
+        static constexpr size_t alignment = 64;
+
+        explicit BufferPool(size_t max_free_slabs = 1024) : max_free(max_free_slabs) {}
+
+        ~BufferPool() {
+            for (char* slab : free_slabs) {
+                free_bytes(slab);
+            }
+        }
+
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        char* acquire() {
+            if (free_slabs.empty()) return allocate_bytes(slab_size);
+            char* slab = free_slabs.back();
+            free_slabs.pop_back();
+            return slab;
+        }
+
+        void release(char* slab) {
+            if (free_slabs.size() >= max_free) {
+                free_bytes(slab);
+                return;
+            }
+            free_slabs.push_back(slab);
+        }
+
+        size_t free_count() const { return free_slabs.size(); }
+
+        static char* allocate_bytes(size_t size) {
+            return static_cast<char*>(::operator new(size, std::align_val_t{alignment}));
+        }
+
+        static void free_bytes(char* bytes) {
+            ::operator delete(bytes, std::align_val_t{alignment});
+        }
+
+    private:
+        std::vector<char*> free_slabs;
+        size_t max_free;
+    };
+
+    // Receive buffer on top of a BufferPool slab. The socket is read straight into the free
+    // space at the back (prepare/commit), and framed requests are dropped from the front with
+    // consume(), which only moves a read offset. A request bigger than a slab moves to a
+    // private allocation that is freed, not pooled, on release().
+    class IoBuffer {
+    public:
+        explicit IoBuffer(BufferPool& buffer_pool) : pool(&buffer_pool) {}
+
+        ~IoBuffer() {
+            release();
+        }
+
+        IoBuffer(const IoBuffer&) = delete;
+        IoBuffer& operator=(const IoBuffer&) = delete;
+
+        std::string_view view() const { return {storage + begin, end - begin}; }
+        size_t size() const { return end - begin; }
+        bool empty() const { return begin == end; }
+
+        // Returns space for at least `min_free` bytes at the back; writable() tells how much.
+        char* prepare(size_t min_free) {
+            if (!storage) {
+                storage = pool->acquire();
+                capacity = BufferPool::slab_size;
+            }
+            if (capacity - end < min_free && begin > 0) {
+                std::memmove(storage, storage + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            if (capacity - end < min_free) {
+                size_t grown = capacity * 2;
+                while (grown - end < min_free) grown *= 2;
+                char* bigger = BufferPool::allocate_bytes(grown);
+                std::memcpy(bigger, storage, end);
+                free_storage();
+                storage = bigger;
+                capacity = grown;
+            }
+            return storage + end;
+        }
+
+        size_t writable() const { return capacity - end; }
+
+        void commit(size_t bytes) { end += bytes; }
+
+        void append(std::string_view bytes) {
+            std::memcpy(prepare(bytes.size()), bytes.data(), bytes.size());
+            commit(bytes.size());
+        }
+
+        void consume(size_t bytes) {
+            begin += bytes;
+            if (begin == end) {
+                begin = 0;
+                end = 0;
+            }
+        }
+
+        // Returns the storage to the pool. Only call once the buffer is empty, or to discard it.
+        void release() {
+            free_storage();
+            storage = nullptr;
+            capacity = 0;
+            begin = 0;
+            end = 0;
+        }
+
+    private:
+        BufferPool* pool;
+        char* storage = nullptr;
+        size_t capacity = 0;
+        size_t begin = 0;
+        size_t end = 0;
+
+        void free_storage() {
+            if (!storage) return;
+            if (capacity == BufferPool::slab_size) {
+                pool->release(storage);
+            } else {
+                BufferPool::free_bytes(storage);
+            }
+        }
+    };
+}
+
+#endif //SERVERC___BUFFER_POOL_H
@@ -0,0 +1,159 @@
+// Tomas Costantino
+
+#ifndef HTTP_COMPRESSION_H
+#define HTTP_COMPRESSION_H
+
+#include "request_parser.h"
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Codecs are compiled in when the build links them: FASTAPI_WITH_ZLIB (gzip, deflate) and
+// FASTAPI_WITH_BROTLI (br). Without either, negotiation always picks identity.
+#if defined(FASTAPI_WITH_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(FASTAPI_WITH_BROTLI)
+#include <brotli/encode.h>
+#endif
+
+namespace http {
+
+    enum class ContentEncoding {
+        IDENTITY,
+        GZIP,
+        DEFLATE,
+        BROTLI
+    };
+
+    // FAST for bodies compressed per response, BEST for ones compressed once and kept.
+    enum class CompressionEffort {
+        FAST,
+        BEST
+    };
+
+    constexpr std::string_view encoding_name(ContentEncoding encoding) {
+        switch (encoding) {
+            case ContentEncoding::GZIP: return "gzip";
+            case ContentEncoding::DEFLATE: return "deflate";
+            case ContentEncoding::BROTLI: return "br";
+            default: return "identity";
+        }
+    }
+
+    constexpr bool encoding_available(ContentEncoding encoding) {
+        switch (encoding) {
+            case ContentEncoding::IDENTITY: return true;
+#if defined(FASTAPI_WITH_ZLIB)
+            case ContentEncoding::GZIP:
+            case ContentEncoding::DEFLATE: return true;
+#endif
+#if defined(FASTAPI_WITH_BROTLI)
+            case ContentEncoding::BROTLI: return true;
+#endif
+            default: return false;
+        }
+    }
+
+    // Picks the available coding with the highest q-value in an Accept-Encoding header,
+    // preferring br, then gzip, then deflate on ties. Identity when nothing else is acceptable.
+    inline ContentEncoding negotiate_encoding(std::string_view accept_encoding) {
+        static constexpr ContentEncoding preference[] = {ContentEncoding::BROTLI, ContentEncoding::GZIP, ContentEncoding::DEFLATE};
+        int quality[4] = {-1, -1, -1, -1};   // per ContentEncoding, in thousandths; -1 = not listed
+        int wildcard = -1;
+        while (!accept_encoding.empty()) {
+            size_t comma = accept_encoding.find(',');
+            std::string_view item = accept_encoding.substr(0, comma);
+            accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+
+            size_t semicolon = item.find(';');
+            std::string_view coding = item.substr(0, semicolon);
+            while (!coding.empty() && coding.front() == ' ') coding.remove_prefix(1);
+            while (!coding.empty() && coding.back() == ' ') coding.remove_suffix(1);
+            int q = 1000;
+            if (semicolon != std::string_view::npos) {
+                std::string_view parameter = item.substr(semicolon + 1);
+                size_t equals = parameter.find('=');
+                if (equals != std::string_view::npos) {
+                    std::string_view value = parameter.substr(equals + 1);
+                    while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+                    double parsed = 1.0;
+                    std::from_chars(value.data(), value.data() + value.size(), parsed);
+                    q = static_cast<int>(parsed * 1000 + 0.5);
+                }
+            }
+            if (coding == "*") {
+                wildcard = q;
+            } else if (RequestParser::equals_ignore_case(coding, "br")) {
+                quality[static_cast<int>(ContentEncoding::BROTLI)] = q;
+            } else if (RequestParser::equals_ignore_case(coding, "gzip") || RequestParser::equals_ignore_case(coding, "x-gzip")) {
+                quality[static_cast<int>(ContentEncoding::GZIP)] = q;
+            } else if (RequestParser::equals_ignore_case(coding, "deflate")) {
+                quality[static_cast<int>(ContentEncoding::DEFLATE)] = q;
+            }
+        }
+
+        ContentEncoding best = ContentEncoding::IDENTITY;
+        int best_quality = 0;
+        for (ContentEncoding encoding : preference) {
+            if (!encoding_available(encoding)) continue;
+            int q = quality[static_cast<int>(encoding)];
+            if (q < 0) q = wildcard;
+            if (q > best_quality) {
+                best = encoding;
+                best_quality = q;
+            }
+        }
+        return best;
+    }
+
+    // Media types worth compressing; images, archives and the like are already compressed.
+    inline bool compressible_type(std::string_view content_type) {
+        std::string_view type = content_type.substr(0, content_type.find(';'));
+        return type.starts_with("text/") || type == "application/json" || type == "application/javascript" ||
+               type == "application/xml" || type == "image/svg+xml" || type.ends_with("+json") || type.ends_with("+xml");
+    }
+
+    // Compressed bytes, or nullopt when the coding is unavailable or fails.
+    // The parameters go unused in a build without any codec.
+    inline std::optional<std::string> compress([[maybe_unused]] ContentEncoding encoding, [[maybe_unused]] std::string_view data,
+                                               [[maybe_unused]] CompressionEffort effort = CompressionEffort::FAST) {
+#if defined(FASTAPI_WITH_ZLIB)
+        if (encoding == ContentEncoding::GZIP || encoding == ContentEncoding::DEFLATE) {
+            z_stream stream{};
+            int window_bits = encoding == ContentEncoding::GZIP ? 15 + 16 : 15;
+            int level = effort == CompressionEffort::BEST ? 9 : 6;
+            if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) return std::nullopt;
+            std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+            stream.avail_in = static_cast<uInt>(data.size());
+            stream.next_out = reinterpret_cast<Bytef*>(out.data());
+            stream.avail_out = static_cast<uInt>(out.size());
+            int status = deflate(&stream, Z_FINISH);
+            out.resize(stream.total_out);
+            deflateEnd(&stream);
+            if (status != Z_STREAM_END) return std::nullopt;
+            return out;
+        }
+#endif
+#if defined(FASTAPI_WITH_BROTLI)
+        if (encoding == ContentEncoding::BROTLI) {
+            size_t size = BrotliEncoderMaxCompressedSize(data.size());
+            std::string out(size, '\0');
+            int quality = effort == CompressionEffort::BEST ? 9 : 5;
+            if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, data.size(),
+                                       reinterpret_cast<const uint8_t*>(data.data()), &size,
+                                       reinterpret_cast<uint8_t*>(out.data()))) {
+                return std::nullopt;
+            }
+            out.resize(size);
+            return out;
+        }
+#endif
+        return std::nullopt;
+    }
+}
+
+#endif //HTTP_COMPRESSION_H
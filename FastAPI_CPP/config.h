@@ -0,0 +1,70 @@
+// Tomas Costantino
+
+#ifndef SERVERC___CONFIG_H
+#define SERVERC___CONFIG_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "logger.h"
+
+namespace fastapi_cpp {
+
+    // How workers do their socket I/O. EVENT_LOOP: readiness notification (epoll, kqueue)
+    // and one syscall per recv/send. IO_URING (Linux 6.0+): multishot accept and receive
+    // into provided buffers, with sends and closes batched into one io_uring_enter per
+    // loop iteration. Falls back to EVENT_LOOP where io_uring is unavailable.
+    enum class IoBackend {
+        EVENT_LOOP,
+        IO_URING
+    };
+
+    struct ServerConfig {
+        // Idle time after which a persistent connection with no request in flight is closed.
+        std::chrono::milliseconds keep_alive_timeout{5000};
+        // A request's header block must arrive within header_timeout of its first byte, and
+        // its body may stall for at most body_timeout between reads; either is answered with
+        // 408 and a close. A response the client stops reading for send_timeout is abandoned.
+        std::chrono::milliseconds header_timeout{10000};
+        std::chrono::milliseconds body_timeout{30000};
+        std::chrono::milliseconds send_timeout{30000};
+        // Open connections, split evenly across workers (0 = no limit). Connections beyond it
+        // are answered with a precomputed 503 and closed as soon as they are accepted.
+        size_t max_connections = 10000;
+        // Responses served on one connection before the server answers with Connection: close.
+        unsigned max_requests_per_connection = 1000;
+        // Pipelined requests are not dispatched while this much response data is still unsent.
+        size_t max_pending_output = 64 * 1024;
+        // Requests whose header block or decoded body exceed these are answered with 431 / 413.
+        size_t max_header_size = 16 * 1024;
+        size_t max_body_size = 16 * 1024 * 1024;
+        // Applied to the process-wide Logger by FastAPI::configure. INFO logs one access line
+        // per request; DEBUG adds routing details and raw requests/responses.
+        LogLevel log_level = LogLevel::INFO;
+        // Threads running Execution::BLOCKING handlers (0 = one per hardware thread), and how
+        // many such requests may wait for one before new ones are answered with 503 and their
+        // connection closed.
+        unsigned blocking_threads = 0;
+        size_t blocking_queue_capacity = 1024;
+        // Bodies of at least compression_min_size bytes with a compressible type are sent
+        // gzip/deflate/br encoded when the client accepts it (0 disables compression). Those
+        // of compression_offload_size or more are compressed on the blocking pool instead of
+        // the I/O thread. Prepared and cached responses are compressed once and kept; a large
+        // one is sent uncompressed until the pool has done so.
+        size_t compression_min_size = 1024;
+        size_t compression_offload_size = 128 * 1024;
+        // Memory for responses of GET routes registered with a cache TTL.
+        size_t response_cache_bytes = 64 * 1024 * 1024;
+        // Streamed response bodies are produced until this much output is waiting to be sent.
+        size_t stream_high_water = 256 * 1024;
+        // Cleartext HTTP/2 (h2c), by prior knowledge or by Upgrade from HTTP/1.1. A connection
+        // carries up to http2_max_concurrent_streams requests at once; each may send
+        // http2_initial_window_size bytes of body ahead of what the server has read.
+        bool enable_http2 = true;
+        uint32_t http2_max_concurrent_streams = 100;
+        uint32_t http2_initial_window_size = 1 << 20;
+        IoBackend io_backend = IoBackend::EVENT_LOOP;
+    };
+}
+
+#endif //SERVERC___CONFIG_H
@@ -0,0 +1,207 @@
+// Tomas Costantino
+
+#ifndef SERVERC___CONNECTION_H
+#define SERVERC___CONNECTION_H
+
+#include "request_framer.h"
+#include "http2.h"
+#include "buffer_pool.h"
+#include "arena.h"
+#include "tracing.h"
+#include "timer_wheel.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace fastapi_cpp {
+
+    // What a connection's deadline is guarding: the wait for its next request, the arrival
+    // of a request's header block or body, or the client reading a response.
+    enum class ConnectionDeadline : uint8_t {
+        NONE,
+        IDLE,
+        HEADER,
+        BODY,
+        SEND
+    };
+
+    // Bytes queued for sending: either owned, a view of memory that outlives the connection
+    // (the buffers of a PreparedResponse), or a range of an open file sent with sendfile.
+    struct OutputSegment {
+        std::string owned;
+        const char* external = nullptr;
+        size_t external_size = 0;
+        http::FileBody file = {};
+
+        bool is_file() const { return file.fd >= 0; }
+        const char* data() const { return external ? external : owned.data(); }
+        size_t size() const { return is_file() ? file.length : external ? external_size : owned.size(); }
+    };
+
+    // Per-socket state machine driven by the worker's event loop.
+    // READING: waiting for the next request to be framed from in_buffer.
+    // WRITING: out_segments holds responses (in request order) not yet fully sent.
+    // CLOSED: the worker closes the socket after the current event.
+    struct Connection {
+        static constexpr size_t small_body = 256;
+        static constexpr size_t max_spare_tail = 16 * 1024;
+        // Input is dispatched every this many bytes read, rather than once the socket is
+        // drained, so that a body streamed to a BodyReader is handed on as it comes and a
+        // flood of pipelined requests is seen before it has all been buffered.
+        static constexpr size_t upload_read_size = 64 * 1024;
+
+        enum class State {
+            READING,
+            WRITING,
+            CLOSED
+        };
+
+        int fd = -1;
+        uint64_t id = 0;
+        State state = State::READING;
+        bool peer_closed = false;
+        // Dispatch is held up, so the socket is not read until it catches up; see
+        // Worker::pause_reading.
+        bool read_paused = false;
+        bool close_after_write = false;
+        // A request has gone to the blocking pool and its response is not back yet.
+        bool awaiting_handler = false;
+        unsigned requests_served = 0;
+        uint64_t bytes_received = 0;
+        uint64_t bytes_sent = 0;
+        // Negotiated from the Accept-Encoding of the request being answered.
+        http::ContentEncoding response_encoding = http::ContentEncoding::IDENTITY;
+        http::Version request_version{1, 1};
+        // The one deadline the connection is under, and the progress count it was armed at;
+        // see Worker::refresh_deadline.
+        TimerWheel::Node deadline;
+        ConnectionDeadline deadline_kind = ConnectionDeadline::NONE;
+        uint64_t deadline_progress = 0;
+        IoBuffer in_buffer;
+        http::RequestFramer framer;
+        // Backs the Request being dispatched; reset before the next one is framed.
+        http::Arena request_arena{4096};
+        http::ArenaResource request_memory{request_arena};
+        // Output is a list of segments sent with one sendmsg() per batch: response heads are
+        // written into an open tail segment, bodies are moved in as segments of their own.
+        // A deque, so queued segments stay put while an asynchronous send reads them.
+        std::deque<OutputSegment> out_segments;
+        size_t out_front = 0;     // first segment not yet fully sent
+        size_t out_offset = 0;    // bytes of out_segments[out_front] already sent
+        size_t out_pending = 0;
+        bool tail_open = false;
+        std::string spare_tail;   // storage of the last flushed tail, reused by the next one
+        std::vector<std::shared_ptr<const void>> retained;   // owners of queued external segments
+        uint64_t output_started = 0;   // Metrics timestamp of the first response in out_segments
+        // Only written while the Tracer is enabled.
+        uint64_t accepted_at = 0;
+        uint64_t input_started = 0;    // arrival of the first bytes of the request being framed
+        uint64_t last_received = 0;
+        RequestTrace trace;                       // request being dispatched
+        std::vector<RequestTrace> unsent_traces;  // requests whose responses are queued
+        // Request whose body is being passed to body_reader as it arrives. Nothing further is
+        // dispatched until on_end has answered it.
+        std::optional<http::Request> upload;
+        std::optional<http::BodyReader> body_reader;
+        // Producer of the streamed response being sent; set until it has returned false.
+        // Its chunks go out after everything already queued.
+        http::BodyProducer body_stream;
+        bool stream_chunked = false;
+        // Set once the connection has switched to HTTP/2; its requests then arrive as streams
+        // of the session, answered in any order and several at a time.
+        std::unique_ptr<http::Http2Session> h2;
+        std::unordered_map<uint32_t, http::BodyReader> stream_readers;   // streamed uploads, by stream id
+        // io_uring backend: a sendmsg (or a poll for writability) is in flight; the message
+        // and its iovecs stay here until it completes.
+        bool send_in_flight = false;
+        bool recv_armed = false;   // the multishot receive is still active
+        std::vector<iovec> send_iov;
+        msghdr send_message{};
+
+        Connection(int socket_fd, http::FramingLimits limits, BufferPool& buffers)
+                : fd(socket_fd), in_buffer(buffers), framer(limits) {}
+
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        size_t pending_output() const { return out_pending; }
+
+        // Segment to append copied bytes to; the caller adds what it wrote via count_output().
+        std::string& output_tail() {
+            if (!tail_open) {
+                out_segments.emplace_back().owned = std::move(spare_tail);
+                spare_tail.clear();
+                tail_open = true;
+            }
+            return out_segments.back().owned;
+        }
+
+        void count_output(size_t bytes) { out_pending += bytes; }
+
+        // Small bodies are copied into the tail: a short memcpy is cheaper than another iovec.
+        void queue_body(std::string&& body) {
+            out_pending += body.size();
+            if (body.size() <= small_body) {
+                output_tail() += body;
+            } else {
+                out_segments.push_back({std::move(body)});
+                tail_open = false;
+            }
+        }
+
+        void queue_external(std::string_view bytes) {
+            if (bytes.empty()) return;
+            out_pending += bytes.size();
+            out_segments.push_back({{}, bytes.data(), bytes.size()});
+            tail_open = false;
+        }
+
+        void queue_file(const http::FileBody& file) {
+            if (file.length == 0) return;
+            out_pending += file.length;
+            out_segments.push_back({{}, nullptr, 0, file});
+            tail_open = false;
+        }
+
+        void consume_output(size_t bytes) {
+            out_pending -= bytes;
+            bytes_sent += bytes;
+            while (bytes > 0) {
+                size_t remaining = out_segments[out_front].size() - out_offset;
+                if (bytes < remaining) {
+                    out_offset += bytes;
+                    return;
+                }
+                bytes -= remaining;
+                out_front++;
+                out_offset = 0;
+            }
+        }
+
+        void clear_output() {
+            for (OutputSegment& segment : out_segments) {
+                if (!segment.external && !segment.is_file() && segment.owned.capacity() <= max_spare_tail) {
+                    spare_tail = std::move(segment.owned);
+                    spare_tail.clear();
+                    break;
+                }
+            }
+            out_segments.clear();
+            retained.clear();
+            out_front = 0;
+            out_offset = 0;
+            out_pending = 0;
+            tail_open = false;
+        }
+    };
+}
+
+#endif //SERVERC___CONNECTION_H
@@ -0,0 +1,143 @@
+// Tomas Costantino
+
+#ifndef SERVERC___EVENT_LOOP_H
+#define SERVERC___EVENT_LOOP_H
+
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <sys/event.h>
+#include <sys/time.h>
+#define FASTAPI_USE_KQUEUE
+#else
+#error "No supported event notification mechanism (epoll or kqueue) on this platform"
+#endif
+
+namespace fastapi_cpp {
+
+    enum EventFlags : uint32_t {
+        EVENT_READ = 1u << 0,
+        EVENT_WRITE = 1u << 1,
+        EVENT_ERROR = 1u << 2
+    };
+
+    struct Event {
+        int fd;
+        uint32_t flags;
+    };
+
+    inline void set_nonblocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            throw std::runtime_error("Failed to set socket non-blocking");
+        }
+    }
+
+    // Edge-triggered readiness notification: epoll on Linux, kqueue on the BSDs and macOS.
+    // Descriptors are registered once for both read and write readiness, so callers must
+    // drain reads and writes until EAGAIN before waiting again.
+    class EventLoop {
+    public:
+        EventLoop() {
+#if defined(FASTAPI_USE_KQUEUE)
+            poll_fd = kqueue();
+#else
+            poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+            if (poll_fd < 0) {
+                throw std::runtime_error("Event loop creation failed");
+            }
+        }
+
+        ~EventLoop() {
+            if (poll_fd != -1) {
+                close(poll_fd);
+            }
+        }
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        void add(int fd) {
+#if defined(FASTAPI_USE_KQUEUE)
+            struct kevent changes[2];
+            EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+            EV_SET(&changes[1], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+            if (kevent(poll_fd, changes, 2, nullptr, 0, nullptr) < 0) {
+                throw std::runtime_error("Event registration failed");
+            }
+#else
+            struct epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.fd = fd;
+            if (epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                throw std::runtime_error("Event registration failed");
+            }
+#endif
+        }
+
+        void remove(int fd) {
+#if defined(FASTAPI_USE_KQUEUE)
+            struct kevent changes[2];
+            EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+            EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+            kevent(poll_fd, changes, 2, nullptr, 0, nullptr);
+#else
+            epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+        }
+
+        // The epoll or kqueue descriptor, which itself polls readable while events are pending.
+        int native_handle() const { return poll_fd; }
+
+        // Waits up to timeout_ms for readiness and fills `events`. Returns the number of events.
+        int wait(std::vector<Event>& events, int timeout_ms) {
+            events.clear();
+#if defined(FASTAPI_USE_KQUEUE)
+            struct kevent raw[max_events];
+            struct timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+            int n = kevent(poll_fd, nullptr, 0, raw, max_events, timeout_ms < 0 ? nullptr : &timeout);
+            if (n < 0) {
+                if (errno == EINTR) return 0;
+                throw std::runtime_error("Event wait failed");
+            }
+            for (int i = 0; i < n; i++) {
+                uint32_t flags = 0;
+                if (raw[i].filter == EVFILT_READ) flags |= EVENT_READ;
+                if (raw[i].filter == EVFILT_WRITE) flags |= EVENT_WRITE;
+                if (raw[i].flags & EV_ERROR) flags |= EVENT_ERROR;
+                events.push_back({static_cast<int>(raw[i].ident), flags});
+            }
+#else
+            struct epoll_event raw[max_events];
+            int n = epoll_wait(poll_fd, raw, max_events, timeout_ms);
+            if (n < 0) {
+                if (errno == EINTR) return 0;
+                throw std::runtime_error("Event wait failed");
+            }
+            for (int i = 0; i < n; i++) {
+                uint32_t flags = 0;
+                // Hang-ups are reported as readable so the final read observes EOF.
+                if (raw[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) flags |= EVENT_READ;
+                if (raw[i].events & EPOLLOUT) flags |= EVENT_WRITE;
+                if (raw[i].events & EPOLLERR) flags |= EVENT_ERROR;
+                events.push_back({raw[i].data.fd, flags});
+            }
+#endif
+            return static_cast<int>(events.size());
+        }
+
+    private:
+        static constexpr int max_events = 256;
+        int poll_fd = -1;
+    };
+}
+
+#endif //SERVERC___EVENT_LOOP_H
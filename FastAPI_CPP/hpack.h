@@ -0,0 +1,379 @@
+// Tomas Costantino
+
+#ifndef HTTP_HPACK_H
+#define HTTP_HPACK_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+namespace http {
+
+    // HPACK (RFC 7541), the header compression of HTTP/2: fields are sent as indexes into a
+    // static table shared by every connection and a dynamic table each direction of a
+    // connection keeps, or as literals, optionally Huffman-coded.
+
+    struct HpackField {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    // RFC 7541 Appendix A; index 1 is the first entry.
+    inline constexpr HpackField hpack_static_table[] = {
+            {":authority", ""}, {":method", "GET"}, {":method", "POST"},
+            {":path", "/"}, {":path", "/index.html"}, {":scheme", "http"},
+            {":scheme", "https"}, {":status", "200"}, {":status", "204"},
+            {":status", "206"}, {":status", "304"}, {":status", "400"},
+            {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+            {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""},
+            {"accept", ""}, {"access-control-allow-origin", ""}, {"age", ""},
+            {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+            {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""},
+            {"content-length", ""}, {"content-location", ""}, {"content-range", ""},
+            {"content-type", ""}, {"cookie", ""}, {"date", ""},
+            {"etag", ""}, {"expect", ""}, {"expires", ""},
+            {"from", ""}, {"host", ""}, {"if-match", ""},
+            {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+            {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""},
+            {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+            {"proxy-authorization", ""}, {"range", ""}, {"referer", ""},
+            {"refresh", ""}, {"retry-after", ""}, {"server", ""},
+            {"set-cookie", ""}, {"strict-transport-security", ""}, {"transfer-encoding", ""},
+            {"user-agent", ""}, {"vary", ""}, {"via", ""},
+            {"www-authenticate", ""}};
+
+    inline constexpr size_t hpack_static_size = sizeof(hpack_static_table) / sizeof(hpack_static_table[0]);
+
+    namespace detail {
+
+        // Code length of every symbol, EOS (256) last (RFC 7541 Appendix B).
+        inline constexpr uint8_t huffman_lengths[257] = {
+                13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+                28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+                6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+                5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+                13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+                7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+                15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+                6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+                20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+                24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+                22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+                21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+                26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+                19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+                20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+                26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+                30};
+
+        inline constexpr unsigned huffman_max_length = 30;
+
+        // The HPACK code is canonical: codes are handed out in order of (length, symbol), so
+        // the codes and the tables to decode them follow from the lengths alone.
+        struct HuffmanTables {
+            std::array<uint32_t, 257> codes{};
+            std::array<uint16_t, 257> symbols{};   // in the order their codes were handed out
+            std::array<uint32_t, huffman_max_length + 1> first_code{};
+            std::array<uint16_t, huffman_max_length + 1> first_symbol{};
+            std::array<uint16_t, huffman_max_length + 1> count{};
+        };
+
+        constexpr HuffmanTables make_huffman_tables() {
+            HuffmanTables tables;
+            uint16_t next = 0;
+            uint32_t code = 0;
+            for (unsigned length = 1; length <= huffman_max_length; length++) {
+                tables.first_code[length] = code;
+                tables.first_symbol[length] = next;
+                for (uint16_t symbol = 0; symbol < 257; symbol++) {
+                    if (huffman_lengths[symbol] != length) continue;
+                    tables.symbols[next++] = symbol;
+                    tables.codes[symbol] = code++;
+                }
+                tables.count[length] = next - tables.first_symbol[length];
+                code <<= 1;
+            }
+            return tables;
+        }
+
+        inline constexpr HuffmanTables huffman = make_huffman_tables();
+        static_assert(huffman.codes['a'] == 0x3 && huffman.codes['z'] == 0x7b && huffman.codes[256] == 0x3fffffff,
+                      "Huffman codes must match RFC 7541 Appendix B");
+    }
+
+    inline size_t huffman_encoded_size(std::string_view text) {
+        uint64_t bits = 0;
+        for (unsigned char c : text) bits += detail::huffman_lengths[c];
+        return static_cast<size_t>((bits + 7) / 8);
+    }
+
+    inline void huffman_encode(std::string_view text, std::string& out) {
+        uint64_t bits = 0;
+        unsigned pending = 0;
+        for (unsigned char c : text) {
+            unsigned length = detail::huffman_lengths[c];
+            bits = bits << length | detail::huffman.codes[c];
+            pending += length;
+            while (pending >= 8) {
+                pending -= 8;
+                out += static_cast<char>(bits >> pending);
+            }
+            bits &= (uint64_t{1} << pending) - 1;
+        }
+        // Padded with the most significant bits of EOS, which are all ones.
+        if (pending > 0) out += static_cast<char>(bits << (8 - pending) | (0xffu >> pending));
+    }
+
+    // Appends the decoded text. False for EOS inside the text, or padding that is longer than
+    // 7 bits or not all ones; both are decoding errors.
+    inline bool huffman_decode(std::string_view text, std::string& out) {
+        const detail::HuffmanTables& tables = detail::huffman;
+        uint32_t code = 0;
+        unsigned length = 0;
+        for (unsigned char byte : text) {
+            for (int bit = 7; bit >= 0; bit--) {
+                code = code << 1 | ((byte >> bit) & 1);
+                length++;
+                uint32_t offset = code - tables.first_code[length];
+                if (offset < tables.count[length]) {
+                    uint16_t symbol = tables.symbols[tables.first_symbol[length] + offset];
+                    if (symbol == 256) return false;
+                    out += static_cast<char>(symbol);
+                    code = 0;
+                    length = 0;
+                } else if (length == detail::huffman_max_length) {
+                    return false;
+                }
+            }
+        }
+        return length < 8 && code == (uint32_t{1} << length) - 1;
+    }
+
+    // Integer with an N-bit prefix (RFC 7541 5.1); `flags` fills the bits above the prefix.
+    inline void hpack_encode_integer(uint64_t value, unsigned prefix_bits, uint8_t flags, std::string& out) {
+        uint64_t limit = (uint64_t{1} << prefix_bits) - 1;
+        if (value < limit) {
+            out += static_cast<char>(flags | value);
+            return;
+        }
+        out += static_cast<char>(flags | limit);
+        value -= limit;
+        while (value >= 128) {
+            out += static_cast<char>(value % 128 + 128);
+            value /= 128;
+        }
+        out += static_cast<char>(value);
+    }
+
+    // Reads an integer from the front of `input`. False when it is truncated or overflows.
+    inline bool hpack_decode_integer(std::string_view& input, unsigned prefix_bits, uint64_t& value) {
+        if (input.empty()) return false;
+        uint64_t limit = (uint64_t{1} << prefix_bits) - 1;
+        value = static_cast<unsigned char>(input.front()) & limit;
+        input.remove_prefix(1);
+        if (value < limit) return true;
+        for (unsigned shift = 0; shift <= 56; shift += 7) {
+            if (input.empty()) return false;
+            auto byte = static_cast<unsigned char>(input.front());
+            input.remove_prefix(1);
+            value += static_cast<uint64_t>(byte & 127) << shift;
+            if (!(byte & 128)) return true;
+        }
+        return false;
+    }
+
+    // String literal (RFC 7541 5.2), Huffman-coded when that is shorter.
+    inline void hpack_encode_string(std::string_view text, std::string& out) {
+        size_t coded = huffman_encoded_size(text);
+        if (coded < text.size()) {
+            hpack_encode_integer(coded, 7, 0x80, out);
+            huffman_encode(text, out);
+        } else {
+            hpack_encode_integer(text.size(), 7, 0, out);
+            out += text;
+        }
+    }
+
+    // Replaces `out` with the string literal at the front of `input`.
+    inline bool hpack_decode_string(std::string_view& input, std::string& out) {
+        if (input.empty()) return false;
+        bool huffman = static_cast<unsigned char>(input.front()) & 0x80;
+        uint64_t length = 0;
+        if (!hpack_decode_integer(input, 7, length) || length > input.size()) return false;
+        std::string_view text = input.substr(0, length);
+        input.remove_prefix(length);
+        out.clear();
+        if (!huffman) {
+            out.assign(text);
+            return true;
+        }
+        return huffman_decode(text, out);
+    }
+
+    // A dynamic table: newest entry first, evicting the oldest to stay within its capacity,
+    // where an entry costs its name and value plus 32 bytes (RFC 7541 4.1).
+    class HpackTable {
+    public:
+        static constexpr size_t entry_overhead = 32;
+
+        explicit HpackTable(size_t capacity_bytes = 4096) : max_bytes(capacity_bytes) {}
+
+        size_t capacity() const { return max_bytes; }
+        size_t size() const { return entries.size(); }
+
+        // Entry i counted from the newest, 0-based.
+        HpackField at(size_t i) const { return {entries[i].name, entries[i].value}; }
+
+        void set_capacity(size_t capacity_bytes) {
+            max_bytes = capacity_bytes;
+            evict(0);
+        }
+
+        // An entry larger than the whole table empties it and is not added.
+        void insert(std::string_view name, std::string_view value) {
+            size_t cost = name.size() + value.size() + entry_overhead;
+            evict(cost);
+            if (cost > max_bytes) return;
+            entries.push_front({std::string(name), std::string(value)});
+            bytes += cost;
+        }
+
+    private:
+        struct Entry {
+            std::string name;
+            std::string value;
+        };
+
+        std::deque<Entry> entries;
+        size_t bytes = 0;
+        size_t max_bytes;
+
+        void evict(size_t room) {
+            while (!entries.empty() && bytes + room > max_bytes) {
+                bytes -= entries.back().name.size() + entries.back().value.size() + entry_overhead;
+                entries.pop_back();
+            }
+        }
+    };
+
+    class HpackDecoder {
+    public:
+        // max_capacity is the SETTINGS_HEADER_TABLE_SIZE this side advertised.
+        explicit HpackDecoder(size_t max_capacity = 4096) : table(max_capacity), limit(max_capacity) {}
+
+        // Decodes one complete header block, calling fn(name, value) for every field in order;
+        // the views are only valid during the call. False on a compression error, after which
+        // the connection's tables are out of step and it has to be closed.
+        template<typename Fn>
+        bool decode(std::string_view block, Fn&& fn) {
+            while (!block.empty()) {
+                auto first = static_cast<unsigned char>(block.front());
+                uint64_t index = 0;
+                if (first & 0x80) {
+                    // Indexed field.
+                    HpackField field;
+                    if (!hpack_decode_integer(block, 7, index) || !lookup(index, field)) return false;
+                    fn(field.name, field.value);
+                    continue;
+                }
+                if ((first & 0xe0) == 0x20) {
+                    // Dynamic table size update.
+                    if (!hpack_decode_integer(block, 5, index) || index > limit) return false;
+                    table.set_capacity(index);
+                    continue;
+                }
+                // Literal, with incremental indexing (01), without (0000) or never indexed (0001).
+                bool indexing = first & 0x40;
+                if (!hpack_decode_integer(block, indexing ? 6 : 4, index)) return false;
+                if (index == 0) {
+                    if (!hpack_decode_string(block, name)) return false;
+                } else {
+                    HpackField field;
+                    if (!lookup(index, field)) return false;
+                    name.assign(field.name);
+                }
+                if (!hpack_decode_string(block, value)) return false;
+                if (indexing) table.insert(name, value);
+                fn(std::string_view(name), std::string_view(value));
+            }
+            return true;
+        }
+
+    private:
+        HpackTable table;
+        size_t limit;
+        std::string name;
+        std::string value;
+
+        bool lookup(uint64_t index, HpackField& field) const {
+            if (index == 0) return false;
+            if (index <= hpack_static_size) {
+                field = hpack_static_table[index - 1];
+                return true;
+            }
+            index -= hpack_static_size + 1;
+            if (index >= table.size()) return false;
+            field = table.at(index);
+            return true;
+        }
+    };
+
+    class HpackEncoder {
+    public:
+        // The peer's SETTINGS_HEADER_TABLE_SIZE; the table never grows past 4096 bytes, and
+        // a smaller limit is announced at the start of the next header block.
+        void set_max_capacity(size_t peer_limit) {
+            size_t capacity = std::min<size_t>(peer_limit, default_capacity);
+            if (capacity != table.capacity()) {
+                table.set_capacity(capacity);
+                size_update_pending = true;
+            }
+        }
+
+        // Call before the first field of every header block.
+        void begin_block(std::string& out) {
+            if (!size_update_pending) return;
+            hpack_encode_integer(table.capacity(), 5, 0x20, out);
+            size_update_pending = false;
+        }
+
+        // Appends one field; `name` must be lowercase. An exact match in either table is sent
+        // as its index. Otherwise the field is sent as a literal, which with `index` is also
+        // added to the dynamic table so that the next response can refer to it.
+        void encode(std::string_view name, std::string_view value, bool index, std::string& out) {
+            size_t name_index = 0;
+            for (size_t i = 0; i < hpack_static_size; i++) {
+                if (hpack_static_table[i].name != name) continue;
+                if (hpack_static_table[i].value == value) {
+                    hpack_encode_integer(i + 1, 7, 0x80, out);
+                    return;
+                }
+                if (!name_index) name_index = i + 1;
+            }
+            for (size_t i = 0; i < table.size(); i++) {
+                HpackField field = table.at(i);
+                if (field.name != name) continue;
+                if (field.value == value) {
+                    hpack_encode_integer(hpack_static_size + 1 + i, 7, 0x80, out);
+                    return;
+                }
+                if (!name_index) name_index = hpack_static_size + 1 + i;
+            }
+            hpack_encode_integer(name_index, index ? 6 : 4, index ? 0x40 : 0x00, out);
+            if (!name_index) hpack_encode_string(name, out);
+            hpack_encode_string(value, out);
+            if (index) table.insert(name, value);
+        }
+
+    private:
+        static constexpr size_t default_capacity = 4096;
+
+        HpackTable table{default_capacity};
+        bool size_update_pending = false;
+    };
+}
+
+#endif //HTTP_HPACK_H
@@ -0,0 +1,919 @@
+// Tomas Costantino
+
+#ifndef HTTP_HTTP2_H
+#define HTTP_HTTP2_H
+
+#include "http_lib.h"
+#include "hpack.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unistd.h>
+
+namespace http {
+
+    // What a client sends first on an HTTP/2 connection, before its SETTINGS frame.
+    inline constexpr std::string_view http2_preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    enum class Http2Error : uint32_t {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION_ERROR = 0x9,
+        ENHANCE_YOUR_CALM = 0xb
+    };
+
+    // What the server side of a session advertises and enforces.
+    struct Http2Limits {
+        uint32_t max_concurrent_streams = 100;
+        // Request body bytes a client may send on one stream before the server has read them.
+        uint32_t initial_window_size = 1 << 20;
+        size_t max_header_list_size = 16 * 1024;
+        // Buffered request bodies only; bodies passed to a BodyReader are not limited.
+        size_t max_body_size = 16 * 1024 * 1024;
+    };
+
+    // The server side of one HTTP/2 connection (RFC 9113), without the socket: feed() takes
+    // the bytes received and reports each stream's request through events, respond() takes
+    // a stream's response, and produce() frames response bodies as far as output room and
+    // flow control allow. Everything to send accumulates in an output buffer the caller
+    // drains with take_output(). Frames are read and written here; HPACK keeps the header
+    // fields small.
+    //
+    // A stream's request, its head decoded and its body buffered, stays with the stream
+    // until its response has been sent. Streams are independent: any number may be waiting
+    // for their handler, and bodies of several responses are interleaved frame by frame.
+    class Http2Session {
+    public:
+        enum class EventKind : uint8_t {
+            HEAD,    // a request's header block is complete; its body, if any, follows
+            DATA,    // a piece of the body of a stream passed to stream_body()
+            END,     // the request is complete
+            RESET    // the stream is gone, by the client's RST_STREAM or a stream error
+        };
+
+        struct Event {
+            EventKind kind;
+            uint32_t stream_id;
+            std::string_view data;   // DATA only; valid during the callback
+        };
+
+        struct Stream {
+            uint32_t id = 0;
+            Request request;
+            // For the server's use: how the response body is to be encoded.
+            ContentEncoding response_encoding = ContentEncoding::IDENTITY;
+
+            // More of the request body is still to come.
+            bool body_pending() const { return !remote_closed; }
+
+        private:
+            friend class Http2Session;
+            bool remote_closed = false;    // END_STREAM received
+            bool responded = false;
+            bool streamed_body = false;
+            bool handler_running = false;
+            int64_t send_window = 0;
+            uint32_t unacknowledged = 0;   // received DATA bytes not yet returned with WINDOW_UPDATE
+            // The response body left to send, in this order: data, then external or file, then
+            // whatever producer adds to data.
+            std::string data;
+            size_t data_offset = 0;
+            std::string_view external;
+            FileBody file{};
+            BodyProducer producer;
+            std::shared_ptr<const void> retained;
+        };
+
+        explicit Http2Session(Http2Limits session_limits)
+                : limits(session_limits),
+                  connection_window(static_cast<int64_t>(session_limits.initial_window_size) * connection_window_streams) {}
+
+        Http2Session(const Http2Session&) = delete;
+        Http2Session& operator=(const Http2Session&) = delete;
+
+        // For a connection that opened with the preface: queues the server's SETTINGS.
+        void start() {
+            write_settings();
+        }
+
+        // For a connection upgraded from HTTP/1.1 (RFC 7540 3.2), once the 101 is queued:
+        // applies the settings of the request's HTTP2-Settings header and opens stream 1,
+        // whose request already arrived, for its response. False when the header is invalid.
+        bool upgrade(std::string_view http2_settings) {
+            std::optional<std::string> payload = decode_base64url(http2_settings);
+            if (!payload || payload->size() % 6 != 0 || apply_settings(*payload) != Http2Error::NO_ERROR) return false;
+            write_settings();
+            Stream& stream = streams[1];
+            stream.id = 1;
+            stream.remote_closed = true;
+            stream.send_window = peer_initial_window;
+            last_stream_id = 1;
+            return true;
+        }
+
+        // Consumes the complete frames at the front of `input`, calling on_event(const Event&)
+        // as streams progress, and returns how many bytes it used; a partial frame is left
+        // for the next call. It also stops once `output_room` bytes of frames are queued, so a
+        // client sending PINGs or SETTINGS without reading the replies is held back. After a
+        // connection error everything is consumed: the GOAWAY is queued and the connection is
+        // to be closed once it is sent.
+        template<typename Fn>
+        size_t feed(std::string_view input, size_t output_room, Fn&& on_event) {
+            if (is_failed) return input.size();
+            size_t used = 0;
+            if (awaiting_preface) {
+                if (input.size() < http2_preface.size()) {
+                    if (!http2_preface.starts_with(input)) fail(Http2Error::PROTOCOL_ERROR);
+                    return is_failed ? input.size() : 0;
+                }
+                if (!input.starts_with(http2_preface)) {
+                    fail(Http2Error::PROTOCOL_ERROR);
+                    return input.size();
+                }
+                awaiting_preface = false;
+                used = http2_preface.size();
+            }
+            while (!is_failed && output.size() < output_room && input.size() - used >= frame_header_size) {
+                const auto* header = reinterpret_cast<const unsigned char*>(input.data() + used);
+                size_t length = static_cast<size_t>(header[0]) << 16 | header[1] << 8 | header[2];
+                if (length > max_frame_size) {
+                    fail(Http2Error::FRAME_SIZE_ERROR);
+                    break;
+                }
+                if (input.size() - used < frame_header_size + length) break;
+                auto type = static_cast<FrameType>(header[3]);
+                uint8_t flags = header[4];
+                uint32_t stream_id = read_u32(header + 5) & 0x7fffffff;
+                std::string_view payload = input.substr(used + frame_header_size, length);
+                used += frame_header_size + length;
+                if (!settings_received && type != FrameType::SETTINGS) {
+                    fail(Http2Error::PROTOCOL_ERROR);
+                } else if (continuation_stream && (type != FrameType::CONTINUATION || stream_id != continuation_stream)) {
+                    fail(Http2Error::PROTOCOL_ERROR);
+                } else {
+                    on_frame(type, flags, stream_id, payload, on_event);
+                }
+            }
+            return is_failed ? input.size() : used;
+        }
+
+        // The stream while it is open, or nullptr once it has been answered or reset.
+        Stream* find(uint32_t stream_id) {
+            auto it = streams.find(stream_id);
+            return it == streams.end() ? nullptr : &it->second;
+        }
+
+        // During the HEAD event: report the stream's body as DATA events instead of buffering
+        // it into its request.
+        void stream_body(uint32_t stream_id) {
+            if (Stream* stream = find(stream_id)) stream->streamed_body = true;
+        }
+
+        // Queues HEADERS for the stream's response and its body for produce(). Ignored for a
+        // stream that has been reset, or already answered. Connection-level fields are left
+        // out, names are lowercased, and Date and Content-Length are added.
+        void respond(uint32_t stream_id, Response&& response) {
+            Stream* stream = find(stream_id);
+            if (!stream || stream->responded) return;
+            stream->responded = true;
+
+            const ResponseHeaders& headers = response.prepared ? response.prepared->fields() : response.headers;
+            std::string_view content_type = response.prepared ? response.prepared->media_type() : response.content_type;
+            HttpStatus status = response.prepared ? response.prepared->status_code() : response.status;
+            uint64_t length = 0;
+            if (response.prepared) {
+                stream->external = response.prepared->content();
+                length = stream->external.size();
+            } else if (response.file.fd >= 0) {
+                stream->file = response.file;
+                length = response.file.length;
+            } else {
+                stream->data = std::move(response.body);
+                stream->producer = std::move(response.stream);
+                length = stream->data.size();
+            }
+            stream->retained = std::move(response.retained);
+            bool bodiless = status == HttpStatus::NOT_MODIFIED || status == HttpStatus::NO_CONTENT;
+            if (bodiless) {
+                stream->data.clear();
+                stream->external = {};
+                stream->file = {};
+                stream->producer = nullptr;
+            }
+
+            block.clear();
+            encoder.begin_block(block);
+            char number[24];
+            auto end = std::to_chars(number, number + sizeof(number), static_cast<int>(status)).ptr;
+            encoder.encode(":status", std::string_view(number, end - number), true, block);
+            if (!content_type.empty() && !headers.contains("Content-Type")) {
+                encoder.encode("content-type", content_type, true, block);
+            }
+            for (const auto& header : headers) {
+                lowercase_name.assign(header.name);
+                for (char& c : lowercase_name) {
+                    if (c >= 'A' && c <= 'Z') c = static_cast<char>(c + ('a' - 'A'));
+                }
+                if (!forwarded_field(lowercase_name)) continue;
+                encoder.encode(lowercase_name, header.value, indexed_field(lowercase_name), block);
+            }
+            if (!bodiless && !stream->producer) {
+                end = std::to_chars(number, number + sizeof(number), length).ptr;
+                encoder.encode("content-length", std::string_view(number, end - number), false, block);
+            }
+            date_line.clear();
+            DateCache::instance().append_to(date_line);
+            // "Date: " ... "\r\n"
+            encoder.encode("date", std::string_view(date_line).substr(6, date_line.size() - 8), false, block);
+
+            bool empty = !stream->producer && stream_pending(*stream) == 0;
+            write_headers(stream_id, block, empty);
+            if (empty) {
+                finish_stream(stream_id);
+            } else {
+                sending.push_back(stream_id);
+            }
+        }
+
+        // Frames DATA until about `budget` bytes of output are queued, taking turns across
+        // streams one frame at a time, and within the flow-control windows the client grants.
+        // Streamed bodies are asked for more as their earlier chunks go out.
+        void produce(size_t budget) {
+            // After an upgrade, bodies wait for the client's preface: until then it is still
+            // switching protocols, and may not have room to buffer them.
+            if (!settings_received) return;
+            size_t start = output.size();
+            bool progressed = true;
+            while (progressed && !sending.empty() && output.size() - start < budget) {
+                progressed = false;
+                for (size_t turns = sending.size(); turns > 0 && output.size() - start < budget; turns--) {
+                    uint32_t stream_id = sending.front();
+                    sending.pop_front();
+                    Stream* stream = find(stream_id);
+                    if (!stream) continue;
+                    switch (write_data(*stream)) {
+                        case DataResult::BLOCKED:
+                            sending.push_back(stream_id);
+                            break;
+                        case DataResult::WROTE:
+                            sending.push_back(stream_id);
+                            progressed = true;
+                            break;
+                        case DataResult::FINISHED:
+                            finish_stream(stream_id);
+                            progressed = true;
+                            break;
+                        case DataResult::FAILED:
+                            reset_stream(stream_id, Http2Error::INTERNAL_ERROR);
+                            progressed = true;
+                            break;
+                    }
+                }
+            }
+        }
+
+        bool has_output() const { return !output.empty(); }
+        std::string take_output() { return std::exchange(output, {}); }
+        // Appends the frames queued so far, e.g. behind an HTTP/1.1 101 response.
+        void take_output(std::string& out) {
+            out += output;
+            output.clear();
+        }
+
+        // Sends GOAWAY: streams opened so far are answered, later ones are refused.
+        void shutdown() {
+            if (going_away) return;
+            going_away = true;
+            write_goaway(Http2Error::NO_ERROR);
+        }
+
+        // Nothing more will happen on the connection; close it once the output is sent.
+        bool finished() const { return is_failed || ((going_away || peer_going_away) && streams.empty()); }
+        bool failed() const { return is_failed; }
+        size_t open_streams() const { return streams.size(); }
+
+        // For the server's use: a handler is running for the stream, and will answer later. A
+        // stream reset meanwhile still counts against max_concurrent_streams until its handler
+        // has finished, so opening and resetting streams ("Rapid Reset") cannot pile up work.
+        void handler_started(uint32_t stream_id) {
+            if (Stream* stream = find(stream_id)) stream->handler_running = true;
+        }
+
+        void handler_finished(uint32_t stream_id) {
+            if (Stream* stream = find(stream_id)) {
+                stream->handler_running = false;
+            } else if (orphaned_handlers > 0) {
+                orphaned_handlers--;
+            }
+        }
+
+        // Some request is still arriving: a header block, or the body of an open stream.
+        bool receiving() const {
+            if (continuation_stream) return true;
+            return std::any_of(streams.begin(), streams.end(), [](const auto& entry) { return !entry.second.remote_closed; });
+        }
+
+        // Some response data waits in a stream, for a window or for output room.
+        bool sending_data() const { return !sending.empty(); }
+
+    private:
+        enum class FrameType : uint8_t {
+            DATA = 0x0,
+            HEADERS = 0x1,
+            PRIORITY = 0x2,
+            RST_STREAM = 0x3,
+            SETTINGS = 0x4,
+            PUSH_PROMISE = 0x5,
+            PING = 0x6,
+            GOAWAY = 0x7,
+            WINDOW_UPDATE = 0x8,
+            CONTINUATION = 0x9
+        };
+
+        enum class DataResult {
+            BLOCKED,
+            WROTE,
+            FINISHED,
+            FAILED
+        };
+
+        static constexpr uint8_t flag_end_stream = 0x1;
+        static constexpr uint8_t flag_ack = 0x1;
+        static constexpr uint8_t flag_end_headers = 0x4;
+        static constexpr uint8_t flag_padded = 0x8;
+        static constexpr uint8_t flag_priority = 0x20;
+        static constexpr size_t frame_header_size = 9;
+        // SETTINGS_MAX_FRAME_SIZE is left at its default, so peers send no larger frames.
+        static constexpr size_t max_frame_size = 16384;
+        static constexpr int64_t max_window = 0x7fffffff;
+        // The connection-level receive window, in stream windows: room for several streams
+        // to upload at full rate.
+        static constexpr int64_t connection_window_streams = 4;
+
+        Http2Limits limits;
+        HpackDecoder decoder;
+        HpackEncoder encoder;
+        std::unordered_map<uint32_t, Stream> streams;
+        std::deque<uint32_t> sending;
+        std::string output;
+        std::string block;
+        std::string lowercase_name;
+        std::string date_line;
+        // A header block that continues in CONTINUATION frames.
+        std::string header_block;
+        uint32_t continuation_stream = 0;
+        uint8_t header_flags = 0;
+        uint32_t last_stream_id = 0;
+        size_t orphaned_handlers = 0;          // of streams reset while their handler ran
+        std::deque<uint32_t> reset_streams;    // the latest ones we reset, oldest first
+        bool awaiting_preface = true;
+        bool settings_received = false;
+        bool going_away = false;
+        bool peer_going_away = false;
+        bool is_failed = false;
+        int64_t connection_window;            // what the client may still send
+        uint32_t connection_unacknowledged = 0;
+        int64_t connection_send_window = 65535;
+        int64_t peer_initial_window = 65535;
+        size_t peer_max_frame_size = 16384;
+
+        static uint32_t read_u32(const unsigned char* p) {
+            return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+        }
+
+        static uint32_t read_u32(std::string_view text) {
+            return read_u32(reinterpret_cast<const unsigned char*>(text.data()));
+        }
+
+        static void append_u32(std::string& out, uint32_t value) {
+            char bytes[4] = {static_cast<char>(value >> 24), static_cast<char>(value >> 16), static_cast<char>(value >> 8),
+                             static_cast<char>(value)};
+            out.append(bytes, 4);
+        }
+
+        static void append_frame_header(std::string& out, size_t length, FrameType type, uint8_t flags, uint32_t stream_id) {
+            char header[frame_header_size] = {static_cast<char>(length >> 16), static_cast<char>(length >> 8),
+                                              static_cast<char>(length), static_cast<char>(type), static_cast<char>(flags)};
+            std::string_view prefix(header, 5);
+            out += prefix;
+            append_u32(out, stream_id & 0x7fffffff);
+        }
+
+        static std::optional<std::string> decode_base64url(std::string_view text) {
+            while (!text.empty() && text.back() == '=') text.remove_suffix(1);
+            std::string out;
+            uint32_t bits = 0;
+            int count = 0;
+            for (char c : text) {
+                int value;
+                if (c >= 'A' && c <= 'Z') value = c - 'A';
+                else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+                else if (c >= '0' && c <= '9') value = c - '0' + 52;
+                else if (c == '-' || c == '+') value = 62;
+                else if (c == '_' || c == '/') value = 63;
+                else return std::nullopt;
+                bits = bits << 6 | value;
+                count += 6;
+                if (count >= 8) {
+                    count -= 8;
+                    out += static_cast<char>(bits >> count);
+                }
+            }
+            return out;
+        }
+
+        // Request fields that are hop-by-hop in HTTP/1.1 have no place in HTTP/2.
+        static bool connection_field(std::string_view name) {
+            return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+                   name == "transfer-encoding" || name == "upgrade";
+        }
+
+        static bool forwarded_field(std::string_view name) {
+            return !connection_field(name) && name != "content-length" && name != "date";
+        }
+
+        // Fields whose values repeat across responses are worth a dynamic table entry.
+        static bool indexed_field(std::string_view name) {
+            return name != "etag" && name != "last-modified" && name != "content-range" && name != "set-cookie" &&
+                   name != "age" && name != "expires" && name != "location";
+        }
+
+        void write_settings() {
+            std::string payload;
+            auto setting = [&payload](uint16_t id, uint32_t value) {
+                payload += static_cast<char>(id >> 8);
+                payload += static_cast<char>(id);
+                append_u32(payload, value);
+            };
+            setting(0x3, limits.max_concurrent_streams);
+            setting(0x4, limits.initial_window_size);
+            setting(0x6, static_cast<uint32_t>(limits.max_header_list_size));
+            append_frame_header(output, payload.size(), FrameType::SETTINGS, 0, 0);
+            output += payload;
+            if (connection_window > 65535) write_window_update(0, static_cast<uint32_t>(connection_window - 65535));
+        }
+
+        void write_window_update(uint32_t stream_id, uint32_t increment) {
+            append_frame_header(output, 4, FrameType::WINDOW_UPDATE, 0, stream_id);
+            append_u32(output, increment);
+        }
+
+        void write_goaway(Http2Error code) {
+            append_frame_header(output, 8, FrameType::GOAWAY, 0, 0);
+            append_u32(output, last_stream_id);
+            append_u32(output, static_cast<uint32_t>(code));
+        }
+
+        void write_headers(uint32_t stream_id, std::string_view fields, bool end_stream) {
+            size_t first = std::min(fields.size(), peer_max_frame_size);
+            uint8_t flags = (end_stream ? flag_end_stream : 0) | (first == fields.size() ? flag_end_headers : 0);
+            append_frame_header(output, first, FrameType::HEADERS, flags, stream_id);
+            output += fields.substr(0, first);
+            for (size_t offset = first; offset < fields.size();) {
+                size_t length = std::min(fields.size() - offset, peer_max_frame_size);
+                offset += length;
+                append_frame_header(output, length, FrameType::CONTINUATION, offset == fields.size() ? flag_end_headers : 0,
+                                    stream_id);
+                output += fields.substr(offset - length, length);
+            }
+        }
+
+        void fail(Http2Error code) {
+            if (is_failed) return;
+            is_failed = true;
+            going_away = true;
+            write_goaway(code);
+        }
+
+        void reset_stream(uint32_t stream_id, Http2Error code) {
+            append_frame_header(output, 4, FrameType::RST_STREAM, 0, stream_id);
+            append_u32(output, static_cast<uint32_t>(code));
+            drop_stream(stream_id);
+            // The client may still have frames of the stream in flight.
+            reset_streams.push_back(stream_id);
+            if (reset_streams.size() > limits.max_concurrent_streams) reset_streams.pop_front();
+        }
+
+        bool drop_stream(uint32_t stream_id) {
+            auto it = streams.find(stream_id);
+            if (it == streams.end()) return false;
+            if (it->second.handler_running) orphaned_handlers++;
+            streams.erase(it);
+            return true;
+        }
+
+        // The response is complete. A client still sending its request is told to stop.
+        void finish_stream(uint32_t stream_id) {
+            auto it = streams.find(stream_id);
+            if (it == streams.end()) return;
+            if (!it->second.remote_closed) {
+                reset_stream(stream_id, Http2Error::NO_ERROR);
+                return;
+            }
+            streams.erase(it);
+        }
+
+        static size_t stream_pending(const Stream& stream) {
+            return stream.data.size() - stream.data_offset + stream.external.size() + stream.file.length;
+        }
+
+        // Writes one DATA frame of the stream's body.
+        DataResult write_data(Stream& stream) {
+            if (stream.data_offset == stream.data.size() && stream.external.empty() && stream.file.length == 0 && stream.producer) {
+                stream.data.clear();
+                stream.data_offset = 0;
+                bool more;
+                try {
+                    more = stream.producer(stream.data);
+                } catch (const std::exception&) {
+                    return DataResult::FAILED;
+                }
+                if (!more) stream.producer = nullptr;
+                if (stream.data.empty() && more) return DataResult::WROTE;
+            }
+            size_t pending = stream_pending(stream);
+            int64_t window = std::min(stream.send_window, connection_send_window);
+            size_t length = std::min<uint64_t>(pending, std::min<uint64_t>(peer_max_frame_size, std::max<int64_t>(window, 0)));
+            if (length == 0 && pending > 0) return DataResult::BLOCKED;
+
+            size_t header_at = output.size();
+            append_frame_header(output, length, FrameType::DATA, 0, stream.id);
+            if (stream.data_offset < stream.data.size()) {
+                length = std::min(length, stream.data.size() - stream.data_offset);
+                output.append(stream.data, stream.data_offset, length);
+                stream.data_offset += length;
+            } else if (!stream.external.empty()) {
+                output += stream.external.substr(0, length);
+                stream.external.remove_prefix(length);
+            } else if (stream.file.length > 0) {
+                output.resize(header_at + frame_header_size + length);
+                ssize_t n = pread(stream.file.fd, output.data() + header_at + frame_header_size, length,
+                                  static_cast<off_t>(stream.file.offset));
+                if (n <= 0) {
+                    output.resize(header_at);
+                    return DataResult::FAILED;
+                }
+                length = static_cast<size_t>(n);
+                output.resize(header_at + frame_header_size + length);
+                stream.file.offset += length;
+                stream.file.length -= length;
+            }
+            bool last = !stream.producer && stream_pending(stream) == 0;
+            output[header_at] = static_cast<char>(length >> 16);
+            output[header_at + 1] = static_cast<char>(length >> 8);
+            output[header_at + 2] = static_cast<char>(length);
+            output[header_at + 4] = static_cast<char>(last ? flag_end_stream : 0);
+            stream.send_window -= static_cast<int64_t>(length);
+            connection_send_window -= static_cast<int64_t>(length);
+            return last ? DataResult::FINISHED : DataResult::WROTE;
+        }
+
+        template<typename Fn>
+        void on_frame(FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload, Fn& on_event) {
+            switch (type) {
+                case FrameType::DATA:
+                    on_data(flags, stream_id, payload, on_event);
+                    return;
+                case FrameType::HEADERS:
+                    on_headers(flags, stream_id, payload, on_event);
+                    return;
+                case FrameType::CONTINUATION:
+                    if (stream_id == 0) {
+                        fail(Http2Error::PROTOCOL_ERROR);
+                        return;
+                    }
+                    header_block += payload;
+                    if (header_block.size() > 2 * limits.max_header_list_size) {
+                        fail(Http2Error::ENHANCE_YOUR_CALM);
+                        return;
+                    }
+                    if (flags & flag_end_headers) end_headers(on_event);
+                    return;
+                case FrameType::PRIORITY:
+                    if (stream_id == 0) fail(Http2Error::PROTOCOL_ERROR);
+                    else if (payload.size() != 5) fail(Http2Error::FRAME_SIZE_ERROR);
+                    return;
+                case FrameType::RST_STREAM:
+                    if (stream_id == 0 || stream_id > last_stream_id) {
+                        fail(Http2Error::PROTOCOL_ERROR);
+                    } else if (payload.size() != 4) {
+                        fail(Http2Error::FRAME_SIZE_ERROR);
+                    } else if (drop_stream(stream_id)) {
+                        on_event(Event{EventKind::RESET, stream_id, {}});
+                    }
+                    return;
+                case FrameType::SETTINGS:
+                    on_settings(flags, stream_id, payload);
+                    return;
+                case FrameType::PING:
+                    if (stream_id != 0) {
+                        fail(Http2Error::PROTOCOL_ERROR);
+                    } else if (payload.size() != 8) {
+                        fail(Http2Error::FRAME_SIZE_ERROR);
+                    } else if (!(flags & flag_ack)) {
+                        append_frame_header(output, 8, FrameType::PING, flag_ack, 0);
+                        output += payload;
+                    }
+                    return;
+                case FrameType::GOAWAY:
+                    if (stream_id != 0) fail(Http2Error::PROTOCOL_ERROR);
+                    else peer_going_away = true;
+                    return;
+                case FrameType::WINDOW_UPDATE:
+                    on_window_update(stream_id, payload, on_event);
+                    return;
+                case FrameType::PUSH_PROMISE:
+                    fail(Http2Error::PROTOCOL_ERROR);
+                    return;
+                default:
+                    return;   // unknown frame types are ignored
+            }
+        }
+
+        // Strips the Pad Length byte and the padding. False when the padding is too long.
+        static bool strip_padding(uint8_t flags, std::string_view& payload) {
+            if (!(flags & flag_padded)) return true;
+            if (payload.empty()) return false;
+            size_t padding = static_cast<unsigned char>(payload.front());
+            payload.remove_prefix(1);
+            if (padding > payload.size()) return false;
+            payload.remove_suffix(padding);
+            return true;
+        }
+
+        template<typename Fn>
+        void on_headers(uint8_t flags, uint32_t stream_id, std::string_view payload, Fn& on_event) {
+            if (stream_id == 0 || stream_id % 2 == 0 || !strip_padding(flags, payload)) {
+                fail(Http2Error::PROTOCOL_ERROR);
+                return;
+            }
+            if (flags & flag_priority) {
+                if (payload.size() < 5) {
+                    fail(Http2Error::PROTOCOL_ERROR);
+                    return;
+                }
+                payload.remove_prefix(5);
+            }
+            header_block.assign(payload);
+            header_flags = flags;
+            continuation_stream = stream_id;
+            if (flags & flag_end_headers) end_headers(on_event);
+        }
+
+        // A complete header block: a new stream's request, or the trailers of an open one.
+        template<typename Fn>
+        void end_headers(Fn& on_event) {
+            uint32_t stream_id = std::exchange(continuation_stream, 0);
+            bool end_stream = header_flags & flag_end_stream;
+
+            if (Stream* stream = find(stream_id)) {
+                if (stream->remote_closed) {
+                    fail(Http2Error::STREAM_CLOSED);
+                    return;
+                }
+                if (!decoder.decode(header_block, [](std::string_view, std::string_view) {})) {
+                    fail(Http2Error::COMPRESSION_ERROR);
+                    return;
+                }
+                if (!end_stream) {
+                    reset_stream(stream_id, Http2Error::PROTOCOL_ERROR);
+                    on_event(Event{EventKind::RESET, stream_id, {}});
+                    return;
+                }
+                stream->remote_closed = true;
+                // Already answered, with an early 413 or 431: no handler is to run for it.
+                if (!stream->responded) on_event(Event{EventKind::END, stream_id, {}});
+                return;
+            }
+
+            // The block has to be decoded even when the stream is refused, so that the
+            // decoder's table stays in step with the client's encoder.
+            Request request;
+            bool malformed = false;
+            size_t list_size = 0;
+            if (!decode_request(request, malformed, list_size)) {
+                fail(Http2Error::COMPRESSION_ERROR);
+                return;
+            }
+            if (stream_id <= last_stream_id) {
+                // Trailers sent before the client saw our RST_STREAM are ignored (RFC 9113 5.1).
+                if (std::find(reset_streams.begin(), reset_streams.end(), stream_id) != reset_streams.end()) return;
+                fail(Http2Error::PROTOCOL_ERROR);   // stream ids only go up
+                return;
+            }
+            last_stream_id = stream_id;
+            if (going_away) return;
+            if (streams.size() + orphaned_handlers >= limits.max_concurrent_streams) {
+                reset_stream(stream_id, Http2Error::REFUSED_STREAM);
+                return;
+            }
+            if (malformed) {
+                reset_stream(stream_id, Http2Error::PROTOCOL_ERROR);
+                return;
+            }
+
+            Stream& stream = streams[stream_id];
+            stream.id = stream_id;
+            stream.request = std::move(request);
+            stream.remote_closed = end_stream;
+            stream.send_window = peer_initial_window;
+            if (list_size > limits.max_header_list_size) {
+                respond(stream_id, custom_response(HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE));
+                return;
+            }
+            on_event(Event{EventKind::HEAD, stream_id, {}});
+            if (end_stream && find(stream_id)) on_event(Event{EventKind::END, stream_id, {}});
+        }
+
+        // Builds a request from the header block (RFC 9113 8.3.1). False on a decoding error;
+        // `malformed` is set for a request the stream has to be reset for.
+        bool decode_request(Request& request, bool& malformed, size_t& list_size) {
+            bool regular_seen = false;
+            bool has_method = false;
+            bool has_scheme = false;
+            std::string authority;
+            std::string cookies;
+            bool decoded = decoder.decode(header_block, [&](std::string_view name, std::string_view value) {
+                list_size += name.size() + value.size() + HpackTable::entry_overhead;
+                if (list_size > limits.max_header_list_size) return;
+                if (!name.empty() && name.front() == ':') {
+                    if (regular_seen) {
+                        malformed = true;
+                    } else if (name == ":method") {
+                        request.method = string_to_method(value);
+                        has_method = true;
+                    } else if (name == ":path") {
+                        request.uri = value;
+                    } else if (name == ":scheme") {
+                        has_scheme = true;
+                    } else if (name == ":authority") {
+                        authority = value;
+                    } else {
+                        malformed = true;
+                    }
+                    return;
+                }
+                regular_seen = true;
+                if (std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; }) ||
+                    connection_field(name) || (name == "te" && value != "trailers")) {
+                    malformed = true;
+                } else if (name == "cookie") {
+                    // Split across fields for compression; rejoined for HTTP/1.1 semantics.
+                    if (!cookies.empty()) cookies += "; ";
+                    cookies += value;
+                } else {
+                    request.headers.add(name, value);
+                }
+            });
+            if (!decoded) return false;
+            if (!has_method || !has_scheme || request.uri.empty()) malformed = true;
+            if (!authority.empty() && !request.headers.contains(HeaderId::HOST)) request.headers.add("host", authority);
+            if (!cookies.empty()) request.headers.add("cookie", cookies);
+            request.version = {2, 0};
+            if (size_t query = request.uri.find('?'); query != std::pmr::string::npos) {
+                request.query_params.parse(std::string_view(request.uri).substr(query + 1));
+            }
+            return true;
+        }
+
+        template<typename Fn>
+        void on_data(uint8_t flags, uint32_t stream_id, std::string_view payload, Fn& on_event) {
+            if (stream_id == 0 || stream_id > last_stream_id) {
+                fail(Http2Error::PROTOCOL_ERROR);
+                return;
+            }
+            // Padding counts against flow control too.
+            auto flow = static_cast<uint32_t>(payload.size());
+            connection_window -= flow;
+            if (connection_window < 0) {
+                fail(Http2Error::FLOW_CONTROL_ERROR);
+                return;
+            }
+            if (!strip_padding(flags, payload)) {
+                fail(Http2Error::PROTOCOL_ERROR);
+                return;
+            }
+            // Every byte is consumed as it arrives, so windows are reopened right away, in
+            // updates of half a window at a time.
+            connection_unacknowledged += flow;
+            if (connection_unacknowledged >= limits.initial_window_size / 2) {
+                write_window_update(0, connection_unacknowledged);
+                connection_window += connection_unacknowledged;
+                connection_unacknowledged = 0;
+            }
+
+            Stream* stream = find(stream_id);
+            if (!stream || stream->remote_closed) return;   // already answered or reset
+            stream->unacknowledged += flow;
+            if (stream->unacknowledged > limits.initial_window_size) {
+                reset_stream(stream_id, Http2Error::FLOW_CONTROL_ERROR);
+                on_event(Event{EventKind::RESET, stream_id, {}});
+                return;
+            }
+            bool end_stream = flags & flag_end_stream;
+            if (stream->streamed_body) {
+                if (!payload.empty()) on_event(Event{EventKind::DATA, stream_id, payload});
+                stream = find(stream_id);
+                if (!stream) return;
+            } else if (!stream->responded) {
+                if (stream->request.body.size() + payload.size() > limits.max_body_size) {
+                    stream->request.body.clear();
+                    respond(stream_id, custom_response(HttpStatus::PAYLOAD_TOO_LARGE));
+                    return;
+                }
+                stream->request.body += payload;
+            }
+            if (end_stream) {
+                stream->remote_closed = true;
+                if (!stream->responded) on_event(Event{EventKind::END, stream_id, {}});
+            } else if (stream->unacknowledged >= limits.initial_window_size / 2) {
+                write_window_update(stream_id, stream->unacknowledged);
+                stream->unacknowledged = 0;
+            }
+        }
+
+        void on_settings(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+            if (stream_id != 0) {
+                fail(Http2Error::PROTOCOL_ERROR);
+                return;
+            }
+            if (flags & flag_ack) {
+                if (!payload.empty()) fail(Http2Error::FRAME_SIZE_ERROR);
+                return;
+            }
+            if (payload.size() % 6 != 0) {
+                fail(Http2Error::FRAME_SIZE_ERROR);
+                return;
+            }
+            if (Http2Error error = apply_settings(payload); error != Http2Error::NO_ERROR) {
+                fail(error);
+                return;
+            }
+            settings_received = true;
+            append_frame_header(output, 0, FrameType::SETTINGS, flag_ack, 0);
+        }
+
+        Http2Error apply_settings(std::string_view payload) {
+            for (size_t i = 0; i + 6 <= payload.size(); i += 6) {
+                auto id = static_cast<uint16_t>(static_cast<unsigned char>(payload[i]) << 8 | static_cast<unsigned char>(payload[i + 1]));
+                uint32_t value = read_u32(payload.substr(i + 2, 4));
+                switch (id) {
+                    case 0x1:   // HEADER_TABLE_SIZE
+                        encoder.set_max_capacity(value);
+                        break;
+                    case 0x2:   // ENABLE_PUSH
+                        if (value > 1) return Http2Error::PROTOCOL_ERROR;
+                        break;
+                    case 0x4: { // INITIAL_WINDOW_SIZE, which also moves the windows of open streams
+                        if (value > max_window) return Http2Error::FLOW_CONTROL_ERROR;
+                        int64_t delta = static_cast<int64_t>(value) - peer_initial_window;
+                        for (auto& [id_, stream] : streams) stream.send_window += delta;
+                        peer_initial_window = value;
+                        break;
+                    }
+                    case 0x5:   // MAX_FRAME_SIZE
+                        if (value < 16384 || value > 16777215) return Http2Error::PROTOCOL_ERROR;
+                        peer_max_frame_size = value;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            return Http2Error::NO_ERROR;
+        }
+
+        template<typename Fn>
+        void on_window_update(uint32_t stream_id, std::string_view payload, Fn& on_event) {
+            if (payload.size() != 4) {
+                fail(Http2Error::FRAME_SIZE_ERROR);
+                return;
+            }
+            int64_t increment = read_u32(payload) & 0x7fffffff;
+            if (stream_id == 0) {
+                connection_send_window += increment;
+                if (increment == 0 || connection_send_window > max_window) fail(Http2Error::FLOW_CONTROL_ERROR);
+                return;
+            }
+            Stream* stream = find(stream_id);
+            if (!stream) return;
+            stream->send_window += increment;
+            if (increment == 0 || stream->send_window > max_window) {
+                reset_stream(stream_id, increment == 0 ? Http2Error::PROTOCOL_ERROR : Http2Error::FLOW_CONTROL_ERROR);
+                on_event(Event{EventKind::RESET, stream_id, {}});
+            }
+        }
+    };
+}
+
+#endif //HTTP_HTTP2_H
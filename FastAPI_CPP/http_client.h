@@ -0,0 +1,103 @@
+// Tomas Costantino
+
+#ifndef SERVERC___HTTP_CLIENT_H
+#define SERVERC___HTTP_CLIENT_H
+
+#include "http_lib.h"
+#include "io_context.h"
+#include "task.h"
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace fastapi_cpp {
+
+    struct ClientResponse {
+        int status = 0;
+        http::ResponseHeaders headers;
+        std::string body;
+    };
+
+    namespace client_detail {
+        inline void parse_head(std::string_view head, ClientResponse& response) {
+            size_t space = head.find(' ');
+            if (!head.starts_with("HTTP/") || space == std::string_view::npos) {
+                throw std::runtime_error("Malformed response status line");
+            }
+            std::from_chars(head.data() + space + 1, head.data() + head.size(), response.status);
+
+            size_t line = head.find("\r\n");
+            while (line != std::string_view::npos && line + 2 < head.size()) {
+                line += 2;
+                size_t end = head.find("\r\n", line);
+                if (end == std::string_view::npos) end = head.size();
+                size_t colon = head.find(':', line);
+                if (colon < end) {
+                    size_t value = head.find_first_not_of(' ', colon + 1);
+                    if (value > end) value = end;
+                    response.headers.add(head.substr(line, colon - line), head.substr(value, end - value));
+                }
+                line = end == head.size() ? std::string_view::npos : end;
+            }
+        }
+    }
+
+    // Minimal outbound HTTP/1.0 client for async handlers, running on the caller's event
+    // loop. Each call opens one connection, sends the request with Connection: close and
+    // reads the response until Content-Length is satisfied or the peer closes. HTTP/1.0 keeps
+    // the backend from answering with chunked encoding.
+    //
+    //     auto reply = co_await fastapi_cpp::http_fetch("127.0.0.1", 9000, "GET", "/health");
+    inline Task<ClientResponse> http_fetch(std::string host, int port, std::string method, std::string target,
+                                           std::string body = {}, std::string content_type = "application/json") {
+        int fd = co_await async_connect(host, port);
+        ClientResponse response;
+        std::string raw;
+        try {
+            std::string request = method + " " + target + " HTTP/1.0\r\nHost: " + host +
+                                  "\r\nConnection: close\r\n";
+            if (!body.empty()) {
+                request += "Content-Type: " + content_type + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+            }
+            request += "\r\n";
+            request += body;
+            co_await async_write(fd, request);
+
+            size_t head_end = std::string::npos;
+            size_t expected = std::string::npos;
+            char chunk[16384];
+            while (true) {
+                size_t n = co_await async_read(fd, chunk, sizeof(chunk));
+                if (n == 0) break;
+                raw.append(chunk, n);
+                if (head_end == std::string::npos) {
+                    head_end = raw.find("\r\n\r\n");
+                    if (head_end == std::string::npos) continue;
+                    client_detail::parse_head(std::string_view(raw).substr(0, head_end), response);
+                    if (const std::string* length = response.headers.find("Content-Length")) {
+                        size_t value = 0;
+                        std::from_chars(length->data(), length->data() + length->size(), value);
+                        expected = head_end + 4 + value;
+                    }
+                }
+                if (expected != std::string::npos && raw.size() >= expected) break;
+            }
+            if (head_end == std::string::npos) {
+                throw std::runtime_error("Malformed response from " + host);
+            }
+            response.body = raw.substr(head_end + 4);
+        } catch (...) {
+            async_close(fd);
+            throw;
+        }
+        async_close(fd);
+        co_return response;
+    }
+
+    inline Task<ClientResponse> http_get(std::string host, int port, std::string target) {
+        co_return co_await http_fetch(std::move(host), port, "GET", std::move(target));
+    }
+}
+
+#endif //SERVERC___HTTP_CLIENT_H
@@ -0,0 +1,124 @@
+// Tomas Costantino
+
+#ifndef HTTP_HTTP_DATE_H
+#define HTTP_HTTP_DATE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace http {
+
+    // Process-wide "Date: <IMF-fixdate>\r\n" header line, reformatted at most once per second
+    // and shared by every worker. The text sits in atomic words guarded by a sequence counter
+    // (a seqlock), so readers never block and never see a half-written date.
+    class DateCache {
+    public:
+        static constexpr size_t line_length = 37;   // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+
+        static DateCache& instance() {
+            static DateCache cache;
+            return cache;
+        }
+
+        // Reformats the line if the wall-clock second has changed. Cheap enough to call on
+        // every event-loop iteration.
+        void refresh() {
+            int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+            int64_t current = second.load(std::memory_order_relaxed);
+            if (now == current) return;
+            if (!second.compare_exchange_strong(current, now, std::memory_order_acq_rel)) return;
+
+            char text[words * 8] = {};
+            format(now, text);
+            uint64_t seq = sequence.load(std::memory_order_relaxed);
+            sequence.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < words; i++) {
+                uint64_t word;
+                std::memcpy(&word, text + i * 8, 8);
+                line[i].store(word, std::memory_order_relaxed);
+            }
+            sequence.store(seq + 2, std::memory_order_release);
+        }
+
+        void append_to(std::string& out) {
+            if (second.load(std::memory_order_relaxed) == 0) refresh();
+            char text[words * 8];
+            while (true) {
+                uint64_t before = sequence.load(std::memory_order_acquire);
+                if (before & 1) continue;
+                for (size_t i = 0; i < words; i++) {
+                    uint64_t word = line[i].load(std::memory_order_relaxed);
+                    std::memcpy(text + i * 8, &word, 8);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence.load(std::memory_order_relaxed) == before) break;
+            }
+            out.append(text, line_length);
+        }
+
+    private:
+        static constexpr size_t words = (line_length + 7) / 8;
+
+        std::atomic<int64_t> second{0};
+        std::atomic<uint64_t> sequence{0};
+        std::array<std::atomic<uint64_t>, words> line{};
+
+        DateCache() = default;
+
+        static void format(int64_t seconds, char* out) {
+            std::time_t t = static_cast<std::time_t>(seconds);
+            std::tm utc{};
+            gmtime_r(&t, &utc);
+            std::strftime(out, line_length + 1, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &utc);
+        }
+    };
+
+    // IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") for Last-Modified and the like.
+    inline std::string format_http_date(int64_t seconds) {
+        std::time_t t = static_cast<std::time_t>(seconds);
+        std::tm utc{};
+        gmtime_r(&t, &utc);
+        char text[32];
+        size_t n = std::strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S GMT", &utc);
+        return std::string(text, n);
+    }
+
+    // Seconds since the epoch for an IMF-fixdate, or nullopt for anything else. The obsolete
+    // RFC 850 and asctime forms are not accepted; recipients may treat them as invalid.
+    inline std::optional<int64_t> parse_http_date(std::string_view text) {
+        static constexpr std::string_view months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        if (text.size() != 29 || text[3] != ',' || text.substr(25) != " GMT") return std::nullopt;
+        auto number = [&](size_t at, size_t digits) -> int {
+            int value = 0;
+            for (size_t i = at; i < at + digits; i++) {
+                if (text[i] < '0' || text[i] > '9') return -1;
+                value = value * 10 + (text[i] - '0');
+            }
+            return value;
+        };
+        size_t month = months.find(text.substr(8, 3));
+        int day = number(5, 2), year = number(12, 4), hour = number(17, 2), minute = number(20, 2), second = number(23, 2);
+        if (month == std::string_view::npos || month % 3 != 0 || day < 1 || year < 0 || hour < 0 || minute < 0 || second < 0) {
+            return std::nullopt;
+        }
+        std::tm utc{};
+        utc.tm_year = year - 1900;
+        utc.tm_mon = static_cast<int>(month / 3);
+        utc.tm_mday = day;
+        utc.tm_hour = hour;
+        utc.tm_min = minute;
+        utc.tm_sec = second;
+        return static_cast<int64_t>(timegm(&utc));
+    }
+}
+
+#endif //HTTP_HTTP_DATE_H
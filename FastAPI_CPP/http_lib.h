@@ -4,11 +4,26 @@
 #define HTTP_LIB_H
 
 #include <string>
+#include <array>
+#include <atomic>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <sstream>
 #include <vector>
+#include <functional>
 #include <algorithm>
 #include <variant>
+#include <string_view>
+#include <stdexcept>
+#include "request_parser.h"
+#include "json_writer.h"
+#include "response_headers.h"
+#include "request_headers.h"
+#include "http_date.h"
+#include "compression.h"
+#include <charconv>
+#include <cstdint>
 
 namespace http {
 
@@ -36,10 +51,8 @@ namespace http {
             return JSON(Array(init.begin(), init.end()));
         }
 
-        static JSON parse(const std::string& json_string) {
-            size_t index = 0;
-            return parse_value(json_string, index);
-        }
+        // Defined in json_document.h: parses through the SIMD-indexed JSONDocument.
+        static JSON parse(const std::string& json_string);
 
         static std::map<std::string, JSON> json_to_map(const JSON& json) {
             if (std::holds_alternative<JSON::Object>(json.get_value())) {
@@ -51,36 +64,33 @@ namespace http {
         const Value& get_value() const { return m_value; }
 
         std::string stringify() const {
-            return std::visit([](auto&& arg) -> std::string {
+            std::string out;
+            stringify(out);
+            return out;
+        }
+
+        // Appends this value to `out` without building intermediate strings.
+        void stringify(std::string& out) const {
+            JSONWriter writer(out);
+            write(writer);
+        }
+
+        void write(JSONWriter& writer) const {
+            std::visit([&writer](auto&& arg) {
                 using T = std::decay_t<decltype(arg)>;
-                if constexpr (std::is_same_v<T, std::nullptr_t>) {
-                    return "null";
-                } else if constexpr (std::is_same_v<T, bool>) {
-                    return arg ? "true" : "false";
-                } else if constexpr (std::is_same_v<T, int>) {
-                    return std::to_string(arg);
-                } else if constexpr (std::is_same_v<T, double>) {
-                    return std::to_string(arg);
-                } else if constexpr (std::is_same_v<T, std::string>) {
-                    return "\"" + escape_string(arg) + "\"";
-                } else if constexpr (std::is_same_v<T, Array>) {
-                    std::string result = "[";
-                    for (size_t i = 0; i < arg.size(); ++i) {
-                        if (i > 0) result += ",";
-                        result += arg[i].stringify();
-                    }
-                    result += "]";
-                    return result;
+                if constexpr (std::is_same_v<T, Array>) {
+                    writer.begin_array();
+                    for (const auto& item : arg) item.write(writer);
+                    writer.end_array();
                 } else if constexpr (std::is_same_v<T, Object>) {
-                    std::string result = "{";
-                    bool first = true;
+                    writer.begin_object();
                     for (const auto& [key, value] : arg) {
-                        if (!first) result += ",";
-                        result += "\"" + escape_string(key) + "\":" + value.stringify();
-                        first = false;
+                        writer.key(key);
+                        value.write(writer);
                     }
-                    result += "}";
-                    return result;
+                    writer.end_object();
+                } else {
+                    writer.value(arg);
                 }
             }, m_value);
         }
@@ -95,204 +105,6 @@ namespace http {
 
     private:
         Value m_value;
-
-        static std::string escape_string(const std::string& s) {
-            std::string result;
-            for (char c : s) {
-                switch (c) {
-                    case '"': result += "\\\""; break;
-                    case '\\': result += "\\\\"; break;
-                    case '\b': result += "\\b"; break;
-                    case '\f': result += "\\f"; break;
-                    case '\n': result += "\\n"; break;
-                    case '\r': result += "\\r"; break;
-                    case '\t': result += "\\t"; break;
-                    default:
-                        if ('\x00' <= c && c <= '\x1f') {
-                            result += "\\u" + std::string(4 - std::to_string((int)c).length(), '0') + std::to_string((int)c);
-                        } else {
-                            result += c;
-                        }
-                }
-            }
-            return result;
-        }
-
-        static JSON parse_value(const std::string& json_string, size_t& index) {
-            skip_whitespace(json_string, index);
-
-            if (index >= json_string.length()) {
-                throw std::runtime_error("Unexpected end of input");
-            }
-
-            char c = json_string[index];
-            if (c == '{') {
-                return parse_object(json_string, index);
-            } else if (c == '[') {
-                return parse_array(json_string, index);
-            } else if (c == '"') {
-                return parse_string(json_string, index);
-            } else if (c == 't' || c == 'f') {
-                return parse_boolean(json_string, index);
-            } else if (c == 'n') {
-                return parse_null(json_string, index);
-            } else if (c == '-' || (c >= '0' && c <= '9')) {
-                return parse_number(json_string, index);
-            }
-
-            throw std::runtime_error("Unexpected character");
-        }
-
-        static JSON parse_object(const std::string& json_string, size_t& index) {
-            Object obj;
-            index++;
-
-            while (index < json_string.length()) {
-                skip_whitespace(json_string, index);
-                if (json_string[index] == '}') {
-                    index++;
-                    return JSON(obj);
-                }
-
-                if (!obj.empty()) {
-                    if (json_string[index] != ',') {
-                        throw std::runtime_error("Expected ',' in object");
-                    }
-                    index++;
-                    skip_whitespace(json_string, index);
-                }
-
-                JSON key_json = parse_string(json_string, index);
-                if (!key_json.is_string()) {
-                    throw std::runtime_error("Object key must be a string");
-                }
-                std::string key = key_json.as_string();
-
-                skip_whitespace(json_string, index);
-
-                if (json_string[index] != ':') {
-                    throw std::runtime_error("Expected ':' in object");
-                }
-                index++;
-
-                JSON value = parse_value(json_string, index);
-                obj[key] = value;
-            }
-
-            throw std::runtime_error("Unterminated object");
-        }
-
-        static JSON parse_array(const std::string& json_string, size_t& index) {
-            Array arr;
-            index++;
-
-            while (index < json_string.length()) {
-                skip_whitespace(json_string, index);
-                if (json_string[index] == ']') {
-                    index++;
-                    return JSON(arr);
-                }
-
-                if (!arr.empty()) {
-                    if (json_string[index] != ',') {
-                        throw std::runtime_error("Expected ',' in array");
-                    }
-                    index++;
-                }
-
-                arr.push_back(parse_value(json_string, index));
-            }
-
-            throw std::runtime_error("Unterminated array");
-        }
-
-        static JSON parse_string(const std::string& json_string, size_t& index) {
-            index++;
-            std::string result;
-            while (index < json_string.length()) {
-                char c = json_string[index++];
-                if (c == '"') {
-                    return JSON(result);
-                } else if (c == '\\') {
-                    if (index >= json_string.length()) {
-                        throw std::runtime_error("Unterminated string");
-                    }
-                    char next = json_string[index++];
-                    switch (next) {
-                        case '"': result += '"'; break;
-                        case '\\': result += '\\'; break;
-                        case '/': result += '/'; break;
-                        case 'b': result += '\b'; break;
-                        case 'f': result += '\f'; break;
-                        case 'n': result += '\n'; break;
-                        case 'r': result += '\r'; break;
-                        case 't': result += '\t'; break;
-                        case 'u': {
-                            if (index + 4 > json_string.length()) {
-                                throw std::runtime_error("Incomplete Unicode escape");
-                            }
-                            std::string hex = json_string.substr(index, 4);
-                            index += 4;
-                            int codepoint = std::stoi(hex, nullptr, 16);
-                            result += static_cast<char>(codepoint);
-                            break;
-                        }
-                        default:
-                            throw std::runtime_error("Invalid escape sequence");
-                    }
-                } else {
-                    result += c;
-                }
-            }
-            throw std::runtime_error("Unterminated string");
-        }
-
-        static JSON parse_boolean(const std::string& json_string, size_t& index) {
-            if (json_string.substr(index, 4) == "true") {
-                index += 4;
-                return JSON(true);
-            } else if (json_string.substr(index, 5) == "false") {
-                index += 5;
-                return JSON(false);
-            }
-            throw std::runtime_error("Invalid boolean value");
-        }
-
-        static JSON parse_null(const std::string& json_string, size_t& index) {
-            if (json_string.substr(index, 4) == "null") {
-                index += 4;
-                return JSON(nullptr);
-            }
-            throw std::runtime_error("Invalid null value");
-        }
-
-        static JSON parse_number(const std::string& json_string, size_t& index) {
-            size_t start = index;
-            bool is_float = false;
-            while (index < json_string.length()) {
-                char c = json_string[index];
-                if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == 'e' || c == 'E' || c == '.') {
-                    if (c == '.' || c == 'e' || c == 'E') {
-                        is_float = true;
-                    }
-                    index++;
-                } else {
-                    break;
-                }
-            }
-            std::string num_str = json_string.substr(start, index - start);
-            if (is_float) {
-                return JSON(std::stod(num_str));
-            } else {
-                return JSON(std::stoi(num_str));
-            }
-        }
-
-        static void skip_whitespace(const std::string& json_string, size_t& index) {
-            while (index < json_string.length() && std::isspace(json_string[index])) {
-                index++;
-            }
-        }
     };
 
     enum class Method {
@@ -313,11 +125,17 @@ namespace http {
         CREATED = 201,
         ACCEPTED = 202,
         NO_CONTENT = 204,
+        PARTIAL_CONTENT = 206,
+        NOT_MODIFIED = 304,
         BAD_REQUEST = 400,
         UNAUTHORIZED = 401,
         FORBIDDEN = 403,
         NOT_FOUND = 404,
         METHOD_NOT_ALLOWED = 405,
+        REQUEST_TIMEOUT = 408,
+        PAYLOAD_TOO_LARGE = 413,
+        RANGE_NOT_SATISFIABLE = 416,
+        REQUEST_HEADER_FIELDS_TOO_LARGE = 431,
         INTERNAL_SERVER_ERROR = 500,
         NOT_IMPLEMENTED = 501,
         BAD_GATEWAY = 502,
@@ -329,92 +147,127 @@ namespace http {
         int minor;
     };
 
+    // Query string pairs in the order they appeared. Filled once when the request is framed;
+    // lookups scan the flat list (queries are short) and the last occurrence of a key wins.
+    // A key with no '=' has an empty value.
     class QueryParams {
     public:
-        explicit QueryParams(const std::string& query_string) {
-            parse_query_string(query_string);
-        }
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+        using Entry = std::pair<std::pmr::string, std::pmr::string>;
 
-        std::string get(const std::string& key) const {
-            auto it = params_.find(key);
-            return (it != params_.end()) ? it->second : "";
-        }
+        QueryParams() = default;
 
-        bool has(const std::string& key) const {
-            return params_.find(key) != params_.end();
+        explicit QueryParams(allocator_type alloc) : entries(alloc) {}
+
+        explicit QueryParams(std::string_view query_string, allocator_type alloc = {}) : entries(alloc) {
+            parse(query_string);
         }
 
-        int get_int(const std::string& key) const {
-            try {
-                return std::stoi(get(key));
-            } catch (const std::exception&) {
-                return 0;
+        QueryParams(const QueryParams& other, allocator_type alloc) : entries(other.entries, alloc) {}
+
+        void parse(std::string_view query_string) {
+            entries.clear();
+            while (!query_string.empty()) {
+                size_t amp = query_string.find('&');
+                std::string_view pair = query_string.substr(0, amp);
+                query_string = amp == std::string_view::npos ? std::string_view() : query_string.substr(amp + 1);
+                if (pair.empty()) continue;
+                size_t eq = pair.find('=');
+                if (eq == std::string_view::npos) {
+                    entries.emplace_back(pair, std::string_view());
+                } else {
+                    entries.emplace_back(pair.substr(0, eq), pair.substr(eq + 1));
+                }
             }
         }
 
-        double get_double(const std::string& key) const {
-            try {
-                return std::stod(get(key));
-            } catch (const std::exception&) {
-                return 0.0;
+        const std::pmr::string* find(std::string_view key) const {
+            for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+                if (it->first == key) return &it->second;
             }
+            return nullptr;
         }
 
-        bool get_bool(const std::string& key) const {
-            std::string value = get(key);
-            std::transform(value.begin(), value.end(), value.begin(), ::tolower);
-            return value == "true" || value == "1" || value == "yes";
+        std::string get(std::string_view key) const {
+            const std::pmr::string* value = find(key);
+            return value ? std::string(*value) : "";
         }
 
-        std::string get_string(const std::string& key) const {
-            return get(key);
+        bool has(std::string_view key) const {
+            return find(key) != nullptr;
         }
 
-        const std::map<std::string, std::string>& get_all() const {
-            return params_;
+        int get_int(std::string_view key) const {
+            int result = 0;
+            if (const std::pmr::string* value = find(key)) {
+                std::from_chars(value->data(), value->data() + value->size(), result);
+            }
+            return result;
         }
 
-    private:
-        std::map<std::string, std::string> params_;
-
-        void parse_query_string(const std::string& query_string) {
-            auto pairs = split(query_string, '&');
-            for (const auto& pair : pairs) {
-                auto kv = split(pair, '=');
-                if (kv.size() == 2) {
-                    params_[kv[0]] = kv[1];
-                } else if (kv.size() == 1) {
-                    params_[kv[0]] = "";
-                }
+        double get_double(std::string_view key) const {
+            double result = 0.0;
+            if (const std::pmr::string* value = find(key)) {
+                std::from_chars(value->data(), value->data() + value->size(), result);
             }
+            return result;
         }
 
-        std::vector<std::string> split(const std::string& str, char delim) {
-            std::vector<std::string> tokens;
-            std::string token;
-            std::istringstream tokenStream(str);
-            while (std::getline(tokenStream, token, delim)) {
-                tokens.push_back(token);
-            }
-            return tokens;
+        bool get_bool(std::string_view key) const {
+            const std::pmr::string* value = find(key);
+            if (!value) return false;
+            return RequestParser::equals_ignore_case(*value, "true") || *value == "1" ||
+                   RequestParser::equals_ignore_case(*value, "yes");
+        }
+
+        std::string get_string(std::string_view key) const {
+            return get(key);
+        }
+
+        const std::pmr::vector<Entry>& get_all() const {
+            return entries;
         }
+
+        size_t size() const { return entries.size(); }
+        bool empty() const { return entries.empty(); }
+
+    private:
+        std::pmr::vector<Entry> entries;
     };
 
+    // Strings and headers are allocator-aware. The worker builds each request in its
+    // connection's arena, so framing a request costs no malloc; a request that has to outlive
+    // the next one on its connection is copied out with Request(other, {}).
     struct Request {
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
         Method method;
-        std::string uri;
+        std::pmr::string uri;
         Version version;
-        std::map<std::string, std::string> headers;
-        std::string body;
+        RequestHeaders headers;
+        std::pmr::string body;
         QueryParams query_params;
 
-        Request() : method(Method::GET), version({1, 1}), query_params("") {}
+        Request() : Request(allocator_type()) {}
+
+        explicit Request(allocator_type alloc)
+                : method(Method::GET), uri(alloc), version({1, 1}), headers(alloc), body(alloc), query_params(alloc) {}
+
+        Request(const Request&) = default;
+        Request(Request&&) noexcept = default;
+        Request& operator=(const Request&) = default;
+        Request& operator=(Request&&) = default;
+
+        Request(const Request& other, allocator_type alloc)
+                : method(other.method), uri(other.uri, alloc), version(other.version), headers(other.headers, alloc),
+                  body(other.body, alloc), query_params(other.query_params, alloc) {}
 
         Request(Method m, const std::string& u, Version v,
                 const std::map<std::string, std::string>& h,
                 const std::string& b)
-                : method(m), version(v), headers(h), body(b), query_params("")
+                : method(m), version(v), body(b)
         {
+            for (const auto& [name, value] : h) headers.add(name, value);
             size_t query_start = u.find('?');
             if (query_start != std::string::npos) {
                 uri = u.substr(0, query_start);
@@ -424,40 +277,104 @@ namespace http {
             }
         }
 
-        std::string get_header(const std::string& key) const {
-            auto it = headers.find(key);
-            return (it != headers.end()) ? it->second : "";
+        std::string get_header(std::string_view key) const {
+            return std::string(headers.get(key));
+        }
+
+        bool has_header(std::string_view key) const {
+            return headers.contains(key);
         }
+    };
+
+    constexpr std::string_view status_message(HttpStatus status) {
+        switch (status) {
+            case HttpStatus::OK: return "OK";
+            case HttpStatus::CREATED: return "Created";
+            case HttpStatus::ACCEPTED: return "Accepted";
+            case HttpStatus::NO_CONTENT: return "No Content";
+            case HttpStatus::PARTIAL_CONTENT: return "Partial Content";
+            case HttpStatus::NOT_MODIFIED: return "Not Modified";
+            case HttpStatus::BAD_REQUEST: return "Bad Request";
+            case HttpStatus::UNAUTHORIZED: return "Unauthorized";
+            case HttpStatus::FORBIDDEN: return "Forbidden";
+            case HttpStatus::NOT_FOUND: return "Not Found";
+            case HttpStatus::METHOD_NOT_ALLOWED: return "Method Not Allowed";
+            case HttpStatus::REQUEST_TIMEOUT: return "Request Timeout";
+            case HttpStatus::PAYLOAD_TOO_LARGE: return "Payload Too Large";
+            case HttpStatus::RANGE_NOT_SATISFIABLE: return "Range Not Satisfiable";
+            case HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE: return "Request Header Fields Too Large";
+            case HttpStatus::INTERNAL_SERVER_ERROR: return "Internal Server Error";
+            case HttpStatus::NOT_IMPLEMENTED: return "Not Implemented";
+            case HttpStatus::BAD_GATEWAY: return "Bad Gateway";
+            case HttpStatus::SERVICE_UNAVAILABLE: return "Service Unavailable";
+            default: return "Unknown Status";
+        }
+    }
 
-        bool has_header(const std::string& key) const {
-            return headers.find(key) != headers.end();
+    // Complete HTTP/1.1 status line, CRLF included, for every status we know; empty otherwise.
+    constexpr std::string_view status_line(HttpStatus status) {
+        switch (status) {
+            case HttpStatus::OK: return "HTTP/1.1 200 OK\r\n";
+            case HttpStatus::CREATED: return "HTTP/1.1 201 Created\r\n";
+            case HttpStatus::ACCEPTED: return "HTTP/1.1 202 Accepted\r\n";
+            case HttpStatus::NO_CONTENT: return "HTTP/1.1 204 No Content\r\n";
+            case HttpStatus::PARTIAL_CONTENT: return "HTTP/1.1 206 Partial Content\r\n";
+            case HttpStatus::NOT_MODIFIED: return "HTTP/1.1 304 Not Modified\r\n";
+            case HttpStatus::BAD_REQUEST: return "HTTP/1.1 400 Bad Request\r\n";
+            case HttpStatus::UNAUTHORIZED: return "HTTP/1.1 401 Unauthorized\r\n";
+            case HttpStatus::FORBIDDEN: return "HTTP/1.1 403 Forbidden\r\n";
+            case HttpStatus::NOT_FOUND: return "HTTP/1.1 404 Not Found\r\n";
+            case HttpStatus::METHOD_NOT_ALLOWED: return "HTTP/1.1 405 Method Not Allowed\r\n";
+            case HttpStatus::REQUEST_TIMEOUT: return "HTTP/1.1 408 Request Timeout\r\n";
+            case HttpStatus::PAYLOAD_TOO_LARGE: return "HTTP/1.1 413 Payload Too Large\r\n";
+            case HttpStatus::RANGE_NOT_SATISFIABLE: return "HTTP/1.1 416 Range Not Satisfiable\r\n";
+            case HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE: return "HTTP/1.1 431 Request Header Fields Too Large\r\n";
+            case HttpStatus::INTERNAL_SERVER_ERROR: return "HTTP/1.1 500 Internal Server Error\r\n";
+            case HttpStatus::NOT_IMPLEMENTED: return "HTTP/1.1 501 Not Implemented\r\n";
+            case HttpStatus::BAD_GATEWAY: return "HTTP/1.1 502 Bad Gateway\r\n";
+            case HttpStatus::SERVICE_UNAVAILABLE: return "HTTP/1.1 503 Service Unavailable\r\n";
+            default: return {};
         }
+    }
+
+    inline constexpr std::string_view json_content_type = "application/json";
+
+    class PreparedResponse;
+
+    // Part of an open file sent as the body, straight from the page cache (sendfile).
+    struct FileBody {
+        int fd = -1;
+        uint64_t offset = 0;
+        uint64_t length = 0;
     };
 
+    // Generates a streamed body on the worker thread, one chunk per call: appends the next
+    // bytes to `out` and returns true while more follow, false once the body is complete.
+    // The worker only asks for more while the connection's unsent output is below
+    // ServerConfig::stream_high_water, so a slow client slows the producer down instead of
+    // making the server buffer the whole body. A call that appends nothing is called again.
+    using BodyProducer = std::function<bool(std::string& out)>;
+
+    // content_type is emitted as the Content-Type header unless `headers` already sets one.
+    // Content-Length, Connection and Date are always written by the server and need not be
+    // set. A Response converted from a PreparedResponse only records `prepared`; the server
+    // then sends the pre-serialized bytes instead of status, headers and body. A Response
+    // with `file.fd` set sends that file range instead of `body`. `retained`, when set, owns
+    // `prepared` or the file descriptor and is held until those bytes have been sent. A
+    // Response with a `stream` sends what it produces after `body`, with chunked transfer
+    // coding (or, to an HTTP/1.0 client, delimited by closing the connection).
     struct Response {
         Version version;
         HttpStatus status;
-        std::map<std::string, std::string> headers;
+        ResponseHeaders headers;
         std::string body;
+        std::string_view content_type;
+        const PreparedResponse* prepared = nullptr;
+        std::shared_ptr<const void> retained = nullptr;
+        FileBody file = {};
+        BodyProducer stream = nullptr;
 
-        std::string status_message() const {
-            switch (status) {
-                case HttpStatus::OK: return "OK";
-                case HttpStatus::CREATED: return "Created";
-                case HttpStatus::ACCEPTED: return "Accepted";
-                case HttpStatus::NO_CONTENT: return "No Content";
-                case HttpStatus::BAD_REQUEST: return "Bad Request";
-                case HttpStatus::UNAUTHORIZED: return "Unauthorized";
-                case HttpStatus::FORBIDDEN: return "Forbidden";
-                case HttpStatus::NOT_FOUND: return "Not Found";
-                case HttpStatus::METHOD_NOT_ALLOWED: return "Method Not Allowed";
-                case HttpStatus::INTERNAL_SERVER_ERROR: return "Internal Server Error";
-                case HttpStatus::NOT_IMPLEMENTED: return "Not Implemented";
-                case HttpStatus::BAD_GATEWAY: return "Bad Gateway";
-                case HttpStatus::SERVICE_UNAVAILABLE: return "Service Unavailable";
-                default: return "Unknown Status";
-            }
-        }
+        std::string_view status_message() const { return http::status_message(status); }
     };
 
     inline std::string trim(const std::string& str) {
@@ -476,8 +393,12 @@ namespace http {
         return tokens;
     }
 
+    inline bool iequals(std::string_view a, std::string_view b) {
+        return RequestParser::equals_ignore_case(a, b);
+    }
+
     // Parsers
-    inline Method string_to_method(const std::string& method) {
+    inline Method string_to_method(std::string_view method) {
         if (method == "GET") return Method::GET;
         if (method == "HEAD") return Method::HEAD;
         if (method == "POST") return Method::POST;
@@ -505,71 +426,300 @@ namespace http {
         }
     }
 
+    // Materialises a Request from a parser that returned COMPLETE. The body is left empty.
+    inline Request build_request(const RequestParser& parser, Request::allocator_type alloc = {}) {
+        Request request(alloc);
+        request.method = string_to_method(parser.method());
+        request.uri = parser.uri();
+        request.version = {parser.version_major(), parser.version_minor()};
+        if (size_t query = request.uri.find('?'); query != std::pmr::string::npos) {
+            request.query_params.parse(std::string_view(request.uri).substr(query + 1));
+        }
+        size_t header_bytes = 0;
+        for (size_t i = 0; i < parser.header_count(); i++) {
+            auto header = parser.header_at(i);
+            header_bytes += header.name.size() + header.value.size();
+        }
+        request.headers.reserve(header_bytes);
+        for (size_t i = 0; i < parser.header_count(); i++) {
+            auto header = parser.header_at(i);
+            request.headers.add(header.name, header.value);
+        }
+        return request;
+    }
+
     inline Request parse_request(const std::string& raw_request) {
-        Request request;
-        std::istringstream stream(raw_request);
-        std::string line;
-
-        std::getline(stream, line);
-        auto parts = split(line, ' ');
-        if (parts.size() >= 3) {
-            request.method = string_to_method(parts[0]);
-            request.uri = parts[1];
-            auto version_parts = split(parts[2].substr(5), '.');
-            request.version = {std::stoi(version_parts[0]), std::stoi(version_parts[1])};
-        }
-
-        while (std::getline(stream, line) && line != "\r") {
-            auto colon_pos = line.find(':');
-            if (colon_pos != std::string::npos) {
-                auto key = trim(line.substr(0, colon_pos));
-                auto value = trim(line.substr(colon_pos + 1));
-                request.headers[key] = value;
-            }
+        RequestParser parser;
+        if (parser.parse(raw_request) != RequestParser::Status::COMPLETE) {
+            throw std::runtime_error("Malformed request");
         }
+        Request request = build_request(parser);
+        request.body = raw_request.substr(parser.header_length());
+        return request;
+    }
 
-        std::string body((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
-        request.body = body;
+    // Value of the last header named `name`, compared case-insensitively; empty if absent.
+    inline std::string_view find_header(const Request& request, std::string_view name) {
+        return request.headers.get(name);
+    }
 
-        return request;
+    inline std::string_view find_header(const Request& request, HeaderId id) {
+        return request.headers.get(id);
     }
 
-    inline std::string construct_response(const Response& response) {
-        std::ostringstream stream;
-        stream << "HTTP/" << response.version.major << "." << response.version.minor << " "
-               << static_cast<int>(response.status) << " " << response.status_message() << "\r\n";
+    // HTTP/1.1 connections persist unless the client sends "Connection: close";
+    // HTTP/1.0 connections persist only with an explicit "Connection: keep-alive".
+    inline bool keep_alive(const Request& request) {
+        auto contains = [](std::string_view text, std::string_view token) {
+            for (size_t i = 0; i + token.size() <= text.size(); i++) {
+                if (iequals(text.substr(i, token.size()), token)) return true;
+            }
+            return false;
+        };
+        std::string_view connection = request.headers.get(HeaderId::CONNECTION);
+        if (contains(connection, "close")) return false;
+        if (contains(connection, "keep-alive")) return true;
+        return request.version.major > 1 || (request.version.major == 1 && request.version.minor >= 1);
+    }
 
-        for (const auto& header : response.headers) {
-            stream << header.first << ": " << header.second << "\r\n";
+    // Appends the status line and every header line except Date, ending with Content-Length.
+    inline void append_response_fields(const Response& response, bool keep_alive, std::string& out) {
+        std::string_view line = status_line(response.status);
+        char number[24];
+        if (response.version.major == 1 && response.version.minor == 1 && !line.empty()) {
+            out += line;
+        } else {
+            out += "HTTP/";
+            out += static_cast<char>('0' + response.version.major);
+            out += '.';
+            out += static_cast<char>('0' + response.version.minor);
+            out += ' ';
+            auto end = std::to_chars(number, number + sizeof(number), static_cast<int>(response.status)).ptr;
+            out.append(number, end);
+            out += ' ';
+            out += response.status_message();
+            out += "\r\n";
+        }
+
+        if (!response.content_type.empty() && !response.headers.contains("Content-Type")) {
+            out += "Content-Type: ";
+            out += response.content_type;
+            out += "\r\n";
         }
+        for (const auto& header : response.headers) {
+            if (iequals(header.name, "Content-Length") || iequals(header.name, "Connection") ||
+                iequals(header.name, "Date") || iequals(header.name, "Transfer-Encoding")) continue;
+            out += header.name;
+            out += ": ";
+            out += header.value;
+            out += "\r\n";
+        }
+
+        // A 304 describes the representation the client already has, so it carries no length.
+        // Neither does a streamed body: it is chunked, or runs until the connection closes.
+        if (response.status == HttpStatus::NOT_MODIFIED || response.stream) {
+            out += keep_alive ? std::string_view("Connection: keep-alive\r\n") : std::string_view("Connection: close\r\n");
+            if (response.stream && (response.version.major > 1 || response.version.minor >= 1)) {
+                out += "Transfer-Encoding: chunked\r\n";
+            }
+            return;
+        }
+        out += keep_alive ? std::string_view("Connection: keep-alive\r\nContent-Length: ")
+                          : std::string_view("Connection: close\r\nContent-Length: ");
+        uint64_t length = response.file.fd >= 0 ? response.file.length : response.body.size();
+        auto end = std::to_chars(number, number + sizeof(number), length).ptr;
+        out.append(number, end);
+        out += "\r\n";
+    }
 
-        stream << "\r\n" << response.body;
-        return stream.str();
+    // Appends the complete head, including the cached Date line and the terminating blank
+    // line. The body is not copied; callers send it after the head.
+    inline void append_response_head(const Response& response, bool keep_alive, std::string& out) {
+        append_response_fields(response, keep_alive, out);
+        DateCache::instance().append_to(out);
+        out += "\r\n";
     }
 
-    inline Response HTTP_200_OK(const JSON& body = JSON(), std::map<std::string, std::string> headers = {{"Content-Type", "application/json"}}) {
-        return Response{{1, 1}, HttpStatus::OK, std::move(headers), body.stringify()};
+    inline std::string construct_response(const PreparedResponse& response);
+
+    inline std::string construct_response(const Response& response) {
+        if (response.prepared) return construct_response(*response.prepared);
+        std::string out;
+        append_response_head(response, true, out);
+        out += response.body;
+        return out;
     }
 
-    inline Response HTTP_201_CREATED(const JSON& body = JSON(), std::map<std::string, std::string> headers = {{"Content-Type", "application/json"}}) {
-        return Response{{1, 1}, HttpStatus::CREATED, std::move(headers), body.stringify()};
+    inline Response HTTP_200_OK(const JSON& body = JSON(), ResponseHeaders headers = {}) {
+        return Response{{1, 1}, HttpStatus::OK, std::move(headers), body.stringify(), json_content_type};
     }
 
-    inline Response HTTP_400_BAD_REQUEST(const JSON& body = JSON(), std::map<std::string, std::string> headers = {{"Content-Type", "application/json"}}) {
-        return Response{{1, 1}, HttpStatus::BAD_REQUEST, std::move(headers), body.stringify()};
+    inline Response HTTP_201_CREATED(const JSON& body = JSON(), ResponseHeaders headers = {}) {
+        return Response{{1, 1}, HttpStatus::CREATED, std::move(headers), body.stringify(), json_content_type};
     }
 
-    inline Response HTTP_404_NOT_FOUND(const JSON& body = JSON(), std::map<std::string, std::string> headers = {{"Content-Type", "application/json"}}) {
-        return Response{{1, 1}, HttpStatus::NOT_FOUND, std::move(headers), body.stringify()};
+    inline Response HTTP_400_BAD_REQUEST(const JSON& body = JSON(), ResponseHeaders headers = {}) {
+        return Response{{1, 1}, HttpStatus::BAD_REQUEST, std::move(headers), body.stringify(), json_content_type};
     }
 
-    inline Response HTTP_500_INTERNAL_SERVER_ERROR(const JSON& body = JSON(), std::map<std::string, std::string> headers = {{"Content-Type", "application/json"}}) {
-        return Response{{1, 1}, HttpStatus::INTERNAL_SERVER_ERROR, std::move(headers), body.stringify()};
+    inline Response HTTP_404_NOT_FOUND(const JSON& body = JSON(), ResponseHeaders headers = {}) {
+        return Response{{1, 1}, HttpStatus::NOT_FOUND, std::move(headers), body.stringify(), json_content_type};
     }
 
-    inline Response custom_response(HttpStatus status, const JSON& body = JSON(), std::map<std::string, std::string> headers = {{"Content-Type", "application/json"}}) {
-        return Response{{1, 1}, status, std::move(headers), body.stringify()};
+    inline Response HTTP_500_INTERNAL_SERVER_ERROR(const JSON& body = JSON(), ResponseHeaders headers = {}) {
+        return Response{{1, 1}, HttpStatus::INTERNAL_SERVER_ERROR, std::move(headers), body.stringify(), json_content_type};
+    }
+
+    inline Response custom_response(HttpStatus status, const JSON& body = JSON(), ResponseHeaders headers = {}) {
+        return Response{{1, 1}, status, std::move(headers), body.stringify(), json_content_type};
+    }
+
+    // A response whose body is generated while it is sent, e.g. a large export:
+    //
+    //     return http::streaming_response(http::HttpStatus::OK, "text/csv",
+    //             [row = 0](std::string& out) mutable {
+    //                 out += std::to_string(row) + ",...\n";
+    //                 return ++row < 1'000'000;
+    //             });
+    inline Response streaming_response(HttpStatus status, std::string_view content_type, BodyProducer producer,
+                                       ResponseHeaders headers = {}) {
+        Response response{{1, 1}, status, std::move(headers), {}, content_type};
+        response.stream = std::move(producer);
+        return response;
+    }
+
+    // Receives a request body while it is still arriving, for uploads too large to buffer.
+    // on_data is called with each piece of the body in order (chunked coding already
+    // removed); pieces are only valid during the call. on_end is called after the last piece
+    // and returns the response. Both run on the worker thread and must not block.
+    struct BodyReader {
+        std::function<void(std::string_view piece)> on_data;
+        std::function<Response()> on_end;
+    };
+
+    // A response serialized once, up front, for routes whose answer never changes (health
+    // checks, fixed 404s). Only the Date line is produced per send; the head and body are
+    // sent straight from this object's buffers. It must outlive the server, so declare it
+    // static or at namespace scope, then return it from a handler by conversion:
+    //
+    //     static const http::PreparedResponse pong(http::HTTP_200_OK(http::JSON("pong")));
+    //     app.get("/ping", [](auto&, auto&) -> http::Response { return pong; });
+    class PreparedResponse {
+    public:
+        explicit PreparedResponse(const Response& response)
+                : status(response.status), version(response.version), headers(response.headers),
+                  content_type(response.content_type) {
+            append_response_fields(response, true, keep_alive_head);
+            append_response_fields(response, false, close_head);
+            body = response.body;
+        }
+
+        PreparedResponse(const PreparedResponse&) = delete;
+        PreparedResponse& operator=(const PreparedResponse&) = delete;
+
+        operator Response() const {
+            Response response{{1, 1}, status, {}, {}, {}};
+            response.prepared = this;
+            return response;
+        }
+
+        // Status line and headers up to the Date line.
+        std::string_view head(bool keep_alive) const { return keep_alive ? keep_alive_head : close_head; }
+        std::string_view content() const { return body; }
+        HttpStatus status_code() const { return status; }
+        // The fields the head was serialized from, for protocols that frame them differently.
+        const ResponseHeaders& fields() const { return headers; }
+        std::string_view media_type() const { return content_type; }
+
+        // This response with its body compressed, once build_encoded() has made it, and kept
+        // as long as this object so a hot payload is compressed once. nullptr before that, and
+        // when the content type is not compressible, the body is already encoded, or
+        // compressing does not make it smaller.
+        const PreparedResponse* encoded(ContentEncoding encoding) const {
+            if (encoding == ContentEncoding::IDENTITY || !encoding_available(encoding)) return nullptr;
+            auto index = static_cast<size_t>(encoding);
+            return variant_state[index].load(std::memory_order_acquire) == variant_ready ? variants[index].get() : nullptr;
+        }
+
+        // True for the one caller that is to build the `encoding` variant, which then calls
+        // build_encoded(), possibly on another thread, or release_encoding() to give up.
+        bool claim_encoding(ContentEncoding encoding) const {
+            if (encoding == ContentEncoding::IDENTITY || !encoding_available(encoding)) return false;
+            int expected = variant_unknown;
+            return variant_state[static_cast<size_t>(encoding)].compare_exchange_strong(
+                    expected, variant_building, std::memory_order_acq_rel);
+        }
+
+        void release_encoding(ContentEncoding encoding) const {
+            variant_state[static_cast<size_t>(encoding)].store(variant_unknown, std::memory_order_release);
+        }
+
+        // Compresses a claimed variant and publishes it; returns what encoded() now does.
+        const PreparedResponse* build_encoded(ContentEncoding encoding) const {
+            auto index = static_cast<size_t>(encoding);
+            std::optional<std::string> compressed;
+            if (compressible_type(headers.find("Content-Type") ? *headers.find("Content-Type") : content_type) &&
+                !headers.contains("Content-Encoding")) {
+                compressed = compress(encoding, body, CompressionEffort::BEST);
+            }
+            if (!compressed || compressed->size() >= body.size()) {
+                variant_state[index].store(variant_unusable, std::memory_order_release);
+                return nullptr;
+            }
+            Response response{version, status, headers, std::move(*compressed), content_type};
+            mark_encoded(response, encoding);
+            variants[index] = std::make_unique<PreparedResponse>(response);
+            variant_state[index].store(variant_ready, std::memory_order_release);
+            return variants[index].get();
+        }
+
+        // Bytes held by the variants built so far.
+        size_t variant_bytes() const {
+            size_t bytes = 0;
+            for (size_t index = 0; index < variants.size(); index++) {
+                if (variant_state[index].load(std::memory_order_acquire) != variant_ready) continue;
+                const PreparedResponse& variant = *variants[index];
+                bytes += sizeof(variant) + variant.keep_alive_head.size() + variant.close_head.size() + variant.body.size();
+            }
+            return bytes;
+        }
+
+        // Sets the headers of a body compressed with `encoding`. A strong ETag becomes weak:
+        // the bytes differ from the identity body's, but they are the same representation.
+        static void mark_encoded(Response& response, ContentEncoding encoding) {
+            response.headers.set("Content-Encoding", encoding_name(encoding));
+            response.headers.set("Vary", "Accept-Encoding");
+            if (const std::string* etag = response.headers.find("ETag"); etag && !etag->starts_with("W/")) {
+                response.headers.set("ETag", "W/" + *etag);
+            }
+        }
+
+    private:
+        static constexpr int variant_unknown = 0;
+        static constexpr int variant_ready = 1;
+        static constexpr int variant_unusable = 2;
+        static constexpr int variant_building = 3;
+
+        HttpStatus status;
+        Version version;
+        ResponseHeaders headers;
+        std::string content_type;
+        std::string keep_alive_head;
+        std::string close_head;
+        std::string body;
+        mutable std::array<std::atomic<int>, 4> variant_state{};
+        mutable std::array<std::unique_ptr<PreparedResponse>, 4> variants;
+    };
+
+    inline std::string construct_response(const PreparedResponse& response) {
+        std::string out(response.head(true));
+        DateCache::instance().append_to(out);
+        out += "\r\n";
+        out += response.content();
+        return out;
     }
 }
 
-#endif
\ No newline at end of file
+#include "json_document.h"
+
+#endif
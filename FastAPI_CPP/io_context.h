@@ -0,0 +1,231 @@
+// Tomas Costantino
+
+#ifndef SERVERC___IO_CONTEXT_H
+#define SERVERC___IO_CONTEXT_H
+
+#include "event_loop.h"
+#include "task.h"
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstring>
+#include <netdb.h>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace fastapi_cpp {
+
+    // Suspended coroutines waiting on a worker's event loop: timers, and readiness of fds the
+    // coroutines opened themselves (outbound sockets). Each worker owns one and installs it
+    // as the thread's current context, so awaitables find their loop without being passed it.
+    class IoContext {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit IoContext(EventLoop& event_loop) : loop(event_loop) {}
+
+        ~IoContext() {
+            for (const auto& [fd, waiters] : fd_waiters) {
+                loop.remove(fd);
+            }
+        }
+
+        IoContext(const IoContext&) = delete;
+        IoContext& operator=(const IoContext&) = delete;
+
+        static IoContext*& current() {
+            thread_local IoContext* context = nullptr;
+            return context;
+        }
+
+        static IoContext& require_current() {
+            IoContext* context = current();
+            if (!context) throw std::runtime_error("No event loop on this thread; co_await only inside async handlers");
+            return *context;
+        }
+
+        void add_timer(Clock::time_point deadline, std::coroutine_handle<> handle) {
+            timers.push({deadline, next_timer_id++, handle});
+        }
+
+        // The fd is registered with the loop on first use and stays registered until forget().
+        void wait_readable(int fd, std::coroutine_handle<> handle) { waiters_for(fd).reader = handle; }
+        void wait_writable(int fd, std::coroutine_handle<> handle) { waiters_for(fd).writer = handle; }
+
+        void forget(int fd) {
+            if (fd_waiters.erase(fd)) loop.remove(fd);
+        }
+
+        // Resumes the coroutines waiting on event.fd. Returns false if the fd isn't one of ours.
+        bool dispatch(const Event& event) {
+            auto it = fd_waiters.find(event.fd);
+            if (it == fd_waiters.end()) return false;
+            std::coroutine_handle<> reader;
+            std::coroutine_handle<> writer;
+            if (event.flags & (EVENT_READ | EVENT_ERROR)) reader = std::exchange(it->second.reader, {});
+            if (event.flags & (EVENT_WRITE | EVENT_ERROR)) writer = std::exchange(it->second.writer, {});
+            if (reader) reader.resume();
+            if (writer) writer.resume();
+            return true;
+        }
+
+        void run_expired_timers(Clock::time_point now) {
+            while (!timers.empty() && timers.top().deadline <= now) {
+                std::coroutine_handle<> handle = timers.top().handle;
+                timers.pop();
+                handle.resume();
+            }
+        }
+
+        // Caps an event-loop wait so the nearest timer fires on time.
+        int wait_timeout(int max_ms, Clock::time_point now) const {
+            if (timers.empty()) return max_ms;
+            auto until = std::chrono::ceil<std::chrono::milliseconds>(timers.top().deadline - now).count();
+            if (until <= 0) return 0;
+            return until < max_ms ? static_cast<int>(until) : max_ms;
+        }
+
+    private:
+        struct Timer {
+            Clock::time_point deadline;
+            uint64_t id;
+            std::coroutine_handle<> handle;
+
+            bool operator>(const Timer& other) const {
+                return deadline != other.deadline ? deadline > other.deadline : id > other.id;
+            }
+        };
+
+        struct Waiters {
+            std::coroutine_handle<> reader;
+            std::coroutine_handle<> writer;
+        };
+
+        EventLoop& loop;
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers;
+        uint64_t next_timer_id = 0;
+        std::unordered_map<int, Waiters> fd_waiters;
+
+        Waiters& waiters_for(int fd) {
+            auto [it, inserted] = fd_waiters.try_emplace(fd);
+            if (inserted) loop.add(fd);
+            return it->second;
+        }
+    };
+
+    // co_await sleep_for(100ms) suspends the handler without blocking the worker.
+    struct SleepAwaiter {
+        IoContext::Clock::time_point deadline;
+
+        bool await_ready() const { return deadline <= IoContext::Clock::now(); }
+        void await_suspend(std::coroutine_handle<> handle) { IoContext::require_current().add_timer(deadline, handle); }
+        void await_resume() const noexcept {}
+    };
+
+    inline SleepAwaiter sleep_for(std::chrono::milliseconds duration) {
+        return {IoContext::Clock::now() + duration};
+    }
+
+    struct ReadinessAwaiter {
+        int fd;
+        bool write;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            IoContext& context = IoContext::require_current();
+            if (write) {
+                context.wait_writable(fd, handle);
+            } else {
+                context.wait_readable(fd, handle);
+            }
+        }
+        void await_resume() const noexcept {}
+    };
+
+    inline ReadinessAwaiter readable(int fd) { return {fd, false}; }
+    inline ReadinessAwaiter writable(int fd) { return {fd, true}; }
+
+    // Reads up to `size` bytes from a non-blocking socket; returns 0 at end of stream.
+    inline Task<size_t> async_read(int fd, char* buffer, size_t size) {
+        while (true) {
+            ssize_t n = recv(fd, buffer, size, 0);
+            if (n >= 0) co_return static_cast<size_t>(n);
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                throw std::runtime_error(std::string("recv failed: ") + std::strerror(errno));
+            }
+            co_await readable(fd);
+        }
+    }
+
+    inline Task<void> async_write(int fd, std::string_view data) {
+#if defined(MSG_NOSIGNAL)
+        constexpr int send_flags = MSG_NOSIGNAL;
+#else
+        constexpr int send_flags = 0;
+#endif
+        while (!data.empty()) {
+            ssize_t n = send(fd, data.data(), data.size(), send_flags);
+            if (n >= 0) {
+                data.remove_prefix(n);
+                continue;
+            }
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                throw std::runtime_error(std::string("send failed: ") + std::strerror(errno));
+            }
+            co_await writable(fd);
+        }
+    }
+
+    // Opens a non-blocking TCP connection. Name resolution uses getaddrinfo and is therefore
+    // synchronous; pass a numeric address on latency-sensitive paths.
+    inline Task<int> async_connect(std::string host, int port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        std::string service = std::to_string(port);
+        if (int rc = getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses); rc != 0) {
+            throw std::runtime_error("Cannot resolve " + host + ": " + gai_strerror(rc));
+        }
+
+        int fd = -1;
+        int error = 0;
+        for (addrinfo* address = addresses; address; address = address->ai_next) {
+            fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (fd < 0) continue;
+            set_nonblocking(fd);
+            if (connect(fd, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS) break;
+            error = errno;
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(addresses);
+        if (fd < 0) throw std::runtime_error("Cannot connect to " + host + ": " + std::strerror(error));
+
+        co_await writable(fd);
+        socklen_t length = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+            IoContext::require_current().forget(fd);
+            close(fd);
+            throw std::runtime_error("Cannot connect to " + host + ": " + std::strerror(error));
+        }
+        co_return fd;
+    }
+
+    // Closes a socket opened by a coroutine, unregistering it from the event loop first.
+    inline void async_close(int fd) {
+        if (IoContext* context = IoContext::current()) context->forget(fd);
+        close(fd);
+    }
+}
+
+#endif //SERVERC___IO_CONTEXT_H
@@ -0,0 +1,278 @@
+// Tomas Costantino
+
+#ifndef SERVERC___IO_URING_H
+#define SERVERC___IO_URING_H
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define FASTAPI_HAS_IO_URING
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fastapi_cpp {
+
+    // io_uring over the raw syscalls, so nothing beyond the kernel headers is needed: the
+    // mmap'ed submission and completion rings, plus one group of provided buffers that
+    // multishot receives pick from. Submissions are queued by the prep methods and handed to
+    // the kernel in one io_uring_enter per wait(), together with the buffers recycled since
+    // the last one. Owned and used by a single thread, which must be the one that
+    // constructed it. Needs Linux 6.0 or later.
+    class IoUring {
+    public:
+        static constexpr uint16_t buffer_group = 0;
+        // Tags the ring's own requests, whose completions are not passed on.
+        static constexpr uint64_t internal_user_data = ~0ull;
+
+        // Throws std::runtime_error when the kernel cannot provide what is needed.
+        IoUring(unsigned entries, unsigned buffer_count, unsigned buffer_size)
+                : buffers_size(buffer_size) {
+            io_uring_params params{};
+            params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+                           IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+            params.cq_entries = entries * 4;
+            ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (ring_fd < 0 && errno == EINVAL) {
+                // Kernels before 6.1 lack DEFER_TASKRUN; the rest is an optimisation too.
+                params = {};
+                params.flags = IORING_SETUP_CQSIZE;
+                params.cq_entries = entries * 4;
+                ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            }
+            if (ring_fd < 0) throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+            constexpr unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG |
+                                          IORING_FEAT_CQE_SKIP;
+            if ((params.features & required) != required) {
+                close(ring_fd);
+                throw std::runtime_error("io_uring lacks required features");
+            }
+            try {
+                map_rings(params);
+                register_buffers(buffer_count);
+            } catch (...) {
+                unmap();
+                close(ring_fd);
+                throw;
+            }
+        }
+
+        ~IoUring() {
+            unmap();
+            close(ring_fd);
+        }
+
+        IoUring(const IoUring&) = delete;
+        IoUring& operator=(const IoUring&) = delete;
+
+        void accept_multishot(int fd, uint64_t user_data) {
+            io_uring_sqe& sqe = next_sqe(IORING_OP_ACCEPT, fd, user_data);
+            sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        }
+
+        // Each completion carries one provided buffer; see buffer() and recycle().
+        void recv_multishot(int fd, uint64_t user_data) {
+            io_uring_sqe& sqe = next_sqe(IORING_OP_RECV, fd, user_data);
+            sqe.ioprio = IORING_RECV_MULTISHOT;
+            sqe.flags = IOSQE_BUFFER_SELECT;
+            sqe.buf_group = buffer_group;
+        }
+
+        // `message` and everything it points at must stay put until the completion arrives.
+        void sendmsg(int fd, const msghdr* message, unsigned flags, uint64_t user_data) {
+            io_uring_sqe& sqe = next_sqe(IORING_OP_SENDMSG, fd, user_data);
+            sqe.addr = reinterpret_cast<uint64_t>(message);
+            sqe.len = 1;
+            sqe.msg_flags = flags;
+        }
+
+        void poll(int fd, uint32_t events, bool multishot, uint64_t user_data) {
+            io_uring_sqe& sqe = next_sqe(IORING_OP_POLL_ADD, fd, user_data);
+            sqe.poll32_events = events;
+            if (multishot) sqe.len = IORING_POLL_ADD_MULTI;
+        }
+
+        // Cancels whatever is still pending on `fd` (its multishot receive), then closes it.
+        // The pair is hard-linked so the close runs even when there was nothing to cancel, and
+        // neither posts a completion unless it fails.
+        void cancel_and_close(int fd, uint64_t user_data) {
+            io_uring_sqe& cancel = next_sqe(IORING_OP_ASYNC_CANCEL, fd, user_data);
+            cancel.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            cancel.flags = IOSQE_IO_HARDLINK | IOSQE_CQE_SKIP_SUCCESS;
+            io_uring_sqe& closing = next_sqe(IORING_OP_CLOSE, fd, user_data);
+            closing.flags = IOSQE_CQE_SKIP_SUCCESS;
+        }
+
+        // Cancels the request submitted with `target`; a multishot one completes with ECANCELED.
+        void cancel(uint64_t target, uint64_t user_data) {
+            io_uring_sqe& sqe = next_sqe(IORING_OP_ASYNC_CANCEL, -1, user_data);
+            sqe.addr = target;
+            sqe.flags = IOSQE_CQE_SKIP_SUCCESS;
+        }
+
+        void cancel_fd(int fd, uint64_t user_data) {
+            io_uring_sqe& sqe = next_sqe(IORING_OP_ASYNC_CANCEL, fd, user_data);
+            sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe.flags = IOSQE_CQE_SKIP_SUCCESS;
+        }
+
+        // Submits everything queued and waits until a completion is available or timeout_ms
+        // passes (-1: no limit), all in one syscall.
+        void wait(int timeout_ms) {
+            provide_returned();
+            enter(1, timeout_ms);
+        }
+
+        // Calls fn(const io_uring_cqe&) for every completion available now. fn may queue
+        // further submissions.
+        template<typename Fn>
+        void for_each_completion(Fn&& fn) {
+            unsigned head = std::atomic_ref<unsigned>(*cq_head).load(std::memory_order_relaxed);
+            while (head != std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire)) {
+                io_uring_cqe cqe = cqes[head & cq_mask];
+                std::atomic_ref<unsigned>(*cq_head).store(++head, std::memory_order_release);
+                if (cqe.user_data != internal_user_data) fn(cqe);
+            }
+        }
+
+        static bool more(const io_uring_cqe& cqe) { return cqe.flags & IORING_CQE_F_MORE; }
+        static bool has_buffer(const io_uring_cqe& cqe) { return cqe.flags & IORING_CQE_F_BUFFER; }
+        static unsigned buffer_id(const io_uring_cqe& cqe) { return cqe.flags >> IORING_CQE_BUFFER_SHIFT; }
+
+        std::string_view buffer(unsigned id, size_t length) const {
+            return {buffers + static_cast<size_t>(id) * buffers_size, length};
+        }
+
+        // Gives a provided buffer back to the kernel once its bytes have been copied out.
+        void recycle(unsigned id) {
+            returned.push_back(static_cast<uint16_t>(id));
+        }
+
+    private:
+        int ring_fd = -1;
+        void* ring_memory = MAP_FAILED;
+        size_t ring_size = 0;
+        io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        size_t sqes_size = 0;
+        unsigned* sq_head = nullptr;
+        unsigned* sq_tail_shared = nullptr;
+        unsigned sq_mask = 0;
+        unsigned sq_entries = 0;
+        unsigned sq_tail = 0;
+        unsigned* cq_head = nullptr;
+        unsigned* cq_tail = nullptr;
+        unsigned cq_mask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        char* buffers = static_cast<char*>(MAP_FAILED);
+        size_t buffers_bytes = 0;
+        unsigned buffers_size;
+        std::vector<uint16_t> returned;
+
+        void map_rings(const io_uring_params& params) {
+            size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            ring_size = std::max(sq_size, cq_size);
+            ring_memory = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+            if (ring_memory == MAP_FAILED) throw std::runtime_error("io_uring ring mmap failed");
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(
+                    mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED) throw std::runtime_error("io_uring sqe mmap failed");
+
+            char* base = static_cast<char*>(ring_memory);
+            sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+            sq_tail_shared = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+            sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+            sq_entries = params.sq_entries;
+            sq_tail = *sq_tail_shared;
+            // The index array maps each slot to itself, so only the tail ever moves.
+            auto* array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+            for (unsigned i = 0; i < sq_entries; i++) array[i] = i;
+            cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+            cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+        }
+
+        void register_buffers(unsigned count) {
+            if (count == 0 || count > 32768) throw std::runtime_error("io_uring buffer count must be between 1 and 32768");
+            buffers_bytes = static_cast<size_t>(count) * buffers_size;
+            void* memory = mmap(nullptr, buffers_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) throw std::runtime_error("io_uring buffer allocation failed");
+            buffers = static_cast<char*>(memory);
+            returned.reserve(count);
+            provide(0, count);
+        }
+
+        // Buffers go back as PROVIDE_BUFFERS requests, one per run of consecutive ids.
+        void provide(unsigned first_id, unsigned count) {
+            io_uring_sqe& sqe = next_sqe(IORING_OP_PROVIDE_BUFFERS, static_cast<int>(count), internal_user_data);
+            sqe.addr = reinterpret_cast<uint64_t>(buffers + static_cast<size_t>(first_id) * buffers_size);
+            sqe.len = buffers_size;
+            sqe.off = first_id;
+            sqe.buf_group = buffer_group;
+            sqe.flags = IOSQE_CQE_SKIP_SUCCESS;
+        }
+
+        void provide_returned() {
+            if (returned.empty()) return;
+            std::sort(returned.begin(), returned.end());
+            size_t start = 0;
+            for (size_t i = 1; i <= returned.size(); i++) {
+                if (i < returned.size() && returned[i] == returned[i - 1] + 1) continue;
+                provide(returned[start], static_cast<unsigned>(i - start));
+                start = i;
+            }
+            returned.clear();
+        }
+
+        void unmap() {
+            if (buffers != MAP_FAILED) munmap(buffers, buffers_bytes);
+            if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+            if (ring_memory != MAP_FAILED) munmap(ring_memory, ring_size);
+        }
+
+        io_uring_sqe& next_sqe(uint8_t opcode, int fd, uint64_t user_data) {
+            if (sq_tail - std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire) >= sq_entries) {
+                enter(0, 0);
+            }
+            io_uring_sqe& sqe = sqes[sq_tail++ & sq_mask];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = opcode;
+            sqe.fd = fd;
+            sqe.user_data = user_data;
+            return sqe;
+        }
+
+        void enter(unsigned wait_for, int timeout_ms) {
+            std::atomic_ref<unsigned>(*sq_tail_shared).store(sq_tail, std::memory_order_release);
+            unsigned to_submit = sq_tail - std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire);
+            __kernel_timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+            io_uring_getevents_arg argument{};
+            argument.sigmask_sz = _NSIG / 8;
+            if (timeout_ms >= 0) argument.ts = reinterpret_cast<uint64_t>(&timeout);
+            long rc = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_for,
+                              IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument, sizeof(argument));
+            if (rc < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            }
+        }
+    };
+}
+
+#endif
+
+#endif //SERVERC___IO_URING_H
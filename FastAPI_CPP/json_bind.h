@@ -0,0 +1,292 @@
+// Tomas Costantino
+
+#ifndef HTTP_JSON_BIND_H
+#define HTTP_JSON_BIND_H
+
+#include "http_lib.h"
+#include "json_document.h"
+#include "json_simd.h"
+#include "json_writer.h"
+#include <charconv>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// Declares the JSON fields of a struct, once, next to it:
+//
+//     struct Item { std::string name; double price = 0; std::vector<std::string> tags; };
+//     FASTAPI_JSON(Item, name, price, tags)
+//
+// Item can then be read with http::from_json<Item>(request.body) and returned with
+// http::HTTP_200_OK(item). Both directions work straight on the text; no http::JSON or
+// JSONDocument tree is built. The macro must be used in the struct's namespace.
+#define FASTAPI_JSON(Type, ...) \
+    [[maybe_unused]] inline constexpr auto fastapi_json_fields(const Type*) { \
+        return std::make_tuple(FASTAPI_JSON_FOR_EACH(FASTAPI_JSON_FIELD, Type, __VA_ARGS__)); \
+    }
+
+#define FASTAPI_JSON_FIELD(Type, field) ::http::json_bind::Field{#field, &Type::field}
+
+#define FASTAPI_JSON_PARENS ()
+#define FASTAPI_JSON_EXPAND(...) FASTAPI_JSON_EXPAND3(FASTAPI_JSON_EXPAND3(FASTAPI_JSON_EXPAND3(__VA_ARGS__)))
+#define FASTAPI_JSON_EXPAND3(...) FASTAPI_JSON_EXPAND2(FASTAPI_JSON_EXPAND2(FASTAPI_JSON_EXPAND2(__VA_ARGS__)))
+#define FASTAPI_JSON_EXPAND2(...) FASTAPI_JSON_EXPAND1(FASTAPI_JSON_EXPAND1(FASTAPI_JSON_EXPAND1(__VA_ARGS__)))
+#define FASTAPI_JSON_EXPAND1(...) __VA_ARGS__
+#define FASTAPI_JSON_FOR_EACH(macro, Type, ...) \
+    __VA_OPT__(FASTAPI_JSON_EXPAND(FASTAPI_JSON_FOR_EACH_NEXT(macro, Type, __VA_ARGS__)))
+#define FASTAPI_JSON_FOR_EACH_NEXT(macro, Type, field, ...) \
+    macro(Type, field) __VA_OPT__(, FASTAPI_JSON_FOR_EACH_AGAIN FASTAPI_JSON_PARENS (macro, Type, __VA_ARGS__))
+#define FASTAPI_JSON_FOR_EACH_AGAIN() FASTAPI_JSON_FOR_EACH_NEXT
+
+namespace http {
+
+    namespace json_bind {
+        template<typename Class, typename Member>
+        struct Field {
+            std::string_view name;
+            Member Class::* member;
+        };
+
+        template<typename T> struct is_optional : std::false_type {};
+        template<typename T> struct is_optional<std::optional<T>> : std::true_type {};
+        template<typename T> struct is_vector : std::false_type {};
+        template<typename T, typename A> struct is_vector<std::vector<T, A>> : std::true_type {};
+    }
+
+    template<typename T>
+    concept JSONBound = requires(const T* p) { fastapi_json_fields(p); };
+
+    // Pull reader over the structural index of one JSON text. Values are consumed in
+    // document order; there is no tree.
+    class JSONReader {
+    public:
+        JSONReader(std::string_view input, std::vector<uint32_t>& index_storage)
+                : text(input), tokens(index_storage) {
+            token_count = json_simd::build_structural_index(input, tokens);
+        }
+
+        bool done() const { return next_token == token_count; }
+
+        char peek() const {
+            if (next_token >= token_count) throw std::runtime_error("Unexpected end of input");
+            return text[tokens[next_token]];
+        }
+
+        void expect(char c, const char* message) {
+            if (text[take()] != c) throw std::runtime_error(message);
+        }
+
+        // Body of the next string literal with escapes still in place.
+        std::string_view raw_string() {
+            uint32_t open_quote = take();
+            if (text[open_quote] != '"') throw std::runtime_error("Expected string");
+            uint32_t close_quote = take();
+            return text.substr(open_quote + 1, close_quote - open_quote - 1);
+        }
+
+        void read_string(std::string& out) {
+            std::string_view raw = raw_string();
+            if (std::memchr(raw.data(), '\\', raw.size()) == nullptr) {
+                out.assign(raw);
+                return;
+            }
+            out.resize(raw.size());
+            out.resize(json_detail::unescape(raw, out.data()));
+        }
+
+        // Text of the next number or literal.
+        std::string_view scalar() {
+            uint32_t at = take();
+            char c = text[at];
+            if (c == '"' || c == '{' || c == '}' || c == '[' || c == ']' || c == ',' || c == ':') {
+                throw std::runtime_error("Expected a number or literal");
+            }
+            return text.substr(at, json_detail::scalar_end(text, at) - at);
+        }
+
+        bool read_null() {
+            if (peek() != 'n') return false;
+            if (scalar() != "null") throw std::runtime_error("Invalid null value");
+            return true;
+        }
+
+        // Calls on_key(key) for every member; on_key must consume the member's value.
+        template<typename OnKey>
+        void read_object(OnKey&& on_key) {
+            expect('{', "Expected object");
+            if (peek() == '}') {
+                next_token++;
+                return;
+            }
+            std::string decoded;
+            while (true) {
+                std::string_view key = raw_string();
+                if (std::memchr(key.data(), '\\', key.size()) != nullptr) {
+                    decoded.resize(key.size());
+                    decoded.resize(json_detail::unescape(key, decoded.data()));
+                    key = decoded;
+                }
+                expect(':', "Expected ':' in object");
+                on_key(key);
+                char c = text[take()];
+                if (c == '}') return;
+                if (c != ',') throw std::runtime_error("Expected ',' in object");
+            }
+        }
+
+        template<typename OnItem>
+        void read_array(OnItem&& on_item) {
+            expect('[', "Expected array");
+            if (peek() == ']') {
+                next_token++;
+                return;
+            }
+            while (true) {
+                on_item();
+                char c = text[take()];
+                if (c == ']') return;
+                if (c != ',') throw std::runtime_error("Expected ',' in array");
+            }
+        }
+
+        // Steps over one value of any shape, e.g. a member the target struct doesn't declare.
+        void skip_value() {
+            size_t depth = 0;
+            do {
+                char c = text[take()];
+                if (c == '"') {
+                    take();
+                } else if (c == '{' || c == '[') {
+                    depth++;
+                } else if (c == '}' || c == ']') {
+                    if (depth == 0) throw std::runtime_error("Unexpected character");
+                    depth--;
+                }
+            } while (depth > 0);
+        }
+
+    private:
+        std::string_view text;
+        std::vector<uint32_t>& tokens;
+        size_t token_count = 0;
+        size_t next_token = 0;
+
+        uint32_t take() {
+            if (next_token >= token_count) throw std::runtime_error("Unexpected end of input");
+            return tokens[next_token++];
+        }
+    };
+
+    template<typename T>
+    void read_json(JSONReader& reader, T& out) {
+        if constexpr (std::is_same_v<T, bool>) {
+            std::string_view token = reader.scalar();
+            if (token == "true") out = true;
+            else if (token == "false") out = false;
+            else throw std::runtime_error("Expected a boolean");
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            std::string_view token = reader.scalar();
+            auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), out);
+            if (ec != std::errc() || end != token.data() + token.size()) {
+                throw std::runtime_error("Invalid number");
+            }
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            reader.read_string(out);
+        } else if constexpr (json_bind::is_optional<T>::value) {
+            if (reader.read_null()) {
+                out.reset();
+            } else {
+                read_json(reader, out.emplace());
+            }
+        } else if constexpr (json_bind::is_vector<T>::value) {
+            out.clear();
+            reader.read_array([&] { read_json(reader, out.emplace_back()); });
+        } else if constexpr (JSONBound<T>) {
+            // Members missing from the input keep their default values; unknown ones are skipped.
+            constexpr auto fields = fastapi_json_fields(static_cast<const T*>(nullptr));
+            reader.read_object([&](std::string_view key) {
+                bool matched = std::apply([&](const auto&... field) {
+                    return ((field.name == key ? (read_json(reader, out.*(field.member)), true) : false) || ...);
+                }, fields);
+                if (!matched) reader.skip_value();
+            });
+        } else {
+            static_assert(JSONBound<T>, "type has no JSON binding; declare it with FASTAPI_JSON");
+        }
+    }
+
+    template<typename T>
+    void write_json(JSONWriter& writer, const T& value) {
+        if constexpr (std::is_arithmetic_v<T> || std::is_same_v<T, std::string>) {
+            writer.value(value);
+        } else if constexpr (json_bind::is_optional<T>::value) {
+            if (value) {
+                write_json(writer, *value);
+            } else {
+                writer.null();
+            }
+        } else if constexpr (json_bind::is_vector<T>::value) {
+            writer.begin_array();
+            for (const auto& item : value) write_json(writer, item);
+            writer.end_array();
+        } else if constexpr (JSONBound<T>) {
+            constexpr auto fields = fastapi_json_fields(static_cast<const T*>(nullptr));
+            writer.begin_object();
+            std::apply([&](const auto&... field) {
+                ((writer.key(field.name), write_json(writer, value.*(field.member))), ...);
+            }, fields);
+            writer.end_object();
+        } else {
+            static_assert(JSONBound<T>, "type has no JSON binding; declare it with FASTAPI_JSON");
+        }
+    }
+
+    template<JSONBound T>
+    void from_json(std::string_view text, T& out) {
+        thread_local std::vector<uint32_t> index;
+        // Kept for the next body parsed on this thread, unless a large one grew it past 1 MiB:
+        // that memory would otherwise stay pinned to the thread for good.
+        constexpr size_t max_retained = (1 << 20) / sizeof(uint32_t);
+        struct Trim {
+            std::vector<uint32_t>& entries;
+            ~Trim() {
+                if (entries.capacity() > max_retained) std::vector<uint32_t>().swap(entries);
+            }
+        } trim{index};
+        JSONReader reader(text, index);
+        read_json(reader, out);
+        if (!reader.done()) throw std::runtime_error("Unexpected trailing characters");
+    }
+
+    template<JSONBound T>
+    T from_json(std::string_view text) {
+        T out{};
+        from_json(text, out);
+        return out;
+    }
+
+    template<JSONBound T>
+    std::string to_json_string(const T& value) {
+        std::string out;
+        JSONWriter writer(out);
+        write_json(writer, value);
+        return out;
+    }
+
+    template<JSONBound T>
+    Response HTTP_200_OK(const T& body, ResponseHeaders headers = {}) {
+        return Response{{1, 1}, HttpStatus::OK, std::move(headers), to_json_string(body), json_content_type};
+    }
+
+    template<JSONBound T>
+    Response HTTP_201_CREATED(const T& body, ResponseHeaders headers = {}) {
+        return Response{{1, 1}, HttpStatus::CREATED, std::move(headers), to_json_string(body), json_content_type};
+    }
+}
+
+#endif //HTTP_JSON_BIND_H
@@ -0,0 +1,496 @@
+// Tomas Costantino
+
+#ifndef HTTP_JSON_DOCUMENT_H
+#define HTTP_JSON_DOCUMENT_H
+
+#include "arena.h"
+#include "http_lib.h"
+#include "json_simd.h"
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace http {
+
+    struct JSONMember;
+
+    // Immutable node of a JSONDocument. Arrays and objects point at contiguous arena storage;
+    // object members keep their source order. Strings without escapes are views into the
+    // parsed input, so the input must outlive the document.
+    class JSONValue {
+    public:
+        enum class Type : uint8_t {
+            NULL_VALUE,
+            BOOL,
+            INT,
+            DOUBLE,
+            STRING,
+            ARRAY,
+            OBJECT
+        };
+
+        JSONValue() : type_(Type::NULL_VALUE), size_(0), integer(0) {}
+
+        Type type() const { return type_; }
+        bool is_null() const { return type_ == Type::NULL_VALUE; }
+        bool is_bool() const { return type_ == Type::BOOL; }
+        bool is_int() const { return type_ == Type::INT; }
+        bool is_double() const { return type_ == Type::DOUBLE; }
+        bool is_number() const { return type_ == Type::INT || type_ == Type::DOUBLE; }
+        bool is_string() const { return type_ == Type::STRING; }
+        bool is_array() const { return type_ == Type::ARRAY; }
+        bool is_object() const { return type_ == Type::OBJECT; }
+
+        bool as_bool() const { check(Type::BOOL, "bool"); return boolean; }
+        int64_t as_int() const { check(Type::INT, "integer"); return integer; }
+        double as_double() const {
+            if (type_ == Type::INT) return static_cast<double>(integer);
+            check(Type::DOUBLE, "number");
+            return number;
+        }
+        std::string_view as_string() const { check(Type::STRING, "string"); return {string, size_}; }
+
+        // Element count of an array or member count of an object.
+        size_t size() const { return (type_ == Type::ARRAY || type_ == Type::OBJECT) ? size_ : 0; }
+
+        const JSONValue& operator[](size_t i) const {
+            check(Type::ARRAY, "array");
+            if (i >= size_) throw std::out_of_range("JSON array index out of range");
+            return items[i];
+        }
+
+        // Elements of an array / members of an object in source order; empty for other types.
+        inline std::span<const JSONValue> elements() const;
+        inline std::span<const JSONMember> object_members() const;
+
+        // Linear lookup of the first member named `key`; nullptr when absent or not an object.
+        inline const JSONValue* find(std::string_view key) const;
+
+        // Converts to the owning http::JSON representation.
+        inline JSON to_json() const;
+
+        // Serializes straight from the document, in source member order.
+        inline void write(JSONWriter& writer) const;
+
+        static JSONValue make_null() { return JSONValue(); }
+        static JSONValue make_bool(bool b) { JSONValue v(Type::BOOL, 0); v.boolean = b; return v; }
+        static JSONValue make_int(int64_t i) { JSONValue v(Type::INT, 0); v.integer = i; return v; }
+        static JSONValue make_double(double d) { JSONValue v(Type::DOUBLE, 0); v.number = d; return v; }
+        static JSONValue make_string(std::string_view s) {
+            JSONValue v(Type::STRING, static_cast<uint32_t>(s.size()));
+            v.string = s.data();
+            return v;
+        }
+        static JSONValue make_array(const JSONValue* values, size_t count) {
+            JSONValue v(Type::ARRAY, static_cast<uint32_t>(count));
+            v.items = values;
+            return v;
+        }
+        static JSONValue make_object(const JSONMember* values, size_t count) {
+            JSONValue v(Type::OBJECT, static_cast<uint32_t>(count));
+            v.members = values;
+            return v;
+        }
+
+    private:
+        Type type_;
+        uint32_t size_;
+        union {
+            bool boolean;
+            int64_t integer;
+            double number;
+            const char* string;
+            const JSONValue* items;
+            const JSONMember* members;
+        };
+
+        JSONValue(Type t, uint32_t size) : type_(t), size_(size), integer(0) {}
+
+        void check(Type expected, const char* name) const {
+            if (type_ != expected) throw std::runtime_error(std::string("JSON value is not a ") + name);
+        }
+    };
+
+    struct JSONMember {
+        std::string_view key;
+        JSONValue value;
+    };
+
+    inline std::span<const JSONValue> JSONValue::elements() const {
+        if (type_ != Type::ARRAY) return {};
+        return {items, size_};
+    }
+
+    inline std::span<const JSONMember> JSONValue::object_members() const {
+        if (type_ != Type::OBJECT) return {};
+        return {members, size_};
+    }
+
+    inline const JSONValue* JSONValue::find(std::string_view key) const {
+        if (type_ != Type::OBJECT) return nullptr;
+        for (uint32_t i = 0; i < size_; i++) {
+            if (members[i].key == key) return &members[i].value;
+        }
+        return nullptr;
+    }
+
+    inline JSON JSONValue::to_json() const {
+        switch (type_) {
+            case Type::NULL_VALUE: return JSON(nullptr);
+            case Type::BOOL: return JSON(boolean);
+            case Type::INT:
+                if (integer >= INT32_MIN && integer <= INT32_MAX) return JSON(static_cast<int>(integer));
+                return JSON(static_cast<double>(integer));
+            case Type::DOUBLE: return JSON(number);
+            case Type::STRING: return JSON(std::string(string, size_));
+            case Type::ARRAY: {
+                JSON::Array array;
+                array.reserve(size_);
+                for (uint32_t i = 0; i < size_; i++) array.push_back(items[i].to_json());
+                return JSON(array);
+            }
+            case Type::OBJECT: {
+                JSON::Object object;
+                for (uint32_t i = 0; i < size_; i++) {
+                    object.insert_or_assign(std::string(members[i].key), members[i].value.to_json());
+                }
+                return JSON(object);
+            }
+        }
+        return JSON();
+    }
+
+    inline void JSONValue::write(JSONWriter& writer) const {
+        switch (type_) {
+            case Type::NULL_VALUE: writer.null(); break;
+            case Type::BOOL: writer.value(boolean); break;
+            case Type::INT: writer.value(static_cast<long long>(integer)); break;
+            case Type::DOUBLE: writer.value(number); break;
+            case Type::STRING: writer.value(std::string_view(string, size_)); break;
+            case Type::ARRAY:
+                writer.begin_array();
+                for (uint32_t i = 0; i < size_; i++) items[i].write(writer);
+                writer.end_array();
+                break;
+            case Type::OBJECT:
+                writer.begin_object();
+                for (uint32_t i = 0; i < size_; i++) {
+                    writer.key(members[i].key);
+                    members[i].value.write(writer);
+                }
+                writer.end_object();
+                break;
+        }
+    }
+
+    namespace json_detail {
+        inline bool is_terminator(char c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',' || c == ':' ||
+                   c == ']' || c == '}' || c == '[' || c == '{' || c == '"';
+        }
+
+        // End of the number or literal that starts at `start`.
+        inline size_t scalar_end(std::string_view text, size_t start) {
+            size_t end = start;
+            while (end < text.size() && !is_terminator(text[end])) end++;
+            return end;
+        }
+
+        inline uint32_t parse_hex4(std::string_view raw, size_t& i) {
+            if (i + 4 > raw.size()) throw std::runtime_error("Incomplete Unicode escape");
+            uint32_t value = 0;
+            auto [last, ec] = std::from_chars(raw.data() + i, raw.data() + i + 4, value, 16);
+            if (ec != std::errc() || last != raw.data() + i + 4) throw std::runtime_error("Invalid Unicode escape");
+            i += 4;
+            return value;
+        }
+
+        // \uXXXX (6 input bytes) expands to at most 3 UTF-8 bytes, and a surrogate pair
+        // (12 input bytes) to 4, so the output always fits in the escaped length.
+        inline size_t encode_utf8(char* out, uint32_t cp) {
+            if (cp < 0x80) {
+                out[0] = static_cast<char>(cp);
+                return 1;
+            }
+            if (cp < 0x800) {
+                out[0] = static_cast<char>(0xC0 | (cp >> 6));
+                out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+                return 2;
+            }
+            if (cp < 0x10000) {
+                out[0] = static_cast<char>(0xE0 | (cp >> 12));
+                out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+                return 3;
+            }
+            out[0] = static_cast<char>(0xF0 | (cp >> 18));
+            out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+            return 4;
+        }
+
+        // Decodes the body of a string literal into `out`, which must hold raw.size() bytes;
+        // decoded text is never longer than its escaped form. Returns the decoded length.
+        inline size_t unescape(std::string_view raw, char* out) {
+            size_t length = 0;
+            size_t i = 0;
+            while (i < raw.size()) {
+                char c = raw[i++];
+                if (c != '\\') {
+                    out[length++] = c;
+                    continue;
+                }
+                if (i >= raw.size()) throw std::runtime_error("Invalid escape sequence");
+                char next = raw[i++];
+                switch (next) {
+                    case '"': out[length++] = '"'; break;
+                    case '\\': out[length++] = '\\'; break;
+                    case '/': out[length++] = '/'; break;
+                    case 'b': out[length++] = '\b'; break;
+                    case 'f': out[length++] = '\f'; break;
+                    case 'n': out[length++] = '\n'; break;
+                    case 'r': out[length++] = '\r'; break;
+                    case 't': out[length++] = '\t'; break;
+                    case 'u': {
+                        uint32_t codepoint = parse_hex4(raw, i);
+                        if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+                            if (raw.compare(i, 2, "\\u") != 0) throw std::runtime_error("Unpaired surrogate");
+                            i += 2;
+                            uint32_t low = parse_hex4(raw, i);
+                            if (low < 0xDC00 || low > 0xDFFF) throw std::runtime_error("Unpaired surrogate");
+                            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        length += encode_utf8(out + length, codepoint);
+                        break;
+                    }
+                    default:
+                        throw std::runtime_error("Invalid escape sequence");
+                }
+            }
+            return length;
+        }
+    }
+
+    // Parses JSON into arena-backed JSONValues in two stages. Stage one
+    // (json_simd::build_structural_index) classifies the input 64 bytes at a time with
+    // AVX2 / SSE2 / NEON, or a scalar fallback, and records every token offset. Stage two
+    // walks that index without recursion and builds the tree: strings are sliced between
+    // their indexed quotes, and scalars are parsed in place. All nodes come from the
+    // document's arena and are released together by reset() or destruction. The token
+    // index and the scratch stacks survive across parses, so a reused document causes no
+    // heap traffic.
+    class JSONDocument {
+    public:
+        static constexpr size_t max_depth = 512;
+
+        JSONDocument() : arena(&owned_arena) {}
+        explicit JSONDocument(Arena& external_arena) : arena(&external_arena) {}
+
+        JSONDocument(const JSONDocument&) = delete;
+        JSONDocument& operator=(const JSONDocument&) = delete;
+
+        // `input` must stay alive and unmodified while the returned value is in use.
+        const JSONValue& parse(std::string_view input) {
+            text = input;
+            token_count = json_simd::build_structural_index(input, tokens);
+            next_token = 0;
+            value_stack.clear();
+            member_stack.clear();
+            frames.clear();
+
+            root_value = build();
+            if (next_token != token_count) {
+                throw std::runtime_error("Unexpected trailing characters");
+            }
+            return root_value;
+        }
+
+        const JSONValue& root() const { return root_value; }
+
+        void reset() {
+            root_value = JSONValue();
+            arena->reset();
+        }
+
+    private:
+        struct Frame {
+            bool object;
+            size_t start;
+            std::string_view key;
+        };
+
+        Arena owned_arena;
+        Arena* arena;
+        std::string_view text;
+        std::vector<uint32_t> tokens;
+        size_t token_count = 0;
+        size_t next_token = 0;
+        JSONValue root_value;
+        std::vector<JSONValue> value_stack;
+        std::vector<JSONMember> member_stack;
+        std::vector<Frame> frames;
+
+        uint32_t take_token() {
+            if (next_token >= token_count) throw std::runtime_error("Unexpected end of input");
+            return tokens[next_token++];
+        }
+
+        char peek_token() const {
+            if (next_token >= token_count) throw std::runtime_error("Unexpected end of input");
+            return text[tokens[next_token]];
+        }
+
+        // Stage two. Each iteration either opens a container or produces a value, which is
+        // then appended to the innermost open container, closing containers as their
+        // terminators are reached.
+        JSONValue build() {
+            while (true) {
+                uint32_t at = take_token();
+                JSONValue value;
+                bool produced = true;
+                switch (text[at]) {
+                    case '{':
+                        if (peek_token() == '}') {
+                            next_token++;
+                            value = JSONValue::make_object(nullptr, 0);
+                        } else {
+                            open(true, member_stack.size());
+                            read_key();
+                            produced = false;
+                        }
+                        break;
+                    case '[':
+                        if (peek_token() == ']') {
+                            next_token++;
+                            value = JSONValue::make_array(nullptr, 0);
+                        } else {
+                            open(false, value_stack.size());
+                            produced = false;
+                        }
+                        break;
+                    case '"':
+                        value = JSONValue::make_string(string_at(at));
+                        break;
+                    default:
+                        value = scalar_at(at);
+                        break;
+                }
+                if (!produced) continue;
+
+                // Attach the value; keep closing containers whose terminator follows.
+                while (true) {
+                    if (frames.empty()) return value;
+                    Frame& frame = frames.back();
+                    if (frame.object) {
+                        member_stack.push_back({frame.key, value});
+                    } else {
+                        value_stack.push_back(value);
+                    }
+
+                    char c = text[take_token()];
+                    if (c == ',') {
+                        if (frame.object) read_key();
+                        break;
+                    }
+                    if (frame.object && c == '}') {
+                        size_t count = member_stack.size() - frame.start;
+                        JSONMember* members = arena->allocate_array<JSONMember>(count);
+                        std::copy(member_stack.begin() + frame.start, member_stack.end(), members);
+                        member_stack.resize(frame.start);
+                        value = JSONValue::make_object(members, count);
+                    } else if (!frame.object && c == ']') {
+                        size_t count = value_stack.size() - frame.start;
+                        JSONValue* items = arena->allocate_array<JSONValue>(count);
+                        std::copy(value_stack.begin() + frame.start, value_stack.end(), items);
+                        value_stack.resize(frame.start);
+                        value = JSONValue::make_array(items, count);
+                    } else {
+                        throw std::runtime_error(frame.object ? "Expected ',' in object" : "Expected ',' in array");
+                    }
+                    frames.pop_back();
+                }
+            }
+        }
+
+        void open(bool object, size_t start) {
+            if (frames.size() >= max_depth) throw std::runtime_error("JSON nesting too deep");
+            frames.push_back({object, start, {}});
+        }
+
+        void read_key() {
+            uint32_t at = take_token();
+            if (text[at] != '"') throw std::runtime_error("Object key must be a string");
+            frames.back().key = string_at(at);
+            if (text[take_token()] != ':') throw std::runtime_error("Expected ':' in object");
+        }
+
+        // The token after an opening quote is always its closing quote. Strings without
+        // escapes are returned as views into the input.
+        std::string_view string_at(uint32_t open_quote) {
+            uint32_t close_quote = take_token();
+            std::string_view raw = text.substr(open_quote + 1, close_quote - open_quote - 1);
+            if (std::memchr(raw.data(), '\\', raw.size()) == nullptr) {
+                return raw;
+            }
+            return decode_escaped(raw);
+        }
+
+        JSONValue scalar_at(uint32_t at) {
+            size_t end = json_detail::scalar_end(text, at);
+            std::string_view token = text.substr(at, end - at);
+            if (token.empty()) throw std::runtime_error("Unexpected character");
+            switch (token[0]) {
+                case 't':
+                    if (token == "true") return JSONValue::make_bool(true);
+                    throw std::runtime_error("Invalid boolean value");
+                case 'f':
+                    if (token == "false") return JSONValue::make_bool(false);
+                    throw std::runtime_error("Invalid boolean value");
+                case 'n':
+                    if (token == "null") return JSONValue::make_null();
+                    throw std::runtime_error("Invalid null value");
+                default:
+                    if (token[0] == '-' || (token[0] >= '0' && token[0] <= '9')) return parse_number(token);
+                    throw std::runtime_error("Unexpected character");
+            }
+        }
+
+        static JSONValue parse_number(std::string_view token) {
+            size_t digits_at = token[0] == '-' ? 1 : 0;
+            if (digits_at >= token.size() || token[digits_at] < '0' || token[digits_at] > '9') {
+                throw std::runtime_error("Invalid number");
+            }
+            const char* first = token.data();
+            const char* last = token.data() + token.size();
+            if (token.find_first_of(".eE") == std::string_view::npos) {
+                int64_t value = 0;
+                auto [end, ec] = std::from_chars(first, last, value);
+                if (ec == std::errc() && end == last) return JSONValue::make_int(value);
+            }
+            double value = 0;
+            auto [end, ec] = std::from_chars(first, last, value);
+            if (ec != std::errc() || end != last) throw std::runtime_error("Invalid number");
+            return JSONValue::make_double(value);
+        }
+
+        // Decoded text is never longer than its escaped form, so it is written straight into
+        // one arena allocation of the raw length.
+        std::string_view decode_escaped(std::string_view raw) {
+            char* out = arena->allocate_array<char>(raw.size());
+            return {out, json_detail::unescape(raw, out)};
+        }
+    };
+
+    inline JSON JSON::parse(const std::string& json_string) {
+        JSONDocument document;
+        return document.parse(json_string).to_json();
+    }
+}
+
+#endif //HTTP_JSON_DOCUMENT_H
@@ -0,0 +1,227 @@
+// Tomas Costantino
+
+#ifndef HTTP_JSON_SIMD_H
+#define HTTP_JSON_SIMD_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define FASTAPI_JSON_X86
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FASTAPI_JSON_NEON
+#endif
+
+namespace http::json_simd {
+
+    // Per-64-byte-block classification, one bit per input byte.
+    struct BlockMasks {
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t op;        // { } [ ] : ,
+        uint64_t space;     // space, \t, \n, \r
+        uint64_t control;   // bytes below 0x20
+    };
+
+    inline void classify_scalar(const char* block, BlockMasks& m) {
+        m = {};
+        for (int i = 0; i < 64; i++) {
+            auto c = static_cast<unsigned char>(block[i]);
+            uint64_t bit = uint64_t(1) << i;
+            if (c == '"') m.quote |= bit;
+            else if (c == '\\') m.backslash |= bit;
+            else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') m.op |= bit;
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') m.space |= bit;
+            if (c < 0x20) m.control |= bit;
+        }
+    }
+
+#if defined(FASTAPI_JSON_X86)
+    inline void classify_sse2(const char* block, BlockMasks& m) {
+        m = {};
+        for (int part = 0; part < 4; part++) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + part * 16));
+            auto eq = [&](char c) {
+                return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)))));
+            };
+            int shift = part * 16;
+            m.quote |= eq('"') << shift;
+            m.backslash |= eq('\\') << shift;
+            m.op |= (eq('{') | eq('}') | eq('[') | eq(']') | eq(':') | eq(',')) << shift;
+            m.space |= (eq(' ') | eq('\t') | eq('\n') | eq('\r')) << shift;
+            __m128i low = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F));
+            m.control |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(low))) << shift;
+        }
+    }
+
+    __attribute__((target("avx2"))) inline uint64_t avx2_eq(__m256i v, char c) {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+    }
+
+    __attribute__((target("avx2"))) inline void classify_avx2(const char* block, BlockMasks& m) {
+        m = {};
+        for (int part = 0; part < 2; part++) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + part * 32));
+            int shift = part * 32;
+            m.quote |= avx2_eq(v, '"') << shift;
+            m.backslash |= avx2_eq(v, '\\') << shift;
+            m.op |= (avx2_eq(v, '{') | avx2_eq(v, '}') | avx2_eq(v, '[') | avx2_eq(v, ']') |
+                     avx2_eq(v, ':') | avx2_eq(v, ',')) << shift;
+            m.space |= (avx2_eq(v, ' ') | avx2_eq(v, '\t') | avx2_eq(v, '\n') | avx2_eq(v, '\r')) << shift;
+            __m256i low = _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(0x1F)), _mm256_set1_epi8(0x1F));
+            m.control |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(low))) << shift;
+        }
+    }
+#elif defined(FASTAPI_JSON_NEON)
+    inline uint64_t neon_movemask(uint8x16_t p0, uint8x16_t p1, uint8x16_t p2, uint8x16_t p3) {
+        const uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+        uint8x16_t sum0 = vpaddq_u8(vandq_u8(p0, bits), vandq_u8(p1, bits));
+        uint8x16_t sum1 = vpaddq_u8(vandq_u8(p2, bits), vandq_u8(p3, bits));
+        sum0 = vpaddq_u8(sum0, sum1);
+        sum0 = vpaddq_u8(sum0, sum0);
+        return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+    }
+
+    inline void classify_neon(const char* block, BlockMasks& m) {
+        uint8x16_t v[4];
+        for (int i = 0; i < 4; i++) v[i] = vld1q_u8(reinterpret_cast<const uint8_t*>(block + i * 16));
+        auto eq = [&](uint8_t c) {
+            uint8x16_t s = vdupq_n_u8(c);
+            return neon_movemask(vceqq_u8(v[0], s), vceqq_u8(v[1], s), vceqq_u8(v[2], s), vceqq_u8(v[3], s));
+        };
+        m.quote = eq('"');
+        m.backslash = eq('\\');
+        m.op = eq('{') | eq('}') | eq('[') | eq(']') | eq(':') | eq(',');
+        m.space = eq(' ') | eq('\t') | eq('\n') | eq('\r');
+        uint8x16_t limit = vdupq_n_u8(0x20);
+        m.control = neon_movemask(vcltq_u8(v[0], limit), vcltq_u8(v[1], limit),
+                                  vcltq_u8(v[2], limit), vcltq_u8(v[3], limit));
+    }
+#endif
+
+    // Bits of characters escaped by an odd-length run of backslashes; `prev_odd` carries a run
+    // that ends at the last byte of the previous block.
+    inline uint64_t escaped_characters(uint64_t backslash, uint64_t& prev_odd) {
+        constexpr uint64_t even_bits = 0x5555555555555555ULL;
+        constexpr uint64_t odd_bits = ~even_bits;
+        uint64_t start_edges = backslash & ~(backslash << 1);
+        uint64_t even_start_mask = even_bits ^ prev_odd;
+        uint64_t even_starts = start_edges & even_start_mask;
+        uint64_t odd_starts = start_edges & ~even_start_mask;
+        uint64_t even_carries = backslash + even_starts;
+        uint64_t odd_carries;
+        bool ends_odd = __builtin_add_overflow(backslash, odd_starts, &odd_carries);
+        odd_carries |= prev_odd;
+        prev_odd = ends_odd ? 1 : 0;
+        uint64_t even_carry_ends = even_carries & ~backslash;
+        uint64_t odd_carry_ends = odd_carries & ~backslash;
+        return (even_carry_ends & odd_bits) | (odd_carry_ends & even_bits);
+    }
+
+    // Bit i is set when an odd number of quotes appear at or before i.
+    inline uint64_t prefix_xor(uint64_t x) {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+
+    // Stage one: records the offset of every token start (structural characters, both quotes
+    // of every string, and the first byte of each number or literal) that lies outside a string.
+    template<void (*Classify)(const char*, BlockMasks&)>
+    inline size_t index_blocks(std::string_view input, uint32_t* out) {
+        size_t count = 0;
+        uint64_t prev_odd_backslash = 0;
+        uint64_t prev_in_string = 0;
+        uint64_t prev_boundary = 1;
+        uint64_t string_error = 0;
+        BlockMasks m;
+        alignas(64) char tail[64];
+
+        for (size_t base = 0; base < input.size(); base += 64) {
+            const char* block = input.data() + base;
+            if (input.size() - base < 64) {
+                std::memset(tail, ' ', sizeof(tail));
+                std::memcpy(tail, block, input.size() - base);
+                block = tail;
+            }
+            Classify(block, m);
+
+            uint64_t quotes = m.quote & ~escaped_characters(m.backslash, prev_odd_backslash);
+            uint64_t in_string = prefix_xor(quotes) ^ prev_in_string;
+            prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+            uint64_t outside = ~in_string;
+            uint64_t closing_quotes = quotes & outside;
+            string_error |= m.control & in_string & ~quotes;
+
+            uint64_t ops = m.op & outside;
+            uint64_t boundary = ops | (m.space & outside) | closing_quotes;
+            uint64_t scalars = outside & ~m.op & ~m.space & ~quotes;
+            uint64_t scalar_starts = scalars & ((boundary << 1) | prev_boundary);
+            prev_boundary = boundary >> 63;
+
+            uint64_t structurals = ops | quotes | scalar_starts;
+            while (structurals) {
+                out[count++] = static_cast<uint32_t>(base + __builtin_ctzll(structurals));
+                structurals &= structurals - 1;
+            }
+        }
+
+        if (prev_in_string) throw std::runtime_error("Unterminated string");
+        if (string_error) throw std::runtime_error("Control character in string");
+        return count;
+    }
+
+#if defined(FASTAPI_JSON_X86)
+    __attribute__((target("avx2"))) inline size_t index_avx2(std::string_view input, uint32_t* out) {
+        return index_blocks<classify_avx2>(input, out);
+    }
+#endif
+
+    enum class Backend {
+        SCALAR,
+        SSE2,
+        AVX2,
+        NEON
+    };
+
+    // Picks the widest classifier this CPU supports, once per process.
+    inline Backend active_backend() {
+#if defined(FASTAPI_JSON_X86)
+        static const Backend backend = __builtin_cpu_supports("avx2") ? Backend::AVX2 : Backend::SSE2;
+        return backend;
+#elif defined(FASTAPI_JSON_NEON)
+        return Backend::NEON;
+#else
+        return Backend::SCALAR;
+#endif
+    }
+
+    // Fills `index` with token offsets and returns their count.
+    inline size_t build_structural_index(std::string_view input, std::vector<uint32_t>& index,
+                                         Backend backend = active_backend()) {
+        if (input.size() >= UINT32_MAX) throw std::runtime_error("JSON document too large");
+        if (index.size() < input.size() + 1) index.resize(input.size() + 1);
+
+        switch (backend) {
+#if defined(FASTAPI_JSON_X86)
+            case Backend::AVX2: return index_avx2(input, index.data());
+            case Backend::SSE2: return index_blocks<classify_sse2>(input, index.data());
+#elif defined(FASTAPI_JSON_NEON)
+            case Backend::NEON: return index_blocks<classify_neon>(input, index.data());
+#endif
+            default: return index_blocks<classify_scalar>(input, index.data());
+        }
+    }
+}
+
+#endif //HTTP_JSON_SIMD_H
@@ -0,0 +1,158 @@
+// Tomas Costantino
+
+#ifndef HTTP_JSON_WRITER_H
+#define HTTP_JSON_WRITER_H
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FASTAPI_JSON_WRITER_SSE2
+#endif
+
+namespace http {
+
+    namespace json_escape {
+        // Escape sequence for every byte: empty for bytes copied verbatim, otherwise the text
+        // to emit instead ("\\n", "\\u001f", ...).
+        struct Table {
+            char text[256][7]{};
+            uint8_t length[256]{};
+
+            constexpr Table() {
+                constexpr char hex[] = "0123456789abcdef";
+                for (int c = 0; c < 0x20; c++) {
+                    const char seq[7] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF], 0};
+                    for (int i = 0; i < 7; i++) text[c][i] = seq[i];
+                    length[c] = 6;
+                }
+                set('"', "\\\"");
+                set('\\', "\\\\");
+                set('\b', "\\b");
+                set('\f', "\\f");
+                set('\n', "\\n");
+                set('\r', "\\r");
+                set('\t', "\\t");
+            }
+
+            constexpr void set(unsigned char c, const char* seq) {
+                text[c][0] = seq[0];
+                text[c][1] = seq[1];
+                text[c][2] = 0;
+                length[c] = 2;
+            }
+        };
+
+        inline constexpr Table table{};
+
+        // Length of the prefix of `s` that needs no escaping.
+        inline size_t safe_prefix(const char* s, size_t n) {
+            size_t i = 0;
+#if defined(FASTAPI_JSON_WRITER_SSE2)
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i control_max = _mm_set1_epi8(0x1F);
+            for (; i + 16 <= n; i += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+                __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_max_epu8(v, control_max), control_max));
+                int mask = _mm_movemask_epi8(special);
+                if (mask != 0) return i + __builtin_ctz(mask);
+            }
+#endif
+            while (i < n && table.length[static_cast<unsigned char>(s[i])] == 0) i++;
+            return i;
+        }
+    }
+
+    // Appends JSON text to a caller-owned buffer. Values are written in order and the writer
+    // inserts the separators, so a whole response body is produced in one growing string with
+    // no intermediate allocations:
+    //
+    //     JSONWriter w(out);
+    //     w.begin_object(); w.key("ids"); w.begin_array(); w.value(1); w.end_array(); w.end_object();
+    class JSONWriter {
+    public:
+        explicit JSONWriter(std::string& output) : out(output) {}
+
+        void begin_object() { separate(); out += '{'; need_comma = false; }
+        void end_object() { out += '}'; need_comma = true; }
+        void begin_array() { separate(); out += '['; need_comma = false; }
+        void end_array() { out += ']'; need_comma = true; }
+
+        void key(std::string_view name) {
+            separate();
+            write_string(name);
+            out += ':';
+            need_comma = false;
+        }
+
+        void null() { separate(); out += "null"; need_comma = true; }
+        void value(std::nullptr_t) { null(); }
+        void value(bool b) { separate(); out += b ? "true" : "false"; need_comma = true; }
+        void value(int number) { value(static_cast<long long>(number)); }
+        void value(long number) { value(static_cast<long long>(number)); }
+        void value(unsigned number) { value(static_cast<unsigned long long>(number)); }
+        void value(unsigned long number) { value(static_cast<unsigned long long>(number)); }
+        void value(long long number) { separate(); append_number(number); need_comma = true; }
+        void value(unsigned long long number) { separate(); append_number(number); need_comma = true; }
+
+        // Shortest text that round-trips; JSON has no NaN or Infinity, so those become null.
+        void value(double number) {
+            separate();
+            if (std::isfinite(number)) {
+                append_number(number);
+            } else {
+                out += "null";
+            }
+            need_comma = true;
+        }
+
+        void value(std::string_view text) { separate(); write_string(text); need_comma = true; }
+        void value(const char* text) { value(std::string_view(text)); }
+        void value(const std::string& text) { value(std::string_view(text)); }
+
+        // Appends already-serialized JSON verbatim.
+        void raw(std::string_view json) { separate(); out += json; need_comma = true; }
+
+        std::string& buffer() { return out; }
+
+    private:
+        std::string& out;
+        bool need_comma = false;
+
+        void separate() {
+            if (need_comma) out += ',';
+        }
+
+        template<typename Number>
+        void append_number(Number number) {
+            char digits[32];
+            auto result = std::to_chars(digits, digits + sizeof(digits), number);
+            out.append(digits, result.ptr - digits);
+        }
+
+        void write_string(std::string_view text) {
+            out += '"';
+            const char* p = text.data();
+            size_t remaining = text.size();
+            while (remaining > 0) {
+                size_t safe = json_escape::safe_prefix(p, remaining);
+                out.append(p, safe);
+                if (safe == remaining) break;
+                auto c = static_cast<unsigned char>(p[safe]);
+                out.append(json_escape::table.text[c], json_escape::table.length[c]);
+                p += safe + 1;
+                remaining -= safe + 1;
+            }
+            out += '"';
+        }
+    };
+}
+
+#endif //HTTP_JSON_WRITER_H
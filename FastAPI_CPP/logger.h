@@ -0,0 +1,213 @@
+// Tomas Costantino
+
+#ifndef SERVERC___LOGGER_H
+#define SERVERC___LOGGER_H
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+namespace fastapi_cpp {
+
+    enum class LogLevel {
+        OFF,
+        ERROR,
+        INFO,
+        DEBUG
+    };
+
+    // Process-wide asynchronous logger. Producers format straight into a slot of a bounded
+    // lock-free ring (Vyukov MPMC sequence scheme, single consumer) and never block or
+    // allocate; a background thread drains the ring and writes in batches. If the ring is
+    // full the line is dropped and counted rather than stalling the caller.
+    // Use it through the FASTAPI_LOG_* macros so arguments aren't evaluated when filtered out.
+    class Logger {
+    public:
+        static constexpr size_t capacity = 4096;
+        static constexpr size_t max_line = 480;
+
+        static Logger& instance() {
+            static Logger logger;
+            return logger;
+        }
+
+        void set_level(LogLevel level) { current_level.store(level, std::memory_order_relaxed); }
+        LogLevel level() const { return current_level.load(std::memory_order_relaxed); }
+
+        bool enabled(LogLevel level) const {
+            return level != LogLevel::OFF && static_cast<int>(level) <= static_cast<int>(this->level());
+        }
+
+        size_t dropped() const { return dropped_lines.load(std::memory_order_relaxed); }
+
+        template<typename... Args>
+        void write(LogLevel level, const Args&... args) {
+            ensure_started();
+            size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[pos & (capacity - 1)];
+                size_t seq = slot->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0) {
+                    if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    dropped_lines.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                } else {
+                    pos = enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+
+            char* out = slot->text;
+            char* end = slot->text + max_line;
+            (append(out, end, args), ...);
+            slot->length = static_cast<uint16_t>(out - slot->text);
+            slot->level = level;
+            slot->sequence.store(pos + 1, std::memory_order_release);
+        }
+
+        // Blocks until everything logged so far has been written.
+        void flush() {
+            size_t target = enqueue_pos.load(std::memory_order_acquire);
+            while (started.load(std::memory_order_acquire) && written.load(std::memory_order_acquire) < target) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        ~Logger() {
+            stopping.store(true, std::memory_order_release);
+            if (consumer.joinable()) {
+                consumer.join();
+            }
+        }
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<size_t> sequence{0};
+            LogLevel level = LogLevel::INFO;
+            uint16_t length = 0;
+            char text[max_line];
+        };
+
+        std::atomic<LogLevel> current_level{LogLevel::INFO};
+        std::array<Slot, capacity> slots;
+        alignas(64) std::atomic<size_t> enqueue_pos{0};
+        alignas(64) size_t dequeue_pos = 0;
+        std::atomic<size_t> written{0};
+        std::atomic<size_t> dropped_lines{0};
+        std::atomic<bool> started{false};
+        std::atomic<bool> stopping{false};
+        std::thread consumer;
+        std::atomic_flag start_flag = ATOMIC_FLAG_INIT;
+
+        Logger() {
+            for (size_t i = 0; i < capacity; i++) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        void ensure_started() {
+            if (started.load(std::memory_order_acquire)) return;
+            if (!start_flag.test_and_set(std::memory_order_acq_rel)) {
+                consumer = std::thread([this] { drain_loop(); });
+                started.store(true, std::memory_order_release);
+            }
+        }
+
+        static const char* prefix(LogLevel level) {
+            switch (level) {
+                case LogLevel::ERROR: return "[ERROR] ";
+                case LogLevel::INFO: return "[INFO] ";
+                case LogLevel::DEBUG: return "[DEBUG] ";
+                default: return "";
+            }
+        }
+
+        void drain_loop() {
+            std::string out_batch;
+            std::string err_batch;
+            out_batch.reserve(64 * 1024);
+            while (true) {
+                bool stop = stopping.load(std::memory_order_acquire);
+                size_t drained = 0;
+                while (drained < capacity) {
+                    Slot& slot = slots[dequeue_pos & (capacity - 1)];
+                    if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) break;
+
+                    std::string& batch = slot.level == LogLevel::ERROR ? err_batch : out_batch;
+                    batch += prefix(slot.level);
+                    batch.append(slot.text, slot.length);
+                    batch += '\n';
+
+                    slot.sequence.store(dequeue_pos + capacity, std::memory_order_release);
+                    dequeue_pos++;
+                    drained++;
+                }
+
+                if (!out_batch.empty()) {
+                    std::fwrite(out_batch.data(), 1, out_batch.size(), stdout);
+                    std::fflush(stdout);
+                    out_batch.clear();
+                }
+                if (!err_batch.empty()) {
+                    std::fwrite(err_batch.data(), 1, err_batch.size(), stderr);
+                    err_batch.clear();
+                }
+                written.store(dequeue_pos, std::memory_order_release);
+
+                if (drained == 0) {
+                    if (stop) return;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+        }
+
+        static void append(char*& out, char* end, std::string_view text) {
+            size_t n = std::min(text.size(), static_cast<size_t>(end - out));
+            std::memcpy(out, text.data(), n);
+            out += n;
+        }
+
+        static void append(char*& out, char* end, const char* text) {
+            append(out, end, std::string_view(text));
+        }
+
+        static void append(char*& out, char* end, const std::string& text) {
+            append(out, end, std::string_view(text));
+        }
+
+        static void append(char*& out, char* end, char c) {
+            if (out < end) *out++ = c;
+        }
+
+        template<typename Number, typename = std::enable_if_t<std::is_arithmetic_v<Number>>>
+        static void append(char*& out, char* end, Number value) {
+            if constexpr (std::is_same_v<Number, bool>) {
+                append(out, end, value ? "true" : "false");
+            } else {
+                auto result = std::to_chars(out, end, value);
+                if (result.ec == std::errc()) out = result.ptr;
+            }
+        }
+    };
+}
+
+#define FASTAPI_LOG(level, ...) \
+    do { \
+        auto& fastapi_logger_ = ::fastapi_cpp::Logger::instance(); \
+        if (fastapi_logger_.enabled(level)) fastapi_logger_.write(level, __VA_ARGS__); \
+    } while (0)
+
+#define FASTAPI_LOG_ERROR(...) FASTAPI_LOG(::fastapi_cpp::LogLevel::ERROR, __VA_ARGS__)
+#define FASTAPI_LOG_INFO(...) FASTAPI_LOG(::fastapi_cpp::LogLevel::INFO, __VA_ARGS__)
+#define FASTAPI_LOG_DEBUG(...) FASTAPI_LOG(::fastapi_cpp::LogLevel::DEBUG, __VA_ARGS__)
+
+#endif //SERVERC___LOGGER_H
@@ -0,0 +1,288 @@
+// Tomas Costantino
+
+#ifndef SERVERC___METRICS_H
+#define SERVERC___METRICS_H
+
+#include "http_lib.h"
+#include <array>
+#include <charconv>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fastapi_cpp {
+
+    // Stages of a request that get a latency histogram. SEND runs from the first response
+    // being queued on an idle connection until its output has been fully written.
+    enum class Phase {
+        PARSE,
+        ROUTE,
+        HANDLER,
+        SEND,
+        COUNT
+    };
+
+    // Process-wide request metrics, rendered in the Prometheus text format. Every thread
+    // records into its own cache-line aligned shard with relaxed atomic adds, so recording
+    // never contends; render() sums the shards. Nothing is recorded until enable() is called,
+    // and the hot-path hooks reduce to one predictable branch until then.
+    class Metrics {
+    public:
+        static constexpr size_t max_shards = 64;
+        static constexpr size_t max_routes = 4096;
+        static constexpr size_t max_status = 600;
+
+        // Histogram bucket upper bounds in nanoseconds (1us .. 10s), Prometheus style.
+        static constexpr std::array<uint64_t, 22> bucket_bounds = {
+                1'000, 2'500, 5'000, 10'000, 25'000, 50'000, 100'000, 250'000, 500'000,
+                1'000'000, 2'500'000, 5'000'000, 10'000'000, 25'000'000, 50'000'000,
+                100'000'000, 250'000'000, 500'000'000, 1'000'000'000, 2'500'000'000, 5'000'000'000,
+                10'000'000'000};
+
+        static Metrics& instance() {
+            static Metrics metrics;
+            return metrics;
+        }
+
+        void enable() { active.store(true, std::memory_order_relaxed); }
+        bool enabled() const { return active.load(std::memory_order_relaxed); }
+
+        // Called while routes are being registered; the id indexes the per-route counters.
+        uint32_t register_route(http::Method method, std::string_view pattern) {
+            std::lock_guard<std::mutex> lock(routes_mutex);
+            if (route_labels.size() >= max_routes) return max_routes - 1;
+            route_labels.push_back({http::method_to_string(method), std::string(pattern)});
+            return static_cast<uint32_t>(route_labels.size() - 1);
+        }
+
+        // Timestamp for a phase that may be recorded later; 0 while metrics are disabled.
+        uint64_t start() const { return enabled() ? now_ns() : 0; }
+
+        void observe_since(Phase phase, uint64_t started) {
+            if (started == 0) return;
+            uint64_t nanoseconds = now_ns() - started;
+            Histogram& histogram = local().phases[static_cast<size_t>(phase)];
+            size_t bucket = 0;
+            while (bucket < bucket_bounds.size() && nanoseconds > bucket_bounds[bucket]) bucket++;
+            bump(histogram.buckets[bucket]);
+            bump(histogram.sum_ns, nanoseconds);
+        }
+
+        void count_route(uint32_t route_id) {
+            if (enabled()) bump(local().route_requests[route_id]);
+        }
+
+        void count_unmatched() {
+            if (enabled()) bump(local().unmatched);
+        }
+
+        void count_status(int status) {
+            if (enabled()) bump(local().statuses[status > 0 && status < static_cast<int>(max_status) ? status : 0]);
+        }
+
+        void add_bytes_in(uint64_t bytes) {
+            if (enabled()) bump(local().bytes_in, bytes);
+        }
+
+        void add_bytes_out(uint64_t bytes) {
+            if (enabled()) bump(local().bytes_out, bytes);
+        }
+
+        void connection_opened() {
+            if (enabled()) bump(local().connections_opened);
+        }
+
+        void connection_closed() {
+            if (enabled()) bump(local().connections_closed);
+        }
+
+        static uint64_t now_ns() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        void render(std::string& out) const {
+            std::vector<const Shard*> live;
+            for (const auto& slot : shards) {
+                if (const Shard* shard = slot.load(std::memory_order_acquire)) live.push_back(shard);
+            }
+            auto total = [&](auto member) {
+                uint64_t sum = 0;
+                for (const Shard* shard : live) sum += member(*shard).load(std::memory_order_relaxed);
+                return sum;
+            };
+
+            out += "# HELP fastapi_requests_total Requests dispatched to each route.\n"
+                   "# TYPE fastapi_requests_total counter\n";
+            {
+                std::lock_guard<std::mutex> lock(routes_mutex);
+                for (size_t i = 0; i < route_labels.size(); i++) {
+                    out += "fastapi_requests_total{method=\"";
+                    out += route_labels[i].method;
+                    out += "\",route=\"";
+                    append_label(out, route_labels[i].pattern);
+                    out += "\"} ";
+                    append_number(out, total([i](const Shard& s) -> const std::atomic<uint64_t>& { return s.route_requests[i]; }));
+                    out += '\n';
+                }
+            }
+            metric(out, "fastapi_unmatched_requests_total", "counter", "Requests that matched no route.",
+                   total([](const Shard& s) -> const std::atomic<uint64_t>& { return s.unmatched; }));
+
+            out += "# HELP fastapi_responses_total Responses sent by status code.\n"
+                   "# TYPE fastapi_responses_total counter\n";
+            for (size_t status = 0; status < max_status; status++) {
+                uint64_t count = total([status](const Shard& s) -> const std::atomic<uint64_t>& { return s.statuses[status]; });
+                if (count == 0) continue;
+                out += "fastapi_responses_total{status=\"";
+                append_number(out, status);
+                out += "\"} ";
+                append_number(out, count);
+                out += '\n';
+            }
+
+            uint64_t opened = total([](const Shard& s) -> const std::atomic<uint64_t>& { return s.connections_opened; });
+            uint64_t closed = total([](const Shard& s) -> const std::atomic<uint64_t>& { return s.connections_closed; });
+            metric(out, "fastapi_connections_accepted_total", "counter", "Connections accepted.", opened);
+            metric(out, "fastapi_connections_open", "gauge", "Connections currently open.", opened >= closed ? opened - closed : 0);
+            metric(out, "fastapi_received_bytes_total", "counter", "Bytes read from clients.",
+                   total([](const Shard& s) -> const std::atomic<uint64_t>& { return s.bytes_in; }));
+            metric(out, "fastapi_sent_bytes_total", "counter", "Bytes written to clients.",
+                   total([](const Shard& s) -> const std::atomic<uint64_t>& { return s.bytes_out; }));
+
+            out += "# HELP fastapi_phase_duration_seconds Time spent per request phase.\n"
+                   "# TYPE fastapi_phase_duration_seconds histogram\n";
+            static constexpr const char* phase_names[] = {"parse", "route", "handler", "send"};
+            for (size_t phase = 0; phase < static_cast<size_t>(Phase::COUNT); phase++) {
+                uint64_t cumulative = 0;
+                for (size_t bucket = 0; bucket <= bucket_bounds.size(); bucket++) {
+                    cumulative += total([phase, bucket](const Shard& s) -> const std::atomic<uint64_t>& {
+                        return s.phases[phase].buckets[bucket];
+                    });
+                    out += "fastapi_phase_duration_seconds_bucket{phase=\"";
+                    out += phase_names[phase];
+                    out += "\",le=\"";
+                    if (bucket < bucket_bounds.size()) {
+                        append_seconds(out, bucket_bounds[bucket]);
+                    } else {
+                        out += "+Inf";
+                    }
+                    out += "\"} ";
+                    append_number(out, cumulative);
+                    out += '\n';
+                }
+                out += "fastapi_phase_duration_seconds_sum{phase=\"";
+                out += phase_names[phase];
+                out += "\"} ";
+                append_seconds(out, total([phase](const Shard& s) -> const std::atomic<uint64_t>& { return s.phases[phase].sum_ns; }));
+                out += "\nfastapi_phase_duration_seconds_count{phase=\"";
+                out += phase_names[phase];
+                out += "\"} ";
+                append_number(out, cumulative);
+                out += '\n';
+            }
+        }
+
+    private:
+        struct Histogram {
+            std::array<std::atomic<uint64_t>, bucket_bounds.size() + 1> buckets{};
+            std::atomic<uint64_t> sum_ns{0};
+        };
+
+        struct alignas(64) Shard {
+            std::atomic<uint64_t> bytes_in{0};
+            std::atomic<uint64_t> bytes_out{0};
+            std::atomic<uint64_t> connections_opened{0};
+            std::atomic<uint64_t> connections_closed{0};
+            std::atomic<uint64_t> unmatched{0};
+            std::array<Histogram, static_cast<size_t>(Phase::COUNT)> phases{};
+            std::array<std::atomic<uint64_t>, max_status> statuses{};
+            std::array<std::atomic<uint64_t>, max_routes> route_requests{};
+        };
+
+        struct RouteLabel {
+            std::string method;
+            std::string pattern;
+        };
+
+        std::atomic<bool> active{false};
+        std::array<std::atomic<Shard*>, max_shards> shards{};
+        std::atomic<size_t> next_shard{0};
+        mutable std::mutex routes_mutex;
+        std::vector<RouteLabel> route_labels;
+
+        Metrics() = default;
+
+        ~Metrics() {
+            for (auto& slot : shards) delete slot.load();
+        }
+
+        // Threads beyond max_shards share shards; the adds stay atomic, only less spread out.
+        Shard& local() {
+            thread_local Shard* shard = nullptr;
+            if (shard) return *shard;
+            auto& slot = shards[next_shard.fetch_add(1, std::memory_order_relaxed) % max_shards];
+            Shard* existing = slot.load(std::memory_order_acquire);
+            if (!existing) {
+                auto* created = new Shard();
+                if (slot.compare_exchange_strong(existing, created, std::memory_order_acq_rel)) {
+                    existing = created;
+                } else {
+                    delete created;
+                }
+            }
+            shard = existing;
+            return *shard;
+        }
+
+        static void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+            counter.fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        static void metric(std::string& out, std::string_view name, std::string_view type, std::string_view help, uint64_t value) {
+            out += "# HELP ";
+            out += name;
+            out += ' ';
+            out += help;
+            out += "\n# TYPE ";
+            out += name;
+            out += ' ';
+            out += type;
+            out += '\n';
+            out += name;
+            out += ' ';
+            append_number(out, value);
+            out += '\n';
+        }
+
+        static void append_number(std::string& out, uint64_t value) {
+            char digits[24];
+            auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+            out.append(digits, end);
+        }
+
+        static void append_seconds(std::string& out, uint64_t nanoseconds) {
+            char text[32];
+            int n = std::snprintf(text, sizeof(text), "%.9g", static_cast<double>(nanoseconds) / 1e9);
+            out.append(text, n);
+        }
+
+        static void append_label(std::string& out, std::string_view value) {
+            for (char c : value) {
+                if (c == '\\' || c == '"') out += '\\';
+                if (c == '\n') {
+                    out += "\\n";
+                    continue;
+                }
+                out += c;
+            }
+        }
+    };
+}
+
+#endif //SERVERC___METRICS_H
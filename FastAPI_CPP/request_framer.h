@@ -0,0 +1,329 @@
+// Tomas Costantino
+
+#ifndef HTTP_REQUEST_FRAMER_H
+#define HTTP_REQUEST_FRAMER_H
+
+#include "http_lib.h"
+#include <string>
+#include <cstddef>
+#include <charconv>
+
+namespace http {
+
+    struct FramingLimits {
+        size_t max_header_size = 16 * 1024;
+        size_t max_body_size = 16 * 1024 * 1024;
+    };
+
+    // Incremental request framing over a connection's receive buffer. feed() may be called
+    // again whenever more bytes have been appended; it resumes where the previous call stopped.
+    // A request ends after its header block plus exactly Content-Length body bytes, or after
+    // the terminating chunk (and trailers) of a Transfer-Encoding: chunked body.
+    //
+    // With stop_at_head set, feed() returns HEAD once the header block is parsed, before any
+    // body limit applies. The caller then either calls feed() again to buffer the body as
+    // usual, or stream_body() and then feed_body() to take the body piece by piece.
+    class RequestFramer {
+    public:
+        enum class Status {
+            INCOMPLETE,
+            HEAD,
+            COMPLETE,
+            ERROR
+        };
+
+        explicit RequestFramer(FramingLimits framing_limits = {}) : limits(framing_limits) {}
+
+        void stop_at_head(bool enabled) { report_head = enabled; }
+
+        Status feed(std::string_view buffer) {
+            return advance(buffer, nullptr);
+        }
+
+        // After HEAD: stop buffering the body and hand it out through feed_body() instead.
+        // The body size limit does not apply to a streamed body.
+        void stream_body() { streaming = true; }
+
+        // Decodes the next piece of a streamed body from `buffer`, which starts where the
+        // previous call's consumed() bytes ended. `piece` views the body bytes found, often
+        // fewer than the buffer holds: call again after handing it on and dropping consumed()
+        // bytes. INCOMPLETE with an empty piece means more input is needed.
+        Status feed_body(std::string_view buffer, std::string_view& piece) {
+            piece = {};
+            cursor = 0;
+            header_length = 0;
+            return advance(buffer, &piece);
+        }
+
+        // Request line and headers only; valid after feed() returned HEAD or COMPLETE.
+        Request take_head(std::string_view buffer, Request::allocator_type alloc = {}) {
+            parser.parse(buffer);
+            return build_request(parser, alloc);
+        }
+
+        // Builds the framed request. Only valid after feed() returned COMPLETE.
+        Request take_request(std::string_view buffer, Request::allocator_type alloc = {}) {
+            parser.parse(buffer);
+            Request request = build_request(parser, alloc);
+            if (chunked) {
+                request.body = body;
+            } else {
+                request.body = buffer.substr(header_length, content_length);
+            }
+            return request;
+        }
+
+        // Request line and headers as views into the buffer last passed to feed().
+        const RequestParser& request_head() const { return parser; }
+
+        // Bytes at the front of the buffer that belong to the framed request.
+        size_t consumed() const { return cursor; }
+
+        HttpStatus error() const { return error_status; }
+
+        // The header block of the current request has been framed.
+        bool in_body() const { return phase != Phase::HEADERS; }
+
+        void reset() {
+            parser.reset();
+            phase = Phase::HEADERS;
+            error_status = HttpStatus::BAD_REQUEST;
+            header_length = 0;
+            content_length = 0;
+            cursor = 0;
+            chunk_remaining = 0;
+            body_remaining = 0;
+            trailer_bytes = 0;
+            chunked = false;
+            streaming = false;
+            body.clear();
+        }
+
+    private:
+        enum class Phase {
+            HEADERS,
+            BODY_START,
+            FIXED_BODY,
+            CHUNK_SIZE,
+            CHUNK_DATA,
+            CHUNK_END,
+            TRAILERS,
+            DONE,
+            FAILED
+        };
+
+        static constexpr size_t max_chunk_line = 1024;
+
+        FramingLimits limits;
+        RequestParser parser;
+        Phase phase = Phase::HEADERS;
+        HttpStatus error_status = HttpStatus::BAD_REQUEST;
+        size_t header_length = 0;
+        size_t content_length = 0;
+        size_t cursor = 0;
+        size_t chunk_remaining = 0;
+        size_t body_remaining = 0;
+        size_t trailer_bytes = 0;   // of the trailer section framed so far
+        bool chunked = false;
+        bool report_head = false;
+        bool streaming = false;
+        std::string body;
+
+        // The framing state machine. `piece` is set only while streaming; each body piece
+        // found then ends the call, so the caller can consume it before the next.
+        Status advance(std::string_view buffer, std::string_view* piece) {
+            while (true) {
+                switch (phase) {
+                    case Phase::HEADERS: {
+                        auto status = parser.parse(buffer);
+                        if (status == RequestParser::Status::ERROR) {
+                            return fail(parser.header_count() >= RequestParser::max_headers
+                                        ? HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE
+                                        : HttpStatus::BAD_REQUEST);
+                        }
+                        if (status == RequestParser::Status::INCOMPLETE) {
+                            if (buffer.size() > limits.max_header_size) {
+                                return fail(HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE);
+                            }
+                            return Status::INCOMPLETE;
+                        }
+                        header_length = parser.header_length();
+                        if (header_length > limits.max_header_size) {
+                            return fail(HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE);
+                        }
+                        if (!read_framing_headers()) {
+                            return Status::ERROR;
+                        }
+                        cursor = header_length;
+                        phase = Phase::BODY_START;
+                        if (report_head) return Status::HEAD;
+                        break;
+                    }
+                    case Phase::BODY_START: {
+                        if (chunked) {
+                            phase = Phase::CHUNK_SIZE;
+                        } else if (!streaming && content_length > limits.max_body_size) {
+                            return fail(HttpStatus::PAYLOAD_TOO_LARGE);
+                        } else {
+                            body_remaining = content_length;
+                            phase = Phase::FIXED_BODY;
+                        }
+                        break;
+                    }
+                    case Phase::FIXED_BODY: {
+                        if (streaming) {
+                            size_t available = std::min(buffer.size() - cursor, body_remaining);
+                            *piece = buffer.substr(cursor, available);
+                            cursor += available;
+                            body_remaining -= available;
+                            if (body_remaining == 0) phase = Phase::DONE;
+                            return phase == Phase::DONE ? Status::COMPLETE : Status::INCOMPLETE;
+                        }
+                        if (buffer.size() - header_length < content_length) {
+                            return Status::INCOMPLETE;
+                        }
+                        cursor = header_length + content_length;
+                        phase = Phase::DONE;
+                        break;
+                    }
+                    case Phase::CHUNK_SIZE: {
+                        size_t line_end = buffer.find("\r\n", cursor);
+                        if (line_end == std::string_view::npos) {
+                            if (buffer.size() - cursor > max_chunk_line) {
+                                return fail(HttpStatus::BAD_REQUEST);
+                            }
+                            return Status::INCOMPLETE;
+                        }
+                        size_t size = 0;
+                        size_t digits = 0;
+                        for (size_t i = cursor; i < line_end && buffer[i] != ';'; i++, digits++) {
+                            int value = hex_value(buffer[i]);
+                            if (value < 0 || digits >= 15) {
+                                return fail(HttpStatus::BAD_REQUEST);
+                            }
+                            size = size * 16 + value;
+                        }
+                        if (digits == 0) {
+                            return fail(HttpStatus::BAD_REQUEST);
+                        }
+                        if (!streaming && body.size() + size > limits.max_body_size) {
+                            return fail(HttpStatus::PAYLOAD_TOO_LARGE);
+                        }
+                        cursor = line_end + 2;
+                        chunk_remaining = size;
+                        phase = size == 0 ? Phase::TRAILERS : Phase::CHUNK_DATA;
+                        break;
+                    }
+                    case Phase::CHUNK_DATA: {
+                        size_t available = std::min(buffer.size() - cursor, chunk_remaining);
+                        if (streaming) {
+                            *piece = buffer.substr(cursor, available);
+                        } else {
+                            body.append(buffer, cursor, available);
+                        }
+                        cursor += available;
+                        chunk_remaining -= available;
+                        if (chunk_remaining == 0) phase = Phase::CHUNK_END;
+                        if (chunk_remaining > 0 || streaming) {
+                            return Status::INCOMPLETE;
+                        }
+                        break;
+                    }
+                    case Phase::CHUNK_END: {
+                        if (buffer.size() - cursor < 2) {
+                            return Status::INCOMPLETE;
+                        }
+                        if (buffer.compare(cursor, 2, "\r\n") != 0) {
+                            return fail(HttpStatus::BAD_REQUEST);
+                        }
+                        cursor += 2;
+                        phase = Phase::CHUNK_SIZE;
+                        break;
+                    }
+                    case Phase::TRAILERS: {
+                        // The whole trailer section, like a header block, is bounded by
+                        // max_header_size: it stays buffered until the request is complete.
+                        size_t line_end = buffer.find("\r\n", cursor);
+                        size_t line_length = line_end == std::string_view::npos ? buffer.size() - cursor : line_end + 2 - cursor;
+                        if (trailer_bytes + line_length > limits.max_header_size) {
+                            return fail(HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE);
+                        }
+                        if (line_end == std::string_view::npos) {
+                            return Status::INCOMPLETE;
+                        }
+                        trailer_bytes += line_length;
+                        bool last = line_end == cursor;
+                        cursor = line_end + 2;
+                        if (last) {
+                            phase = Phase::DONE;
+                        }
+                        break;
+                    }
+                    case Phase::DONE:
+                        return Status::COMPLETE;
+                    case Phase::FAILED:
+                        return Status::ERROR;
+                }
+            }
+        }
+
+        Status fail(HttpStatus status) {
+            error_status = status;
+            phase = Phase::FAILED;
+            return Status::ERROR;
+        }
+
+        static int hex_value(char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        // Extracts Content-Length / Transfer-Encoding from the parsed header block.
+        // Conflicting framing information is rejected rather than guessed at.
+        bool read_framing_headers() {
+            bool has_length = false;
+            bool has_encoding = false;
+            for (size_t i = 0; i < parser.header_count(); i++) {
+                auto header = parser.header_at(i);
+                if (iequals(header.name, "Content-Length")) {
+                    size_t length = 0;
+                    auto [end, ec] = std::from_chars(header.value.data(), header.value.data() + header.value.size(), length);
+                    if (ec != std::errc() || end != header.value.data() + header.value.size() ||
+                        header.value.empty() || header.value[0] == '+' || header.value[0] == '-') {
+                        return fail_framing();
+                    }
+                    if (has_length && length != content_length) {
+                        return fail_framing();
+                    }
+                    content_length = length;
+                    has_length = true;
+                } else if (iequals(header.name, "Transfer-Encoding")) {
+                    std::string_view coding = header.value;
+                    auto last_comma = coding.rfind(',');
+                    if (last_comma != std::string_view::npos) coding.remove_prefix(last_comma + 1);
+                    while (!coding.empty() && (coding.front() == ' ' || coding.front() == '\t')) coding.remove_prefix(1);
+                    if (!iequals(coding, "chunked")) {
+                        fail(HttpStatus::NOT_IMPLEMENTED);
+                        return false;
+                    }
+                    has_encoding = true;
+                }
+            }
+
+            if (has_length && has_encoding) {
+                return fail_framing();
+            }
+            chunked = has_encoding;
+            return true;
+        }
+
+        bool fail_framing() {
+            fail(HttpStatus::BAD_REQUEST);
+            return false;
+        }
+    };
+}
+
+#endif //HTTP_REQUEST_FRAMER_H
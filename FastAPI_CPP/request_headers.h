@@ -0,0 +1,260 @@
+// Tomas Costantino
+
+#ifndef HTTP_REQUEST_HEADERS_H
+#define HTTP_REQUEST_HEADERS_H
+
+#include "request_parser.h"
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace http {
+
+    // Header names common enough in requests to be interned. OTHER is any other name.
+    enum class HeaderId : uint8_t {
+        OTHER,
+        HOST,
+        CONNECTION,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        CONTENT_ENCODING,
+        TRANSFER_ENCODING,
+        ACCEPT,
+        ACCEPT_ENCODING,
+        ACCEPT_LANGUAGE,
+        USER_AGENT,
+        EXPECT,
+        COOKIE,
+        AUTHORIZATION,
+        CACHE_CONTROL,
+        PRAGMA,
+        IF_NONE_MATCH,
+        IF_MODIFIED_SINCE,
+        IF_RANGE,
+        RANGE,
+        ORIGIN,
+        REFERER,
+        UPGRADE,
+        KEEP_ALIVE,
+        TE,
+        X_FORWARDED_FOR,
+        X_REQUEST_ID,
+        COUNT
+    };
+
+    constexpr std::string_view header_name(HeaderId id) {
+        switch (id) {
+            case HeaderId::HOST: return "Host";
+            case HeaderId::CONNECTION: return "Connection";
+            case HeaderId::CONTENT_LENGTH: return "Content-Length";
+            case HeaderId::CONTENT_TYPE: return "Content-Type";
+            case HeaderId::CONTENT_ENCODING: return "Content-Encoding";
+            case HeaderId::TRANSFER_ENCODING: return "Transfer-Encoding";
+            case HeaderId::ACCEPT: return "Accept";
+            case HeaderId::ACCEPT_ENCODING: return "Accept-Encoding";
+            case HeaderId::ACCEPT_LANGUAGE: return "Accept-Language";
+            case HeaderId::USER_AGENT: return "User-Agent";
+            case HeaderId::EXPECT: return "Expect";
+            case HeaderId::COOKIE: return "Cookie";
+            case HeaderId::AUTHORIZATION: return "Authorization";
+            case HeaderId::CACHE_CONTROL: return "Cache-Control";
+            case HeaderId::PRAGMA: return "Pragma";
+            case HeaderId::IF_NONE_MATCH: return "If-None-Match";
+            case HeaderId::IF_MODIFIED_SINCE: return "If-Modified-Since";
+            case HeaderId::IF_RANGE: return "If-Range";
+            case HeaderId::RANGE: return "Range";
+            case HeaderId::ORIGIN: return "Origin";
+            case HeaderId::REFERER: return "Referer";
+            case HeaderId::UPGRADE: return "Upgrade";
+            case HeaderId::KEEP_ALIVE: return "Keep-Alive";
+            case HeaderId::TE: return "TE";
+            case HeaderId::X_FORWARDED_FOR: return "X-Forwarded-For";
+            case HeaderId::X_REQUEST_ID: return "X-Request-Id";
+            default: return {};
+        }
+    }
+
+    namespace detail {
+
+        // Case-insensitive for letters, which is all a header name's case can differ in; the
+        // candidate it picks is confirmed with a real comparison.
+        constexpr uint32_t header_hash(std::string_view name, uint32_t seed) {
+            auto fold = [](char c) { return static_cast<uint32_t>(static_cast<unsigned char>(c) | 0x20); };
+            uint32_t h = (seed ^ static_cast<uint32_t>(name.size())) * 0x9E3779B1u;
+            h = (h ^ fold(name.front())) * 0x85EBCA6Bu;
+            h = (h ^ fold(name[name.size() / 2])) * 0xC2B2AE35u;
+            h = (h ^ fold(name.back())) * 0x27D4EB2Fu;
+            return h >> 25;   // 0..127
+        }
+
+        struct HeaderTable {
+            uint32_t seed = 0;
+            std::array<HeaderId, 128> slots{};
+        };
+
+        // Tries seeds until every interned name lands in a slot of its own: a perfect hash,
+        // found by the compiler, that stays perfect when names are added to HeaderId.
+        constexpr HeaderTable make_header_table() {
+            for (uint32_t seed = 1;; seed++) {
+                HeaderTable table{seed, {}};
+                bool collision = false;
+                for (uint8_t id = 1; id < static_cast<uint8_t>(HeaderId::COUNT) && !collision; id++) {
+                    HeaderId& slot = table.slots[header_hash(header_name(HeaderId(id)), seed)];
+                    collision = slot != HeaderId::OTHER;
+                    slot = HeaderId(id);
+                }
+                if (!collision) return table;
+            }
+        }
+
+        inline constexpr HeaderTable header_table = make_header_table();
+    }
+
+    // The interned id of `name`, compared case-insensitively; OTHER when it is not interned.
+    constexpr HeaderId header_id(std::string_view name) {
+        if (name.empty()) return HeaderId::OTHER;
+        HeaderId candidate = detail::header_table.slots[detail::header_hash(name, detail::header_table.seed)];
+        std::string_view known = header_name(candidate);
+        if (known.size() != name.size()) return HeaderId::OTHER;
+        auto lower = [](char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c; };
+        for (size_t i = 0; i < name.size(); i++) {
+            if (lower(name[i]) != lower(known[i])) return HeaderId::OTHER;
+        }
+        return candidate;
+    }
+
+    // Request headers in arrival order. Names and values are copied into one string, so a
+    // request's headers cost a single allocation from its arena; interned names are not
+    // copied at all. The first inline_capacity entries live inside the object. Lookups are
+    // case-insensitive, and O(1) for interned names; for a repeated header they return the
+    // last value, while iteration sees every one.
+    class RequestHeaders {
+    public:
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+        static constexpr size_t inline_capacity = 16;
+
+        struct Header {
+            std::string_view name;
+            std::string_view value;
+        };
+
+        class Iterator {
+        public:
+            Iterator(const RequestHeaders& headers, size_t index) : owner(&headers), position(index) {}
+            Header operator*() const { return owner->at(position); }
+            Iterator& operator++() {
+                position++;
+                return *this;
+            }
+            bool operator==(const Iterator& other) const { return position == other.position; }
+
+        private:
+            const RequestHeaders* owner;
+            size_t position;
+        };
+
+        RequestHeaders() : RequestHeaders(allocator_type()) {}
+
+        explicit RequestHeaders(allocator_type alloc) : text(alloc), overflow(alloc) {}
+
+        RequestHeaders(const RequestHeaders& other, allocator_type alloc)
+                : text(other.text, alloc), inline_entries(other.inline_entries), overflow(other.overflow, alloc),
+                  count(other.count), latest(other.latest) {}
+
+        RequestHeaders(const RequestHeaders&) = default;
+        RequestHeaders(RequestHeaders&&) noexcept = default;
+        RequestHeaders& operator=(const RequestHeaders&) = default;
+        RequestHeaders& operator=(RequestHeaders&&) = default;
+
+        // Room for `bytes` of names and values, so that adding them allocates once.
+        void reserve(size_t bytes) { text.reserve(bytes); }
+
+        // Views handed out before an add() may dangle unless reserve() covered it.
+        void add(std::string_view name, std::string_view value) {
+            Entry entry{header_id(name), 0, 0, 0, 0};
+            if (entry.id == HeaderId::OTHER) {
+                entry.name_offset = static_cast<uint32_t>(text.size());
+                entry.name_length = static_cast<uint32_t>(name.size());
+                text.append(name);
+            }
+            entry.value_offset = static_cast<uint32_t>(text.size());
+            entry.value_length = static_cast<uint32_t>(value.size());
+            text.append(value);
+            if (count < inline_capacity) {
+                inline_entries[count] = entry;
+            } else {
+                overflow.push_back(entry);
+            }
+            count++;
+            if (entry.id != HeaderId::OTHER) latest[static_cast<size_t>(entry.id)] = static_cast<uint16_t>(count);
+        }
+
+        std::optional<std::string_view> find(HeaderId id) const {
+            uint16_t position = latest[static_cast<size_t>(id)];
+            if (id == HeaderId::OTHER || position == 0) return std::nullopt;
+            return value_of(entry_at(position - 1));
+        }
+
+        std::optional<std::string_view> find(std::string_view name) const {
+            HeaderId id = header_id(name);
+            if (id != HeaderId::OTHER) return find(id);
+            for (size_t i = count; i-- > 0;) {
+                const Entry& entry = entry_at(i);
+                if (entry.id == HeaderId::OTHER && RequestParser::equals_ignore_case(name_of(entry), name)) return value_of(entry);
+            }
+            return std::nullopt;
+        }
+
+        // The value, or empty when absent.
+        template<typename Key>
+        std::string_view get(Key key) const { return find(key).value_or(std::string_view()); }
+
+        template<typename Key>
+        bool contains(Key key) const { return find(key).has_value(); }
+
+        Header at(size_t i) const {
+            const Entry& entry = entry_at(i);
+            return {name_of(entry), value_of(entry)};
+        }
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        Iterator begin() const { return {*this, 0}; }
+        Iterator end() const { return {*this, count}; }
+
+    private:
+        struct Entry {
+            HeaderId id;
+            uint32_t name_offset;
+            uint32_t name_length;
+            uint32_t value_offset;
+            uint32_t value_length;
+        };
+
+        std::pmr::string text;
+        std::array<Entry, inline_capacity> inline_entries{};
+        std::pmr::vector<Entry> overflow;
+        size_t count = 0;
+        // 1 + the position of the last entry with each interned id; 0 when there is none.
+        std::array<uint16_t, static_cast<size_t>(HeaderId::COUNT)> latest{};
+
+        const Entry& entry_at(size_t i) const {
+            return i < inline_capacity ? inline_entries[i] : overflow[i - inline_capacity];
+        }
+
+        std::string_view name_of(const Entry& entry) const {
+            if (entry.id != HeaderId::OTHER) return header_name(entry.id);
+            return std::string_view(text).substr(entry.name_offset, entry.name_length);
+        }
+
+        std::string_view value_of(const Entry& entry) const {
+            return std::string_view(text).substr(entry.value_offset, entry.value_length);
+        }
+    };
+}
+
+#endif //HTTP_REQUEST_HEADERS_H
@@ -0,0 +1,175 @@
+// Tomas Costantino
+
+#ifndef HTTP_REQUEST_PARSER_H
+#define HTTP_REQUEST_PARSER_H
+
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+namespace http {
+
+    struct HeaderView {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    // Single-pass parser for the request line and header block. It never copies: method,
+    // URI and headers are recorded as offsets into the caller's buffer and handed out as
+    // string_views. parse() is resumable; call it again with the grown buffer after more
+    // bytes arrive and it carries on from the first unfinished line. Views returned by the
+    // accessors stay valid until the buffer passed to the last parse() call is modified.
+    class RequestParser {
+    public:
+        enum class Status {
+            INCOMPLETE,
+            COMPLETE,
+            ERROR
+        };
+
+        static constexpr size_t max_headers = 100;
+
+        Status parse(std::string_view buffer) {
+            base = buffer;
+            while (phase == Phase::REQUEST_LINE || phase == Phase::HEADER_LINE) {
+                const void* found = std::memchr(buffer.data() + cursor, '\n', buffer.size() - cursor);
+                if (found == nullptr) {
+                    return Status::INCOMPLETE;
+                }
+                size_t line_end = static_cast<const char*>(found) - buffer.data();
+                size_t next = line_end + 1;
+                if (line_end > cursor && buffer[line_end - 1] == '\r') line_end--;
+
+                bool ok = phase == Phase::REQUEST_LINE
+                        ? parse_request_line(buffer, cursor, line_end)
+                        : parse_header_line(buffer, cursor, line_end);
+                if (!ok) {
+                    phase = Phase::FAILED;
+                    return Status::ERROR;
+                }
+                cursor = next;
+            }
+            return phase == Phase::DONE ? Status::COMPLETE : Status::ERROR;
+        }
+
+        std::string_view method() const { return slice(method_span); }
+        std::string_view uri() const { return slice(uri_span); }
+        int version_major() const { return major; }
+        int version_minor() const { return minor; }
+
+        size_t header_count() const { return header_spans.size(); }
+        HeaderView header_at(size_t i) const {
+            return {slice(header_spans[i].name), slice(header_spans[i].value)};
+        }
+
+        // Case-insensitive lookup of the first header named `name`; empty if absent.
+        std::string_view header(std::string_view name) const {
+            for (const auto& span : header_spans) {
+                if (equals_ignore_case(slice(span.name), name)) {
+                    return slice(span.value);
+                }
+            }
+            return {};
+        }
+
+        // Length of the request line plus header block, including the terminating blank line.
+        size_t header_length() const { return cursor; }
+
+        void reset() {
+            phase = Phase::REQUEST_LINE;
+            cursor = 0;
+            major = 0;
+            minor = 0;
+            header_spans.clear();
+        }
+
+        static bool equals_ignore_case(std::string_view a, std::string_view b) {
+            if (a.size() != b.size()) return false;
+            for (size_t i = 0; i < a.size(); i++) {
+                if (to_lower(a[i]) != to_lower(b[i])) return false;
+            }
+            return true;
+        }
+
+    private:
+        enum class Phase {
+            REQUEST_LINE,
+            HEADER_LINE,
+            DONE,
+            FAILED
+        };
+
+        struct Span {
+            size_t offset = 0;
+            size_t length = 0;
+        };
+
+        struct HeaderSpan {
+            Span name;
+            Span value;
+        };
+
+        Phase phase = Phase::REQUEST_LINE;
+        size_t cursor = 0;
+        std::string_view base;
+        Span method_span;
+        Span uri_span;
+        int major = 0;
+        int minor = 0;
+        std::vector<HeaderSpan> header_spans;
+
+        std::string_view slice(Span span) const { return base.substr(span.offset, span.length); }
+
+        static char to_lower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + 32) : c; }
+        static bool is_space(char c) { return c == ' ' || c == '\t'; }
+        static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+        // METHOD SP request-target SP HTTP/d.d
+        bool parse_request_line(std::string_view buffer, size_t start, size_t end) {
+            // Tolerate stray empty lines before the request line (RFC 9112 section 2.2).
+            if (start == end) return true;
+
+            size_t first_space = buffer.find(' ', start);
+            if (first_space == std::string_view::npos || first_space >= end || first_space == start) return false;
+            size_t second_space = buffer.find(' ', first_space + 1);
+            if (second_space == std::string_view::npos || second_space >= end || second_space == first_space + 1) return false;
+
+            std::string_view version = buffer.substr(second_space + 1, end - second_space - 1);
+            if (version.size() != 8 || version.substr(0, 5) != "HTTP/" || !is_digit(version[5]) ||
+                version[6] != '.' || !is_digit(version[7])) {
+                return false;
+            }
+
+            method_span = {start, first_space - start};
+            uri_span = {first_space + 1, second_space - first_space - 1};
+            major = version[5] - '0';
+            minor = version[7] - '0';
+            phase = Phase::HEADER_LINE;
+            return true;
+        }
+
+        // field-name ":" OWS field-value OWS; an empty line ends the header block.
+        bool parse_header_line(std::string_view buffer, size_t start, size_t end) {
+            if (start == end) {
+                phase = Phase::DONE;
+                return true;
+            }
+            if (header_spans.size() >= max_headers) return false;
+
+            size_t colon = buffer.find(':', start);
+            if (colon == std::string_view::npos || colon >= end || colon == start) return false;
+            if (is_space(buffer[colon - 1])) return false;
+
+            size_t value_start = colon + 1;
+            size_t value_end = end;
+            while (value_start < value_end && is_space(buffer[value_start])) value_start++;
+            while (value_end > value_start && is_space(buffer[value_end - 1])) value_end--;
+
+            header_spans.push_back({{start, colon - start}, {value_start, value_end - value_start}});
+            return true;
+        }
+    };
+}
+
+#endif //HTTP_REQUEST_PARSER_H
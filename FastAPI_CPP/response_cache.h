@@ -0,0 +1,275 @@
+// Tomas Costantino
+
+#ifndef SERVERC___RESPONSE_CACHE_H
+#define SERVERC___RESPONSE_CACHE_H
+
+#include "http_lib.h"
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace fastapi_cpp {
+
+    // Finds `directive` in a Cache-Control value. Returns its argument ("" when it has none),
+    // or nullopt when absent.
+    inline std::optional<std::string_view> cache_control_directive(std::string_view value, std::string_view directive) {
+        while (!value.empty()) {
+            size_t comma = value.find(',');
+            std::string_view item = value.substr(0, comma);
+            value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+            while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+            while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+            size_t equals = item.find('=');
+            if (!http::iequals(item.substr(0, equals), directive)) continue;
+            if (equals == std::string_view::npos) return std::string_view();
+            std::string_view argument = item.substr(equals + 1);
+            if (argument.size() >= 2 && argument.front() == '"' && argument.back() == '"') {
+                argument = argument.substr(1, argument.size() - 2);
+            }
+            return argument;
+        }
+        return std::nullopt;
+    }
+
+    // A cached 200 response, serialized once together with the 304 sent to clients whose
+    // If-None-Match carries its ETag.
+    class CachedResponse {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        CachedResponse(const http::Response& response, std::string entity_tag, Clock::time_point expiry)
+                : etag(std::move(entity_tag)), expires(expiry),
+                  full(with_etag(response, etag)), not_modified(not_modified_for(response, etag)) {}
+
+        const std::string etag;
+        const Clock::time_point expires;
+
+        // Weak comparison (RFC 9110 13.1.2), which is what If-None-Match uses.
+        bool matches(std::string_view if_none_match) const {
+            std::string_view own = strip_weak(etag);
+            while (!if_none_match.empty()) {
+                size_t comma = if_none_match.find(',');
+                std::string_view tag = if_none_match.substr(0, comma);
+                if_none_match = comma == std::string_view::npos ? std::string_view() : if_none_match.substr(comma + 1);
+                while (!tag.empty() && tag.front() == ' ') tag.remove_prefix(1);
+                while (!tag.empty() && tag.back() == ' ') tag.remove_suffix(1);
+                if (tag == "*" || strip_weak(tag) == own) return true;
+            }
+            return false;
+        }
+
+        // The response to send; `self` keeps this entry alive until the bytes are written,
+        // even if the cache evicts it in the meantime.
+        static http::Response respond(const std::shared_ptr<const CachedResponse>& self, std::string_view if_none_match) {
+            const http::PreparedResponse& prepared =
+                    !if_none_match.empty() && self->matches(if_none_match) ? self->not_modified : self->full;
+            http::Response response = prepared;
+            response.retained = self;
+            return response;
+        }
+
+        // Grows as compressed variants of the body are built.
+        size_t footprint() const {
+            return sizeof(*this) + full.head(true).size() + full.head(false).size() + full.content().size() +
+                   full.variant_bytes() + not_modified.head(true).size() + not_modified.head(false).size();
+        }
+
+        // Strong validator derived from the body: 64-bit FNV-1a, quoted.
+        static std::string etag_for(std::string_view body) {
+            uint64_t hash = 14695981039346656037ull;
+            for (unsigned char c : body) {
+                hash ^= c;
+                hash *= 1099511628211ull;
+            }
+            static constexpr char digits[] = "0123456789abcdef";
+            std::string tag(18, '"');
+            for (int i = 16; i >= 1; i--) {
+                tag[i] = digits[hash & 15];
+                hash >>= 4;
+            }
+            return tag;
+        }
+
+    private:
+        http::PreparedResponse full;
+        http::PreparedResponse not_modified;
+
+        static std::string_view strip_weak(std::string_view tag) {
+            return tag.starts_with("W/") ? tag.substr(2) : tag;
+        }
+
+        static http::Response with_etag(http::Response response, const std::string& etag) {
+            response.headers.set("ETag", etag);
+            return response;
+        }
+
+        static http::Response not_modified_for(const http::Response& response, const std::string& etag) {
+            http::Response head{response.version, http::HttpStatus::NOT_MODIFIED, {{"ETag", etag}}, {}, {}};
+            if (const std::string* cache_control = response.headers.find("Cache-Control")) {
+                head.headers.set("Cache-Control", *cache_control);
+            }
+            return head;
+        }
+    };
+
+    // Serialized responses of GET routes registered with a cache TTL, keyed on path plus
+    // query. Split into shards, each behind its own mutex with an equal share of the byte
+    // budget, so workers rarely contend. Shards evict with CLOCK: a hit only sets a
+    // referenced bit, and the hand clears bits until it finds an entry to drop, which
+    // approximates LRU without reordering anything on the read path.
+    class ResponseCache {
+    public:
+        using Clock = CachedResponse::Clock;
+        static constexpr size_t shard_count = 16;
+
+        explicit ResponseCache(size_t max_bytes) { set_capacity(max_bytes); }
+
+        ResponseCache(const ResponseCache&) = delete;
+        ResponseCache& operator=(const ResponseCache&) = delete;
+
+        // Shrinking takes effect as shards next store.
+        void set_capacity(size_t max_bytes) {
+            shard_budget.store(max_bytes / shard_count, std::memory_order_relaxed);
+        }
+
+        bool empty() const { return entries.load(std::memory_order_relaxed) == 0; }
+
+        std::shared_ptr<const CachedResponse> find(std::string_view key, Clock::time_point now) {
+            size_t hash = std::hash<std::string_view>{}(key);
+            Shard& shard = shards[hash % shard_count];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it == shard.index.end()) return nullptr;
+            Slot& slot = shard.slots[it->second];
+            if (slot.entry->expires <= now) {
+                drop(shard, it->second);
+                return nullptr;
+            }
+            slot.referenced = true;
+            std::shared_ptr<const CachedResponse> entry = slot.entry;
+            // Variants built since the last hit are charged now, which may evict this entry too.
+            size_t bytes = entry->footprint() + slot.key.size();
+            if (bytes > slot.bytes) {
+                shard.bytes += bytes - slot.bytes;
+                slot.bytes = bytes;
+                size_t budget = shard_budget.load(std::memory_order_relaxed);
+                while (shard.bytes > budget) evict_one(shard);
+            }
+            return entry;
+        }
+
+        // Caches `response` under `key` and returns the entry, or nullptr when it is larger
+        // than a shard's whole budget.
+        std::shared_ptr<const CachedResponse> store(std::string_view key, const http::Response& response,
+                                                    std::chrono::milliseconds ttl, Clock::time_point now) {
+            const std::string* own_etag = response.headers.find("ETag");
+            auto entry = std::make_shared<const CachedResponse>(
+                    response, own_etag ? *own_etag : CachedResponse::etag_for(response.body), now + ttl);
+            size_t bytes = entry->footprint() + key.size();
+            size_t budget = shard_budget.load(std::memory_order_relaxed);
+            if (bytes > budget) return nullptr;
+
+            size_t hash = std::hash<std::string_view>{}(key);
+            Shard& shard = shards[hash % shard_count];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto existing = shard.index.find(key);
+            if (existing != shard.index.end()) drop(shard, existing->second);
+            while (shard.bytes + bytes > budget) evict_one(shard);
+
+            size_t position;
+            if (!shard.free_slots.empty()) {
+                position = shard.free_slots.back();
+                shard.free_slots.pop_back();
+            } else {
+                position = shard.slots.size();
+                shard.slots.emplace_back();
+            }
+            Slot& slot = shard.slots[position];
+            slot.key.assign(key);
+            slot.entry = entry;
+            slot.bytes = bytes;
+            slot.referenced = false;
+            shard.index.emplace(slot.key, position);
+            shard.bytes += bytes;
+            entries.fetch_add(1, std::memory_order_relaxed);
+            return entry;
+        }
+
+        void clear() {
+            for (Shard& shard : shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                entries.fetch_sub(shard.index.size(), std::memory_order_relaxed);
+                shard.index.clear();
+                shard.slots.clear();
+                shard.free_slots.clear();
+                shard.bytes = 0;
+                shard.hand = 0;
+            }
+        }
+
+    private:
+        struct Slot {
+            std::string key;
+            std::shared_ptr<const CachedResponse> entry;   // null for a free slot
+            size_t bytes = 0;
+            bool referenced = false;
+        };
+
+        struct KeyHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            // Keys view Slot::key. A deque never relocates its elements and freed slots are
+            // reused in place, so the views stay valid.
+            std::unordered_map<std::string_view, size_t, KeyHash, std::equal_to<>> index;
+            std::deque<Slot> slots;
+            std::vector<size_t> free_slots;
+            size_t bytes = 0;
+            size_t hand = 0;
+        };
+
+        std::array<Shard, shard_count> shards;
+        std::atomic<size_t> shard_budget{0};
+        std::atomic<size_t> entries{0};
+
+        void drop(Shard& shard, size_t position) {
+            Slot& slot = shard.slots[position];
+            shard.index.erase(slot.key);
+            shard.bytes -= slot.bytes;
+            slot.entry.reset();
+            slot.referenced = false;
+            shard.free_slots.push_back(position);
+            entries.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void evict_one(Shard& shard) {
+            while (true) {
+                if (shard.hand >= shard.slots.size()) shard.hand = 0;
+                Slot& slot = shard.slots[shard.hand++];
+                if (!slot.entry) continue;
+                if (slot.referenced) {
+                    slot.referenced = false;
+                    continue;
+                }
+                drop(shard, shard.hand - 1);
+                return;
+            }
+        }
+    };
+}
+
+#endif //SERVERC___RESPONSE_CACHE_H
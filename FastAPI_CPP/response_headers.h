@@ -0,0 +1,84 @@
+// Tomas Costantino
+
+#ifndef HTTP_RESPONSE_HEADERS_H
+#define HTTP_RESPONSE_HEADERS_H
+
+#include "request_parser.h"
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace http {
+
+    // Response headers as a flat vector, in insertion order, with case-insensitive lookup.
+    // Responses carry a handful of headers, so a linear scan beats a tree of nodes and the
+    // vector serializes without any pointer chasing.
+    class ResponseHeaders {
+    public:
+        struct Header {
+            std::string name;
+            std::string value;
+        };
+
+        ResponseHeaders() = default;
+
+        ResponseHeaders(std::initializer_list<std::pair<std::string, std::string>> init) {
+            entries.reserve(init.size());
+            for (const auto& [name, value] : init) set(name, value);
+        }
+
+        // Replaces an existing header of the same name, otherwise appends.
+        void set(std::string_view name, std::string_view value) {
+            if (Header* header = find_entry(name)) {
+                header->value.assign(value);
+            } else {
+                entries.push_back({std::string(name), std::string(value)});
+            }
+        }
+
+        // Appends without replacing, for headers that may repeat such as Set-Cookie.
+        void add(std::string_view name, std::string_view value) {
+            entries.push_back({std::string(name), std::string(value)});
+        }
+
+        std::string& operator[](std::string_view name) {
+            if (Header* header = find_entry(name)) return header->value;
+            entries.push_back({std::string(name), {}});
+            return entries.back().value;
+        }
+
+        const std::string* find(std::string_view name) const {
+            for (const auto& header : entries) {
+                if (RequestParser::equals_ignore_case(header.name, name)) return &header.value;
+            }
+            return nullptr;
+        }
+
+        bool contains(std::string_view name) const { return find(name) != nullptr; }
+
+        void erase(std::string_view name) {
+            std::erase_if(entries, [&](const Header& header) {
+                return RequestParser::equals_ignore_case(header.name, name);
+            });
+        }
+
+        size_t size() const { return entries.size(); }
+        bool empty() const { return entries.empty(); }
+        auto begin() const { return entries.begin(); }
+        auto end() const { return entries.end(); }
+
+    private:
+        std::vector<Header> entries;
+
+        Header* find_entry(std::string_view name) {
+            for (auto& header : entries) {
+                if (RequestParser::equals_ignore_case(header.name, name)) return &header;
+            }
+            return nullptr;
+        }
+    };
+}
+
+#endif //HTTP_RESPONSE_HEADERS_H
@@ -0,0 +1,125 @@
+// Tomas Costantino
+
+#ifndef SERVERC___ROUTE_PATTERN_H
+#define SERVERC___ROUTE_PATTERN_H
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <string_view>
+#include <system_error>
+
+namespace fastapi_cpp {
+
+    // String literal usable as a template argument: app.get<"/users/{id:int}">(...).
+    template<size_t N>
+    struct FixedString {
+        char value[N]{};
+
+        constexpr FixedString(const char (&s)[N]) {
+            for (size_t i = 0; i < N; i++) value[i] = s[i];
+        }
+
+        constexpr std::string_view view() const { return {value, N - 1}; }
+    };
+
+    enum class ParamType {
+        STRING,
+        INT,
+        INT64,
+        DOUBLE
+    };
+
+    struct PatternParam {
+        std::string_view name;
+        ParamType type;
+    };
+
+    namespace pattern_detail {
+        // Reached only for an invalid pattern; being non-constexpr it turns the mistake into a
+        // compile error at the app.get<...>() call site.
+        inline void invalid_route_pattern(const char*) {}
+
+        constexpr ParamType parse_type(std::string_view type) {
+            if (type.empty() || type == "str") return ParamType::STRING;
+            if (type == "int") return ParamType::INT;
+            if (type == "int64") return ParamType::INT64;
+            if (type == "double") return ParamType::DOUBLE;
+            invalid_route_pattern("unknown parameter type; expected str, int, int64 or double");
+            return ParamType::STRING;
+        }
+
+        // Visits every "{name[:type]}" segment, rejecting braces that don't span a whole segment.
+        template<typename Visitor>
+        constexpr void for_each_param(std::string_view pattern, Visitor&& visit) {
+            size_t start = (!pattern.empty() && pattern[0] == '/') ? 1 : 0;
+            while (start <= pattern.size()) {
+                size_t end = pattern.find('/', start);
+                if (end == std::string_view::npos) end = pattern.size();
+                std::string_view segment = pattern.substr(start, end - start);
+
+                if (!segment.empty() && segment.front() == '{') {
+                    if (segment.size() < 3 || segment.back() != '}') {
+                        invalid_route_pattern("route parameter must be a whole segment like {name} or {name:type}");
+                    }
+                    std::string_view inner = segment.substr(1, segment.size() - 2);
+                    size_t colon = inner.find(':');
+                    std::string_view name = inner.substr(0, colon);
+                    std::string_view type = colon == std::string_view::npos ? std::string_view{} : inner.substr(colon + 1);
+                    if (name.empty()) {
+                        invalid_route_pattern("route parameter needs a name");
+                    }
+                    visit(PatternParam{name, parse_type(type)});
+                } else if (segment.find_first_of("{}") != std::string_view::npos) {
+                    invalid_route_pattern("route parameter must be a whole segment like {name} or {name:type}");
+                }
+                start = end + 1;
+            }
+        }
+
+        constexpr size_t count_params(std::string_view pattern) {
+            size_t count = 0;
+            for_each_param(pattern, [&](PatternParam) { count++; });
+            return count;
+        }
+
+        template<size_t Count>
+        constexpr std::array<PatternParam, Count> collect_params(std::string_view pattern) {
+            std::array<PatternParam, Count> params{};
+            size_t i = 0;
+            for_each_param(pattern, [&](PatternParam param) { params[i++] = param; });
+            return params;
+        }
+
+        template<ParamType Type> struct param_type { using type = std::string_view; };
+        template<> struct param_type<ParamType::INT> { using type = int; };
+        template<> struct param_type<ParamType::INT64> { using type = long long; };
+        template<> struct param_type<ParamType::DOUBLE> { using type = double; };
+    }
+
+    // A route pattern parsed entirely at compile time.
+    template<FixedString Pattern>
+    struct RoutePattern {
+        static constexpr std::string_view text = Pattern.view();
+        static constexpr size_t param_count = pattern_detail::count_params(text);
+        static constexpr std::array<PatternParam, param_count> params =
+                pattern_detail::collect_params<param_count>(text);
+
+        template<size_t I>
+        using arg_type = typename pattern_detail::param_type<params[I].type>::type;
+    };
+
+    // Converts a captured path segment to its declared type. Returns false if it doesn't parse.
+    inline bool convert_param(std::string_view text, std::string_view& out) {
+        out = text;
+        return true;
+    }
+
+    template<typename Number>
+    bool convert_param(std::string_view text, Number& out) {
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && end == text.data() + text.size();
+    }
+}
+
+#endif //SERVERC___ROUTE_PATTERN_H
@@ -0,0 +1,296 @@
+// Tomas Costantino
+
+#ifndef SERVERC___ROUTER_H
+#define SERVERC___ROUTER_H
+
+#include "http_lib.h"
+#include "task.h"
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+
+namespace fastapi_cpp {
+
+    // Values captured for a route's {param} segments, in pattern order. The views point into
+    // the request URI, so they live as long as the Request they were matched against.
+    class PathParams {
+    public:
+        static constexpr size_t max_params = 16;
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        std::string_view operator[](size_t i) const { return values[i]; }
+
+        void push(std::string_view value) { values[count++] = value; }
+        void pop() { count--; }
+        void clear() { count = 0; }
+
+    private:
+        std::array<std::string_view, max_params> values{};
+        size_t count = 0;
+    };
+
+    // What a handler sees as its parameters: the matched {name} path segments followed by the
+    // request's query pairs, as views into the route and the request. Nothing is copied, so
+    // it is only valid during the handler call. A path parameter shadows a query parameter of
+    // the same name; among repeated query keys the last wins.
+    class Params {
+    public:
+        using value_type = std::pair<std::string_view, std::string_view>;
+
+        Params(const std::vector<std::string>& path_names, const PathParams& path_values, const http::QueryParams& query_params)
+                : names(path_names.data()), path(&path_values), query(&query_params.get_all()) {}
+
+        std::optional<std::string_view> find(std::string_view name) const {
+            for (size_t i = 0; i < path->size(); i++) {
+                if (names[i] == name) return (*path)[i];
+            }
+            for (auto it = query->rbegin(); it != query->rend(); ++it) {
+                if (it->first == name) return std::string_view(it->second);
+            }
+            return std::nullopt;
+        }
+
+        bool contains(std::string_view name) const { return find(name).has_value(); }
+
+        std::string_view at(std::string_view name) const {
+            if (auto value = find(name)) return *value;
+            throw std::out_of_range("No parameter named " + std::string(name));
+        }
+
+        std::string_view get(std::string_view name, std::string_view fallback = {}) const {
+            return find(name).value_or(fallback);
+        }
+
+        size_t size() const { return path->size() + query->size(); }
+        bool empty() const { return size() == 0; }
+
+        value_type operator[](size_t i) const {
+            if (i < path->size()) return {names[i], (*path)[i]};
+            const auto& entry = (*query)[i - path->size()];
+            return {entry.first, entry.second};
+        }
+
+        class iterator {
+        public:
+            iterator(const Params* params, size_t index) : owner(params), i(index) {}
+            value_type operator*() const { return (*owner)[i]; }
+            iterator& operator++() { i++; return *this; }
+            bool operator==(const iterator& other) const { return i == other.i; }
+
+        private:
+            const Params* owner;
+            size_t i;
+        };
+
+        iterator begin() const { return {this, 0}; }
+        iterator end() const { return {this, size()}; }
+
+        // For handlers still written against the old map signature; costs a copy per call.
+        operator std::map<std::string, std::string>() const {
+            std::map<std::string, std::string> copy;
+            for (const auto& [name, value] : *query) copy.insert_or_assign(std::string(name), std::string(value));
+            for (size_t i = 0; i < path->size(); i++) copy.insert_or_assign(names[i], std::string((*path)[i]));
+            return copy;
+        }
+
+    private:
+        const std::string* names;
+        const PathParams* path;
+        const std::pmr::vector<http::QueryParams::Entry>* query;
+    };
+
+    // Where a route's handler runs. INLINE handlers run on the I/O thread and must not
+    // block; BLOCKING handlers are queued to a bounded thread pool (see ServerConfig). ASYNC
+    // is chosen automatically for handlers returning Task<Response>: they run on the I/O
+    // thread as coroutines and may co_await timers and sockets on its event loop.
+    enum class Execution {
+        INLINE,
+        BLOCKING,
+        ASYNC
+    };
+
+    // Result of routing on the I/O thread: the response for an INLINE route, or just the
+    // execution mode for a route that must run elsewhere.
+    struct Dispatch {
+        Execution execution = Execution::INLINE;
+        http::Response response;
+    };
+
+    // What the router resolves to: a plain function pointer plus the route object it was
+    // instantiated for, so dispatch is one indirect call into code specialised per route.
+    struct Endpoint {
+        using Invoke = http::Response (*)(const void* route, const http::Request& request, const PathParams& params);
+        using AsyncInvoke = Task<http::Response> (*)(const void* route, const http::Request& request, const PathParams& params);
+        using OpenReader = http::BodyReader (*)(const void* route, const http::Request& request, const PathParams& params);
+        using Accepts = bool (*)(const PathParams& params);
+
+        Invoke invoke = nullptr;
+        AsyncInvoke async_invoke = nullptr;
+        OpenReader open_reader = nullptr;   // set for routes that take their body as a stream
+        Accepts accepts = nullptr;          // set for typed routes: whether the values convert
+        const void* route = nullptr;
+        std::string pattern;
+        Execution execution = Execution::INLINE;
+        uint32_t metrics_id = 0;
+        std::chrono::milliseconds cache_ttl{0};   // 0: responses are not cached
+
+        http::Response operator()(const http::Request& request, const PathParams& params) const {
+            return invoke(route, request, params);
+        }
+
+        // Some parameter values make the route not match.
+        bool constrained() const { return accepts != nullptr; }
+        bool matches(const PathParams& params) const { return !accepts || accepts(params); }
+    };
+
+    // Splits "/a/b/c" into "a", "b", "c". "/" has no segments; a trailing slash yields an
+    // empty final segment, so "/echo" and "/echo/" stay distinct routes.
+    template<typename Visitor>
+    void for_each_segment(std::string_view path, Visitor&& visit) {
+        if (!path.empty() && path.front() == '/') path.remove_prefix(1);
+        if (path.empty()) return;
+        while (true) {
+            size_t slash = path.find('/');
+            visit(path.substr(0, slash));
+            if (slash == std::string_view::npos) return;
+            path.remove_prefix(slash + 1);
+        }
+    }
+
+    // Radix tree over path segments with one tree per Method. Static segments are looked up by
+    // hash, a {param} child matches any non-empty segment, and static matches win over params.
+    // Lookup walks the path once and records parameter values as it descends.
+    //
+    // Patterns that differ only in parameter types, such as /users/{id:int} and
+    // /users/{name}, end at the same node. A target there is chosen only when its matches()
+    // accepts the values: constrained targets are tried in registration order, then the one
+    // that takes any value. When none accepts, lookup goes on with the next branch, just as
+    // for a path that ends without a target.
+    template<typename Target>
+    class Router {
+    public:
+        void insert(http::Method method, std::string_view pattern, const Target* target) {
+            Node* node = &roots[static_cast<size_t>(method)];
+            size_t param_count = 0;
+
+            for_each_segment(pattern, [&](std::string_view segment) {
+                if (segment.size() >= 2 && segment.front() == '{' && segment.back() == '}') {
+                    param_count++;
+                    if (!node->param_child) {
+                        node->param_child = std::make_unique<Node>();
+                    }
+                    node = node->param_child.get();
+                } else {
+                    if (segment.find_first_of("{}") != std::string_view::npos) {
+                        throw std::runtime_error("Route parameters must span a whole path segment: " + std::string(pattern));
+                    }
+                    auto it = node->static_children.find(segment);
+                    if (it == node->static_children.end()) {
+                        it = node->static_children.emplace(std::string(segment), std::make_unique<Node>()).first;
+                    }
+                    node = it->second.get();
+                }
+            });
+
+            if (param_count > PathParams::max_params) {
+                throw std::runtime_error("Too many route parameters: " + std::string(pattern));
+            }
+            // Constrained targets are told apart by their parameter types; the rest accept any
+            // value, so only one of them can end at a node.
+            std::string types;
+            if (target->constrained()) {
+                for_each_segment(pattern, [&](std::string_view segment) {
+                    if (segment.size() < 2 || segment.front() != '{' || segment.back() != '}') return;
+                    size_t colon = segment.find(':');
+                    std::string_view type = colon == std::string_view::npos ? std::string_view() : segment.substr(colon + 1, segment.size() - colon - 2);
+                    types += type == "str" ? std::string_view() : type;
+                    types += '/';
+                });
+            }
+            for (const Candidate& candidate : node->targets) {
+                if (candidate.target->constrained() == target->constrained() && candidate.types == types) {
+                    throw std::runtime_error("Duplicate route: " + http::method_to_string(method) + " " + std::string(pattern));
+                }
+            }
+            auto position = node->targets.end();
+            if (target->constrained() && !node->targets.empty() && !node->targets.back().target->constrained()) position--;
+            node->targets.insert(position, Candidate{std::move(types), target});
+        }
+
+        // Resolves `path` (without query string). Fills `params` on success.
+        const Target* find(http::Method method, std::string_view path, PathParams& params) const {
+            params.clear();
+            std::array<std::string_view, max_depth> segments;
+            size_t depth = 0;
+            bool too_deep = false;
+            for_each_segment(path, [&](std::string_view segment) {
+                if (depth == max_depth) {
+                    too_deep = true;
+                    return;
+                }
+                segments[depth++] = segment;
+            });
+            if (too_deep) return nullptr;
+
+            return match(&roots[static_cast<size_t>(method)], segments.data(), depth, params);
+        }
+
+    private:
+        static constexpr size_t method_count = static_cast<size_t>(http::Method::UNKNOWN) + 1;
+        static constexpr size_t max_depth = 64;
+
+        struct SegmentHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+        };
+
+        struct Candidate {
+            std::string types;   // the parameter types of a constrained target's pattern
+            const Target* target;
+        };
+
+        struct Node {
+            std::unordered_map<std::string, std::unique_ptr<Node>, SegmentHash, std::equal_to<>> static_children;
+            std::unique_ptr<Node> param_child;
+            std::vector<Candidate> targets;   // constrained ones first
+        };
+
+        std::array<Node, method_count> roots;
+
+        static const Target* match(const Node* node, const std::string_view* segments, size_t remaining, PathParams& params) {
+            if (remaining == 0) {
+                for (const Candidate& candidate : node->targets) {
+                    if (candidate.target->matches(params)) return candidate.target;
+                }
+                return nullptr;
+            }
+
+            auto it = node->static_children.find(segments[0]);
+            if (it != node->static_children.end()) {
+                if (const Target* found = match(it->second.get(), segments + 1, remaining - 1, params)) {
+                    return found;
+                }
+            }
+
+            if (node->param_child && !segments[0].empty()) {
+                params.push(segments[0]);
+                if (const Target* found = match(node->param_child.get(), segments + 1, remaining - 1, params)) {
+                    return found;
+                }
+                params.pop();
+            }
+            return nullptr;
+        }
+    };
+}
+
+#endif //SERVERC___ROUTER_H
@@ -0,0 +1,283 @@
+// Tomas Costantino
+
+#ifndef SERVERC___STATIC_FILES_H
+#define SERVERC___STATIC_FILES_H
+
+#include "http_lib.h"
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fastapi_cpp {
+
+    // A file kept open for serving, with what the response headers need precomputed.
+    // Closed once the cache has dropped it and no queued response still sends from it.
+    struct OpenFile {
+        int fd = -1;
+        uint64_t size = 0;
+        ino_t inode = 0;
+        int64_t mtime_ns = 0;
+        std::string etag;
+        std::string last_modified;
+        std::string_view content_type;
+        std::chrono::steady_clock::time_point checked;
+
+        OpenFile() = default;
+        OpenFile(const OpenFile&) = delete;
+        OpenFile& operator=(const OpenFile&) = delete;
+
+        ~OpenFile() {
+            if (fd >= 0) close(fd);
+        }
+    };
+
+    inline std::string_view mime_type(std::string_view path) {
+        static constexpr std::pair<std::string_view, std::string_view> types[] = {
+                {".html", "text/html; charset=utf-8"}, {".htm", "text/html; charset=utf-8"},
+                {".css", "text/css; charset=utf-8"}, {".js", "application/javascript"},
+                {".mjs", "application/javascript"}, {".json", "application/json"},
+                {".txt", "text/plain; charset=utf-8"}, {".xml", "application/xml"},
+                {".svg", "image/svg+xml"}, {".png", "image/png"}, {".jpg", "image/jpeg"},
+                {".jpeg", "image/jpeg"}, {".gif", "image/gif"}, {".webp", "image/webp"},
+                {".avif", "image/avif"}, {".ico", "image/x-icon"}, {".wasm", "application/wasm"},
+                {".woff", "font/woff"}, {".woff2", "font/woff2"}, {".pdf", "application/pdf"},
+                {".mp4", "video/mp4"}, {".webm", "video/webm"}, {".mp3", "audio/mpeg"},
+                {".gz", "application/gzip"}, {".zip", "application/zip"}};
+        size_t dot = path.rfind('.');
+        if (dot == std::string_view::npos || path.find('/', dot) != std::string_view::npos) return "application/octet-stream";
+        std::string_view extension = path.substr(dot);
+        for (const auto& [suffix, type] : types) {
+            if (http::iequals(extension, suffix)) return type;
+        }
+        return "application/octet-stream";
+    }
+
+    // Serves the files under `root` for GET requests below `url_prefix`. Open descriptors and
+    // their stat results are cached, and re-stat'ed at most once per revalidate interval, so
+    // a hot asset costs no open() or stat() per request. Bodies are not read at all: the
+    // response carries the descriptor and the worker sends it with sendfile. Supports a
+    // single byte Range (with If-Range), If-None-Match and If-Modified-Since.
+    class StaticFiles {
+    public:
+        static constexpr auto revalidate_interval = std::chrono::seconds(1);
+
+        StaticFiles(std::string url_prefix, std::string root_directory, size_t max_open_files = 1024)
+                : prefix(std::move(url_prefix)), root(std::move(root_directory)), max_open(max_open_files) {
+            while (prefix.size() > 1 && prefix.back() == '/') prefix.pop_back();
+            while (root.size() > 1 && root.back() == '/') root.pop_back();
+        }
+
+        StaticFiles(const StaticFiles&) = delete;
+        StaticFiles& operator=(const StaticFiles&) = delete;
+
+        // The response for `req`, or nullopt when it is outside this mount or names no
+        // regular file, so that the caller can answer 404.
+        std::optional<http::Response> serve(const http::Request& req) {
+            if (req.method != http::Method::GET) return std::nullopt;
+            std::string_view target = req.uri;
+            target = target.substr(0, target.find('?'));
+            if (!target.starts_with(prefix)) return std::nullopt;
+            std::string_view rest = target.substr(prefix.size());
+            if (prefix != "/" && !rest.empty() && rest.front() != '/') return std::nullopt;
+
+            std::optional<std::string> relative = sanitize(rest);
+            if (!relative) return std::nullopt;
+            if (relative->empty() || relative->back() == '/') *relative += "index.html";
+
+            std::shared_ptr<const OpenFile> file = open_file(root + "/" + *relative);
+            if (!file) return std::nullopt;
+            return respond(req, file);
+        }
+
+    private:
+        std::string prefix;
+        std::string root;
+        size_t max_open;
+        std::mutex files_mutex;
+        std::unordered_map<std::string, std::shared_ptr<OpenFile>> files;
+
+        static int64_t mtime_ns_of(const struct stat& info) {
+#if defined(__APPLE__)
+            const timespec& mtime = info.st_mtimespec;
+#else
+            const timespec& mtime = info.st_mtim;
+#endif
+            return static_cast<int64_t>(mtime.tv_sec) * 1'000'000'000 + mtime.tv_nsec;
+        }
+
+        // Percent-decodes the path and rejects anything that could leave the root.
+        static std::optional<std::string> sanitize(std::string_view path) {
+            std::string decoded;
+            decoded.reserve(path.size());
+            for (size_t i = 0; i < path.size(); i++) {
+                char c = path[i];
+                if (c == '%') {
+                    if (i + 2 >= path.size()) return std::nullopt;
+                    int value = 0;
+                    auto [end, ec] = std::from_chars(path.data() + i + 1, path.data() + i + 3, value, 16);
+                    if (ec != std::errc() || end != path.data() + i + 3) return std::nullopt;
+                    c = static_cast<char>(value);
+                    i += 2;
+                }
+                if (c == '\0' || c == '\\') return std::nullopt;
+                decoded += c;
+            }
+            while (!decoded.empty() && decoded.front() == '/') decoded.erase(0, 1);
+            size_t start = 0;
+            while (start <= decoded.size()) {
+                size_t end = decoded.find('/', start);
+                if (end == std::string::npos) end = decoded.size();
+                std::string_view segment = std::string_view(decoded).substr(start, end - start);
+                if (segment == "." || segment == "..") return std::nullopt;
+                start = end + 1;
+            }
+            return decoded;
+        }
+
+        std::shared_ptr<const OpenFile> open_file(const std::string& path) {
+            auto now = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(files_mutex);
+            auto it = files.find(path);
+            if (it != files.end() && now - it->second->checked < revalidate_interval) return it->second;
+
+            struct stat info{};
+            if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+                if (it != files.end()) files.erase(it);
+                return nullptr;
+            }
+            if (it != files.end() && it->second->inode == info.st_ino && it->second->mtime_ns == mtime_ns_of(info) &&
+                it->second->size == static_cast<uint64_t>(info.st_size)) {
+                it->second->checked = now;
+                return it->second;
+            }
+
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return nullptr;
+            auto file = std::make_shared<OpenFile>();
+            file->fd = fd;
+            if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) return nullptr;
+            file->size = static_cast<uint64_t>(info.st_size);
+            file->inode = info.st_ino;
+            file->mtime_ns = mtime_ns_of(info);
+            file->last_modified = http::format_http_date(file->mtime_ns / 1'000'000'000);
+            char etag[48];
+            int n = std::snprintf(etag, sizeof(etag), "\"%llx-%llx\"", static_cast<unsigned long long>(file->mtime_ns),
+                                  static_cast<unsigned long long>(file->size));
+            file->etag.assign(etag, n);
+            file->content_type = mime_type(path);
+            file->checked = now;
+
+            if (it != files.end()) {
+                it->second = file;
+            } else {
+                if (files.size() >= max_open) files.erase(files.begin());
+                files.emplace(path, file);
+            }
+            return file;
+        }
+
+        static http::Response respond(const http::Request& req, const std::shared_ptr<const OpenFile>& file) {
+            http::Response response{{1, 1}, http::HttpStatus::OK, {}, {}, file->content_type};
+            response.headers.set("ETag", file->etag);
+            response.headers.set("Last-Modified", file->last_modified);
+            response.headers.set("Accept-Ranges", "bytes");
+
+            if (not_modified(req, *file)) {
+                response.status = http::HttpStatus::NOT_MODIFIED;
+                return response;
+            }
+
+            uint64_t offset = 0;
+            uint64_t length = file->size;
+            std::string_view range = http::find_header(req, http::HeaderId::RANGE);
+            std::string_view if_range = http::find_header(req, http::HeaderId::IF_RANGE);
+            if (!range.empty() && (if_range.empty() || if_range == file->etag || if_range == file->last_modified)) {
+                std::optional<std::pair<uint64_t, uint64_t>> span = parse_range(range, file->size);
+                if (!span) {
+                    response.status = http::HttpStatus::RANGE_NOT_SATISFIABLE;
+                    response.headers.set("Content-Range", "bytes */" + std::to_string(file->size));
+                    return response;
+                }
+                if (span->second != 0) {
+                    offset = span->first;
+                    length = span->second;
+                    response.status = http::HttpStatus::PARTIAL_CONTENT;
+                    response.headers.set("Content-Range", "bytes " + std::to_string(offset) + "-" +
+                                                          std::to_string(offset + length - 1) + "/" + std::to_string(file->size));
+                }
+            }
+            response.file = {file->fd, offset, length};
+            response.retained = file;
+            return response;
+        }
+
+        // If-None-Match takes precedence over If-Modified-Since (RFC 9110 13.2.2).
+        static bool not_modified(const http::Request& req, const OpenFile& file) {
+            std::string_view if_none_match = http::find_header(req, http::HeaderId::IF_NONE_MATCH);
+            if (!if_none_match.empty()) {
+                std::string_view own = file.etag;
+                while (!if_none_match.empty()) {
+                    size_t comma = if_none_match.find(',');
+                    std::string_view tag = if_none_match.substr(0, comma);
+                    if_none_match = comma == std::string_view::npos ? std::string_view() : if_none_match.substr(comma + 1);
+                    while (!tag.empty() && tag.front() == ' ') tag.remove_prefix(1);
+                    while (!tag.empty() && tag.back() == ' ') tag.remove_suffix(1);
+                    if (tag.starts_with("W/")) tag.remove_prefix(2);
+                    if (tag == "*" || tag == own) return true;
+                }
+                return false;
+            }
+            std::optional<int64_t> since = http::parse_http_date(http::find_header(req, http::HeaderId::IF_MODIFIED_SINCE));
+            return since && file.mtime_ns / 1'000'000'000 <= *since;
+        }
+
+        // A single "bytes=" range as {offset, length}. {0, 0} means serve the whole file
+        // (a malformed or multi-range header is ignored); nullopt means unsatisfiable.
+        static std::optional<std::pair<uint64_t, uint64_t>> parse_range(std::string_view range, uint64_t size) {
+            std::pair<uint64_t, uint64_t> whole{0, 0};
+            if (!range.starts_with("bytes=")) return whole;
+            range.remove_prefix(6);
+            if (range.find(',') != std::string_view::npos) return whole;
+            size_t dash = range.find('-');
+            if (dash == std::string_view::npos) return whole;
+            std::string_view first_text = range.substr(0, dash);
+            std::string_view last_text = range.substr(dash + 1);
+            auto number = [](std::string_view text, uint64_t& value) {
+                auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+                return !text.empty() && ec == std::errc() && end == text.data() + text.size();
+            };
+
+            uint64_t first = 0;
+            uint64_t last = 0;
+            if (first_text.empty()) {
+                uint64_t suffix = 0;
+                if (!number(last_text, suffix)) return whole;
+                if (suffix == 0 || size == 0) return std::nullopt;
+                suffix = std::min(suffix, size);
+                return std::pair<uint64_t, uint64_t>{size - suffix, suffix};
+            }
+            if (!number(first_text, first)) return whole;
+            if (last_text.empty()) {
+                last = size - 1;
+            } else if (!number(last_text, last) || last < first) {
+                return whole;
+            }
+            if (first >= size) return std::nullopt;
+            last = std::min(last, size - 1);
+            return std::pair<uint64_t, uint64_t>{first, last - first + 1};
+        }
+    };
+}
+
+#endif //SERVERC___STATIC_FILES_H
@@ -0,0 +1,223 @@
+// Tomas Costantino
+
+#ifndef SERVERC___TASK_H
+#define SERVERC___TASK_H
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+#include <variant>
+
+namespace fastapi_cpp {
+
+    // Recycles coroutine frames. Frames are rounded up to 64-byte size classes and kept on
+    // per-thread free lists, so a handler that runs on the same worker again reuses its
+    // previous frame instead of calling malloc. Frames above max_pooled go to operator new.
+    class FramePool {
+    public:
+        static constexpr size_t granularity = 64;
+        static constexpr size_t max_pooled = 4096;
+        static constexpr size_t max_free_per_class = 256;
+
+        static void* allocate(size_t size) {
+            size_t index = class_of(size);
+            if (index >= class_count) return ::operator new(size);
+            Lists& lists = local();
+            if (FreeFrame* frame = lists.head[index]) {
+                lists.head[index] = frame->next;
+                lists.count[index]--;
+                return frame;
+            }
+            return ::operator new((index + 1) * granularity);
+        }
+
+        static void deallocate(void* pointer, size_t size) {
+            size_t index = class_of(size);
+            if (index >= class_count) {
+                ::operator delete(pointer);
+                return;
+            }
+            Lists& lists = local();
+            if (lists.count[index] >= max_free_per_class) {
+                ::operator delete(pointer);
+                return;
+            }
+            auto* frame = static_cast<FreeFrame*>(pointer);
+            frame->next = lists.head[index];
+            lists.head[index] = frame;
+            lists.count[index]++;
+        }
+
+    private:
+        static constexpr size_t class_count = max_pooled / granularity;
+
+        struct FreeFrame {
+            FreeFrame* next;
+        };
+
+        struct Lists {
+            FreeFrame* head[class_count] = {};
+            size_t count[class_count] = {};
+
+            ~Lists() {
+                for (FreeFrame* frame : head) {
+                    while (frame) {
+                        FreeFrame* next = frame->next;
+                        ::operator delete(frame);
+                        frame = next;
+                    }
+                }
+            }
+        };
+
+        static size_t class_of(size_t size) { return (size + granularity - 1) / granularity - 1; }
+
+        static Lists& local() {
+            thread_local Lists lists;
+            return lists;
+        }
+    };
+
+    struct PooledFrame {
+        static void* operator new(size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void* pointer, size_t size) { FramePool::deallocate(pointer, size); }
+    };
+
+    template<typename T>
+    class Task;
+
+    namespace task_detail {
+        // Resumes whoever awaited the task once it finishes.
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                if (auto continuation = handle.promise().continuation) return continuation;
+                return std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        struct PromiseBase : PooledFrame {
+            std::coroutine_handle<> continuation;
+
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            FinalAwaiter final_suspend() const noexcept { return {}; }
+        };
+    }
+
+    // Lazily started coroutine producing a T. Awaiting it starts the body and resumes the
+    // awaiter when the body finishes (symmetric transfer, so chains don't grow the stack).
+    // Exceptions thrown by the body are rethrown to the awaiter.
+    template<typename T>
+    class Task {
+    public:
+        struct promise_type : task_detail::PromiseBase {
+            std::variant<std::monostate, T, std::exception_ptr> result;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            template<typename U>
+            void return_value(U&& value) { result.template emplace<1>(std::forward<U>(value)); }
+            void unhandled_exception() { result.template emplace<2>(std::current_exception()); }
+        };
+
+        Task() = default;
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                if (handle) handle.destroy();
+                handle = std::exchange(other.handle, {});
+            }
+            return *this;
+        }
+        ~Task() {
+            if (handle) handle.destroy();
+        }
+
+        bool valid() const { return static_cast<bool>(handle); }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+            handle.promise().continuation = awaiter;
+            return handle;
+        }
+
+        T await_resume() {
+            auto& result = handle.promise().result;
+            if (result.index() == 2) std::rethrow_exception(std::get<2>(result));
+            return std::move(std::get<1>(result));
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    };
+
+    template<>
+    class Task<void> {
+    public:
+        struct promise_type : task_detail::PromiseBase {
+            std::exception_ptr error;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            void return_void() {}
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        Task() = default;
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                if (handle) handle.destroy();
+                handle = std::exchange(other.handle, {});
+            }
+            return *this;
+        }
+        ~Task() {
+            if (handle) handle.destroy();
+        }
+
+        bool valid() const { return static_cast<bool>(handle); }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+            handle.promise().continuation = awaiter;
+            return handle;
+        }
+
+        void await_resume() {
+            if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    };
+
+    // Eagerly started, self-destroying coroutine used by the worker as the root of each
+    // asynchronous request. Nothing awaits it; it must not let exceptions escape.
+    struct DetachedTask {
+        struct promise_type : PooledFrame {
+            DetachedTask get_return_object() const noexcept { return {}; }
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+            std::suspend_never final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept { std::terminate(); }
+        };
+    };
+
+    template<typename T>
+    struct is_task : std::false_type {};
+    template<typename T>
+    struct is_task<Task<T>> : std::true_type {};
+}
+
+#endif //SERVERC___TASK_H
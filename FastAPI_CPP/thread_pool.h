@@ -0,0 +1,125 @@
+// Tomas Costantino
+
+#ifndef SERVERC___THREAD_POOL_H
+#define SERVERC___THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "logger.h"
+
+namespace fastapi_cpp {
+
+    // Bounded work-stealing pool for handlers that block (database calls, file I/O, ...).
+    // Each thread owns a queue. submit() spreads tasks over the queues round-robin. A thread
+    // takes from the front of its own queue, and when that is empty it steals from the back of
+    // another. At most `capacity` tasks may be queued; beyond that try_submit() refuses, so the
+    // caller can shed load instead of buffering it.
+    class ThreadPool {
+    public:
+        using Task = std::function<void()>;
+
+        ThreadPool(size_t thread_count, size_t queue_capacity) : capacity(queue_capacity) {
+            if (thread_count == 0) thread_count = 1;
+            for (size_t i = 0; i < thread_count; i++) {
+                queues.push_back(std::make_unique<Queue>());
+            }
+            for (size_t i = 0; i < thread_count; i++) {
+                threads.emplace_back([this, i] { run(i); });
+            }
+        }
+
+        // Runs whatever is still queued, then joins the threads.
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        bool try_submit(Task task) {
+            if (queued.fetch_add(1, std::memory_order_acq_rel) >= capacity) {
+                queued.fetch_sub(1, std::memory_order_acq_rel);
+                return false;
+            }
+            Queue& queue = *queues[next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+            }
+            wake.notify_one();
+            return true;
+        }
+
+        size_t size() const { return threads.size(); }
+        size_t queued_tasks() const { return queued.load(std::memory_order_relaxed); }
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        size_t capacity;
+        std::atomic<size_t> queued{0};
+        std::atomic<size_t> next_queue{0};
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        bool take(size_t self, Task& task) {
+            for (size_t i = 0; i < queues.size(); i++) {
+                Queue& queue = *queues[(self + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.tasks.empty()) continue;
+                if (i == 0) {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                } else {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                return true;
+            }
+            return false;
+        }
+
+        void run(size_t self) {
+            while (true) {
+                Task task;
+                if (take(self, task)) {
+                    queued.fetch_sub(1, std::memory_order_acq_rel);
+                    try {
+                        task();
+                    } catch (const std::exception& e) {
+                        FASTAPI_LOG_ERROR("Blocking task failed: ", e.what());
+                    }
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                if (stopping && queued.load(std::memory_order_acquire) == 0) return;
+                wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            }
+        }
+    };
+}
+
+#endif //SERVERC___THREAD_POOL_H
@@ -0,0 +1,136 @@
+// Tomas Costantino
+
+#ifndef SERVERC___TIMER_WHEEL_H
+#define SERVERC___TIMER_WHEEL_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace fastapi_cpp {
+
+    // Hierarchical timing wheel: four levels of 256 slots, each level's slot spanning a whole
+    // revolution of the level below. A timer goes into the lowest level whose range covers
+    // its distance and moves down a level each time the wheel below wraps, so scheduling,
+    // cancelling and expiring are all O(1) however many timers are pending. Deadlines are
+    // rounded up to the tick, so a timer fires at most one tick late and never early.
+    //
+    // Nodes are intrusive: each is embedded in its owner and unlinks itself on destruction.
+    // Owned and used by a single thread.
+    class TimerWheel {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        class Node {
+        public:
+            // For the owner's use; expire() hands the node back with it.
+            uint64_t data = 0;
+
+            Node() = default;
+            Node(const Node&) = delete;
+            Node& operator=(const Node&) = delete;
+
+            ~Node() { unlink(); }
+
+            bool armed() const { return link != nullptr; }
+
+        private:
+            friend class TimerWheel;
+            Node* next = nullptr;
+            Node** link = nullptr;   // the pointer that points at this node
+            uint64_t expires = 0;    // in ticks
+
+            void unlink() {
+                if (!link) return;
+                *link = next;
+                if (next) next->link = link;
+                next = nullptr;
+                link = nullptr;
+            }
+        };
+
+        explicit TimerWheel(Clock::duration tick_length, Clock::time_point now = Clock::now())
+                : tick(tick_length), current(floor_tick(now)) {}
+
+        TimerWheel(const TimerWheel&) = delete;
+        TimerWheel& operator=(const TimerWheel&) = delete;
+
+        // (Re)arms `node` for `deadline`.
+        void schedule(Node& node, Clock::time_point deadline) {
+            node.unlink();
+            node.expires = std::max(ceil_tick(deadline), current + 1);
+            insert(node);
+        }
+
+        void cancel(Node& node) { node.unlink(); }
+
+        // Moves the wheel to `now`, calling fn(Node&) for every timer that came due. A node is
+        // disarmed before its callback runs, which may re-arm or destroy it.
+        template<typename Fn>
+        void expire(Clock::time_point now, Fn&& fn) {
+            uint64_t target = floor_tick(now);
+            while (current < target) {
+                current++;
+                // Cascading first lets timers due on exactly this tick land in its slot.
+                for (unsigned level = 1; level < levels; level++) {
+                    if ((current >> (slot_bits * (level - 1))) & slot_mask) break;
+                    cascade(level, (current >> (slot_bits * level)) & slot_mask);
+                }
+                Node*& head = slots[0][current & slot_mask];
+                while (Node* node = head) {
+                    node->unlink();
+                    fn(*node);
+                }
+            }
+        }
+
+    private:
+        static constexpr unsigned levels = 4;
+        static constexpr unsigned slot_bits = 8;
+        static constexpr uint64_t slot_mask = (1u << slot_bits) - 1;
+        static constexpr uint64_t max_distance = (uint64_t{1} << (slot_bits * levels)) - 1;
+
+        Clock::duration tick;
+        uint64_t current;
+        std::array<std::array<Node*, slot_mask + 1>, levels> slots{};
+
+        uint64_t floor_tick(Clock::time_point t) const {
+            return static_cast<uint64_t>(t.time_since_epoch() / tick);
+        }
+
+        uint64_t ceil_tick(Clock::time_point t) const {
+            Clock::duration since = t.time_since_epoch();
+            return static_cast<uint64_t>(since / tick) + (since % tick != Clock::duration::zero());
+        }
+
+        void insert(Node& node) {
+            uint64_t distance = node.expires > current ? node.expires - current : 0;
+            if (distance > max_distance) {
+                distance = max_distance;
+                node.expires = current + max_distance;
+            }
+            unsigned level = 0;
+            while (level + 1 < levels && distance >> (slot_bits * (level + 1))) level++;
+            Node*& head = slots[level][(node.expires >> (slot_bits * level)) & slot_mask];
+            node.next = head;
+            node.link = &head;
+            if (head) head->link = &node.next;
+            head = &node;
+        }
+
+        void cascade(unsigned level, uint64_t slot) {
+            Node* node = slots[level][slot];
+            slots[level][slot] = nullptr;
+            while (node) {
+                Node* next = node->next;
+                node->next = nullptr;
+                node->link = nullptr;
+                insert(*node);
+                node = next;
+            }
+        }
+    };
+}
+
+#endif //SERVERC___TIMER_WHEEL_H
@@ -0,0 +1,226 @@
+// Tomas Costantino
+
+#ifndef SERVERC___TRACING_H
+#define SERVERC___TRACING_H
+
+#include "http_lib.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fastapi_cpp {
+
+    // Points in the life of a request, in the order they are reached.
+    enum class TracePoint {
+        ACCEPTED,        // the connection was accepted
+        FIRST_BYTE,      // the first bytes of this request were received
+        PARSED,          // headers and body have been framed into a Request
+        ROUTED,          // the router resolved the endpoint
+        HANDLED,         // the handler returned (as seen by the I/O thread for deferred routes)
+        BUILT,           // the response head has been serialized into the output queue
+        LAST_BYTE,       // the last byte of the response was handed to the kernel
+        COUNT
+    };
+
+    // Timestamps of one request, in steady_clock nanoseconds; 0 for points never reached.
+    // Trivially copyable, so sampling one into the ring is a memcpy.
+    struct RequestTrace {
+        static constexpr size_t max_label = 96;
+
+        uint64_t connection_id = 0;
+        unsigned request_index = 0;   // 1 for the first request on the connection
+        int status = 0;
+        std::array<uint64_t, static_cast<size_t>(TracePoint::COUNT)> at{};
+        char label[max_label] = {};   // "METHOD /target", truncated
+
+        uint64_t& operator[](TracePoint point) { return at[static_cast<size_t>(point)]; }
+        uint64_t operator[](TracePoint point) const { return at[static_cast<size_t>(point)]; }
+
+        bool started() const { return (*this)[TracePoint::PARSED] != 0; }
+
+        // From the first byte received to the last byte sent.
+        uint64_t duration() const {
+            uint64_t begin = (*this)[TracePoint::FIRST_BYTE] ? (*this)[TracePoint::FIRST_BYTE] : (*this)[TracePoint::PARSED];
+            uint64_t end = (*this)[TracePoint::LAST_BYTE];
+            return end > begin ? end - begin : 0;
+        }
+
+        void set_label(http::Method method, std::string_view uri) {
+            std::string_view name = http::method_to_string(method);
+            size_t n = std::min(name.size(), max_label - 2);
+            std::memcpy(label, name.data(), n);
+            label[n++] = ' ';
+            size_t rest = std::min(uri.size(), max_label - 1 - n);
+            std::memcpy(label + n, uri.data(), rest);
+            label[n + rest] = '\0';
+        }
+    };
+
+    // Per-request tracing for finding where individual slow requests spend their time. The
+    // worker stamps each request at the points above; requests slower than the threshold are
+    // copied into a fixed ring that can be dumped as text or exported as Chrome trace JSON
+    // (chrome://tracing, Perfetto). While disabled the hooks are one predicted-false branch,
+    // and building with FASTAPI_DISABLE_TRACING removes them entirely.
+    class Tracer {
+    public:
+#if defined(FASTAPI_DISABLE_TRACING)
+        static constexpr bool compiled_in = false;
+#else
+        static constexpr bool compiled_in = true;
+#endif
+
+        static Tracer& instance() {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        void enable(std::chrono::nanoseconds slower_than, size_t capacity = 1024) {
+            {
+                std::lock_guard<std::mutex> lock(ring_mutex);
+                ring.assign(std::max<size_t>(capacity, 1), RequestTrace{});
+                next = 0;
+                stored = 0;
+            }
+            threshold.store(static_cast<uint64_t>(slower_than.count()), std::memory_order_relaxed);
+            active.store(true, std::memory_order_release);
+        }
+
+        void disable() { active.store(false, std::memory_order_relaxed); }
+
+        bool enabled() const {
+            if constexpr (!compiled_in) return false;
+            return active.load(std::memory_order_relaxed);
+        }
+
+        // The trace being built on this thread, or nullptr. The worker points it at the
+        // connection's trace around the inline handler call so FastAPI can stamp into it.
+        static RequestTrace*& current() {
+            thread_local RequestTrace* trace = nullptr;
+            return trace;
+        }
+
+        static void mark(TracePoint point) {
+            if constexpr (!compiled_in) return;
+            if (RequestTrace* trace = current()) [[unlikely]] {
+                (*trace)[point] = now_ns();
+            }
+        }
+
+        // Called once the response is fully sent; keeps the trace if it was slow enough.
+        void finish(const RequestTrace& trace) {
+            if (trace.duration() < threshold.load(std::memory_order_relaxed)) return;
+            std::lock_guard<std::mutex> lock(ring_mutex);
+            if (ring.empty()) return;
+            ring[next] = trace;
+            next = (next + 1) % ring.size();
+            stored = std::min(stored + 1, ring.size());
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(ring_mutex);
+            next = 0;
+            stored = 0;
+        }
+
+        // Sampled traces, oldest first.
+        std::vector<RequestTrace> snapshot() const {
+            std::lock_guard<std::mutex> lock(ring_mutex);
+            std::vector<RequestTrace> traces;
+            traces.reserve(stored);
+            size_t first = (next + ring.size() - stored) % std::max<size_t>(ring.size(), 1);
+            for (size_t i = 0; i < stored; i++) {
+                traces.push_back(ring[(first + i) % ring.size()]);
+            }
+            return traces;
+        }
+
+        // One line per sampled request: total time, then the time spent in each phase.
+        void dump(std::string& out) const {
+            for (const RequestTrace& trace : snapshot()) {
+                char line[160];
+                int n = std::snprintf(line, sizeof(line), "conn %llu #%u %d %.3fms",
+                                      static_cast<unsigned long long>(trace.connection_id), trace.request_index,
+                                      trace.status, static_cast<double>(trace.duration()) / 1e6);
+                out.append(line, n);
+                for_each_phase(trace, [&](const char* phase, uint64_t begin, uint64_t end) {
+                    int written = std::snprintf(line, sizeof(line), " %s=%.3fus", phase, static_cast<double>(end - begin) / 1e3);
+                    out.append(line, written);
+                });
+                out += ' ';
+                out += trace.label;
+                out += '\n';
+            }
+        }
+
+        // Chrome trace event format: one complete event per request on a track per connection,
+        // with its phases nested underneath.
+        std::string chrome_trace() const {
+            http::JSON::Array events;
+            for (const RequestTrace& trace : snapshot()) {
+                auto tid = static_cast<double>(trace.connection_id);
+                uint64_t begin = trace[TracePoint::FIRST_BYTE] ? trace[TracePoint::FIRST_BYTE] : trace[TracePoint::PARSED];
+                http::JSON::Object args{{"status", static_cast<double>(trace.status)},
+                                        {"request_index", static_cast<double>(trace.request_index)}};
+                if (trace[TracePoint::ACCEPTED] && trace[TracePoint::ACCEPTED] <= begin) {
+                    args["since_accept_us"] = static_cast<double>(begin - trace[TracePoint::ACCEPTED]) / 1e3;
+                }
+                events.push_back(event(trace.label, "request", tid, begin, trace.duration(), std::move(args)));
+                for_each_phase(trace, [&](const char* phase, uint64_t from, uint64_t to) {
+                    events.push_back(event(phase, "phase", tid, from, to - from, {}));
+                });
+            }
+            return http::JSON::object({{"traceEvents", events}, {"displayTimeUnit", "ns"}}).stringify();
+        }
+
+        static uint64_t now_ns() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+    private:
+        std::atomic<bool> active{false};
+        std::atomic<uint64_t> threshold{0};
+        mutable std::mutex ring_mutex;
+        std::vector<RequestTrace> ring;
+        size_t next = 0;
+        size_t stored = 0;
+
+        Tracer() = default;
+
+        // Calls fn(name, begin, end) for each span between consecutive points that were reached.
+        template<typename Fn>
+        static void for_each_phase(const RequestTrace& trace, Fn&& fn) {
+            static constexpr const char* phase_names[] = {"", "", "read", "route", "handler", "build", "send"};
+            uint64_t previous = trace[TracePoint::FIRST_BYTE];
+            for (size_t point = static_cast<size_t>(TracePoint::PARSED); point < trace.at.size(); point++) {
+                uint64_t at = trace.at[point];
+                if (at == 0) continue;
+                if (previous != 0 && at >= previous) fn(phase_names[point], previous, at);
+                previous = at;
+            }
+        }
+
+        static http::JSON event(const char* name, const char* category, double tid, uint64_t begin_ns,
+                                uint64_t duration_ns, http::JSON::Object args) {
+            http::JSON::Object object{{"name", name},
+                                      {"cat", category},
+                                      {"ph", "X"},
+                                      {"pid", 1.0},
+                                      {"tid", tid},
+                                      {"ts", static_cast<double>(begin_ns) / 1e3},
+                                      {"dur", static_cast<double>(duration_ns) / 1e3}};
+            if (!args.empty()) object["args"] = http::JSON(std::move(args));
+            return http::JSON(std::move(object));
+        }
+    };
+}
+
+#endif //SERVERC___TRACING_H
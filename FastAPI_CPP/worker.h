@@ -0,0 +1,1444 @@
+// Tomas Costantino
+
+#ifndef SERVERC___WORKER_H
+#define SERVERC___WORKER_H
+
+#include "http_lib.h"
+#include "event_loop.h"
+#include "connection.h"
+#include "config.h"
+#include <functional>
+#include <unordered_map>
+#include "logger.h"
+#include "thread_pool.h"
+#include "router.h"
+#include "io_context.h"
+#include "task.h"
+#include "metrics.h"
+#include "io_uring.h"
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <atomic>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace fastapi_cpp {
+
+    // Owns a listening socket, an event loop and every connection accepted on it.
+    // handle_request is invoked only once a complete request has been framed.
+    // With reuse_port, several workers bind the same port via SO_REUSEPORT and the
+    // kernel spreads incoming connections across their listening sockets.
+    //
+    // The handler answers INLINE routes on the I/O thread. A BLOCKING route is run by the
+    // blocking handler on the shared ThreadPool and its response is posted back to this
+    // worker. An ASYNC route is started as a coroutine on this thread; it suspends on the
+    // worker's IoContext and its response is queued when it finishes. Either way the
+    // connection dispatches nothing further until that response arrives, which keeps
+    // pipelined responses in order. The same holds while a request body is being streamed to
+    // a BodyReader, or a streamed response is still being produced.
+    //
+    // A connection that opens with the HTTP/2 preface, or upgrades to h2c, is handed to an
+    // Http2Session instead. Its requests arrive as streams and go through the same handler,
+    // each answered as soon as it is ready: a stream waiting for its handler holds up no
+    // other, and the session interleaves the response bodies within flow control.
+    //
+    // Each connection is under one deadline at a time (see refresh_deadline), kept in a
+    // timer wheel that the loop advances every iteration.
+    //
+    // With IoBackend::IO_URING the connections' sockets bypass the event loop: accepts and
+    // receives are multishot io_uring requests, and sends are queued as SQEs that go to the
+    // kernel together when the worker next waits. The event loop then only watches the wake
+    // pipe and coroutine sockets, and is itself polled through the ring.
+    class Worker {
+    public:
+        using Handler = std::function<Dispatch(const http::Request&)>;
+        using BlockingHandler = std::function<http::Response(const http::Request&)>;
+        using AsyncHandler = std::function<Task<http::Response>(const http::Request&)>;
+        using BodyReaderHandler = std::function<std::optional<http::BodyReader>(const http::Request&)>;
+
+        Worker(int port, Handler h, const ServerConfig& server_config,
+               const std::atomic<bool>& running_flag, bool reuse_port = false)
+                : handler(std::move(h)), config(server_config), running(running_flag) {
+            open_listener(port, reuse_port);
+            loop.add(listen_fd);
+            open_wake_pipe();
+        }
+
+        ~Worker() {
+            for (auto& [fd, conn] : connections) {
+                close(fd);
+            }
+            if (listen_fd != -1) {
+                close(listen_fd);
+            }
+            close(wake_read_fd);
+            close(wake_write_fd);
+        }
+
+        void set_blocking_pool(ThreadPool* pool, BlockingHandler blocking) {
+            blocking_pool = pool;
+            blocking_handler = std::move(blocking);
+        }
+
+        void set_async_handler(AsyncHandler async) {
+            async_handler = std::move(async);
+        }
+
+        // Offered every request as soon as its head is framed; a BodyReader it returns gets
+        // the body as it arrives instead of once it is buffered. Set before run().
+        void set_body_reader_handler(BodyReaderHandler reader) {
+            body_reader_handler = std::move(reader);
+        }
+
+        // Connections this worker keeps open at once (0 = no limit). Set before run().
+        void set_max_connections(size_t limit) {
+            max_connections = limit;
+        }
+
+        Worker(const Worker&) = delete;
+        Worker& operator=(const Worker&) = delete;
+
+        void run() {
+#if defined(FASTAPI_HAS_IO_URING)
+            if (config.io_backend == IoBackend::IO_URING && start_uring()) {
+                run_uring();
+                return;
+            }
+#endif
+            std::vector<Event> events;
+            IoContext::current() = &io;
+            while (running) {
+                loop.wait(events, io.wait_timeout(deadline_tick.count(), std::chrono::steady_clock::now()));
+                http::DateCache::instance().refresh();
+                io.run_expired_timers(std::chrono::steady_clock::now());
+                for (const auto& event : events) {
+                    if (io.dispatch(event)) continue;
+                    if (event.fd == listen_fd) {
+                        accept_connections();
+                        continue;
+                    }
+                    if (event.fd == wake_read_fd) {
+                        deliver_completions();
+                        continue;
+                    }
+
+                    auto it = connections.find(event.fd);
+                    if (it == connections.end()) continue;
+                    Connection& conn = it->second;
+
+                    if (event.flags & EVENT_ERROR) {
+                        conn.state = Connection::State::CLOSED;
+                    }
+                    if ((event.flags & EVENT_READ) && conn.state != Connection::State::CLOSED) {
+                        on_readable(conn);
+                    }
+                    if ((event.flags & EVENT_WRITE) && conn.state == Connection::State::WRITING) {
+                        flush(conn);
+                        process(conn);
+                        resume_reading(conn);
+                    }
+                    if (conn.state == Connection::State::CLOSED) {
+                        close_connection(conn.fd);
+                    } else {
+                        refresh_deadline(conn);
+                    }
+                }
+
+                deliver_async_completions();
+                expire_deadlines(std::chrono::steady_clock::now());
+            }
+            IoContext::current() = nullptr;
+        }
+
+    private:
+        struct Completion {
+            int fd;
+            uint64_t connection_id;
+            http::Response response;
+            uint32_t stream_id = 0;   // HTTP/2 stream the response is for; 0 on HTTP/1
+        };
+
+        int listen_fd = -1;
+        EventLoop loop;
+        BufferPool buffers;
+        // Resolution of connection deadlines, and so the longest the loop sleeps.
+        static constexpr auto deadline_tick = std::chrono::milliseconds(100);
+        // Declared before the connections, whose deadline nodes unlink from it as they go.
+        TimerWheel deadlines{deadline_tick};
+        std::vector<int> expired;
+        std::unordered_map<int, Connection> connections;
+        size_t max_connections = 0;
+        uint64_t next_connection_id = 0;
+        Handler handler;
+        const ServerConfig& config;
+        const std::atomic<bool>& running;
+
+        ThreadPool* blocking_pool = nullptr;
+        BlockingHandler blocking_handler;
+        int wake_read_fd = -1;
+        int wake_write_fd = -1;
+        std::mutex completions_mutex;
+        std::vector<Completion> completions;
+        std::atomic<bool> wake_pending{false};
+
+        AsyncHandler async_handler;
+        BodyReaderHandler body_reader_handler;
+        IoContext io{loop};
+        std::vector<Completion> async_completions;
+
+        static constexpr size_t max_send_iov = 64;
+
+#if defined(FASTAPI_HAS_IO_URING)
+        // What a completion is for; packed into user_data with the fd and the low bits of the
+        // connection id, so completions for a connection that has since closed are ignored.
+        enum class UringOp : uint8_t {
+            ACCEPT,
+            RECV,
+            SEND,
+            POLL_OUT,
+            EVENT_LOOP,
+            CLOSE
+        };
+
+        static constexpr unsigned uring_entries = 1024;
+        static constexpr unsigned uring_buffer_count = 1024;
+        static constexpr unsigned uring_buffer_size = 4096;
+
+        // Declared after the connections, so it is torn down before the buffers its requests use.
+        std::unique_ptr<IoUring> ring;
+#endif
+
+        void open_listener(int port, bool reuse_port) {
+            if ((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+                throw std::runtime_error("Socket creation failed");
+            }
+
+            int opt = 1;
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+            if (reuse_port) {
+#if defined(SO_REUSEPORT)
+                if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+                    close(listen_fd);
+                    throw std::runtime_error("SO_REUSEPORT failed");
+                }
+#else
+                close(listen_fd);
+                throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+            }
+
+            struct sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = INADDR_ANY;
+            address.sin_port = htons(port);
+
+            if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+                close(listen_fd);
+                throw std::runtime_error("Bind failed");
+            }
+
+            if (listen(listen_fd, SOMAXCONN) < 0) {
+                close(listen_fd);
+                throw std::runtime_error("Listen failed");
+            }
+
+            set_nonblocking(listen_fd);
+        }
+
+        // Self-pipe registered with the event loop, so pool threads can wake this worker.
+        void open_wake_pipe() {
+            int fds[2];
+            if (pipe(fds) < 0) {
+                throw std::runtime_error("Wake pipe creation failed");
+            }
+            wake_read_fd = fds[0];
+            wake_write_fd = fds[1];
+            set_nonblocking(wake_read_fd);
+            set_nonblocking(wake_write_fd);
+            loop.add(wake_read_fd);
+        }
+
+        // Called from pool threads.
+        void post_completion(Completion completion) {
+            {
+                std::lock_guard<std::mutex> lock(completions_mutex);
+                completions.push_back(std::move(completion));
+            }
+            if (!wake_pending.exchange(true, std::memory_order_acq_rel)) {
+                char byte = 1;
+                while (write(wake_write_fd, &byte, 1) < 0 && errno == EINTR) {}
+            }
+        }
+
+        void deliver_completions() {
+            char drain[64];
+            while (read(wake_read_fd, drain, sizeof(drain)) > 0) {}
+            wake_pending.store(false, std::memory_order_release);
+
+            std::vector<Completion> ready;
+            {
+                std::lock_guard<std::mutex> lock(completions_mutex);
+                ready.swap(completions);
+            }
+            complete(ready);
+        }
+
+        // Completions of coroutines that finished during this iteration. They are queued rather
+        // than delivered from inside the coroutine, so process() never re-enters itself.
+        void deliver_async_completions() {
+            while (!async_completions.empty()) {
+                std::vector<Completion> ready;
+                ready.swap(async_completions);
+                complete(ready);
+            }
+        }
+
+        void complete(std::vector<Completion>& ready) {
+            for (auto& completion : ready) {
+                auto it = connections.find(completion.fd);
+                if (it == connections.end() || it->second.id != completion.connection_id) continue;
+                Connection& conn = it->second;
+                if (completion.stream_id) {
+                    conn.h2->handler_finished(completion.stream_id);
+                    respond_h2(conn, completion.stream_id, std::move(completion.response));
+                } else {
+                    conn.awaiting_handler = false;
+                    if (conn.trace.started()) conn.trace[TracePoint::HANDLED] = Tracer::now_ns();
+                    queue_response(conn, std::move(completion.response));
+                }
+                process(conn);
+                resume_reading(conn);
+                if (conn.state == Connection::State::CLOSED) {
+                    close_connection(conn.fd);
+                } else {
+                    refresh_deadline(conn);
+                }
+            }
+        }
+
+        // Hands the request to the pool; answers 503 right away when the pool queue is full.
+        void offload(Connection& conn, http::Request&& req, uint32_t stream_id = 0) {
+            http::Method method = req.method;
+            std::string uri = Logger::instance().enabled(LogLevel::INFO) ? std::string(req.uri) : std::string();
+            bool accepted = blocking_pool && blocking_pool->try_submit(
+                    [this, fd = conn.fd, id = conn.id, stream_id, req = std::move(req)] {
+                        http::Response resp;
+                        try {
+                            resp = blocking_handler(req);
+                        } catch (const std::exception& e) {
+                            FASTAPI_LOG_ERROR("Error handling request: ", e.what());
+                            resp = http::HTTP_500_INTERNAL_SERVER_ERROR();
+                        }
+                        FASTAPI_LOG_INFO(http::method_to_string(req.method), " ", req.uri, " ", static_cast<int>(resp.status));
+                        post_completion({fd, id, std::move(resp), stream_id});
+                    });
+            if (accepted) {
+                await_response(conn, stream_id);
+                return;
+            }
+            FASTAPI_LOG_INFO(http::method_to_string(method), " ", uri, " 503");
+            if (stream_id) {
+                respond_h2(conn, stream_id, overload_response());
+                return;
+            }
+            conn.close_after_write = true;
+            queue_response(conn, overload_response());
+        }
+
+        // Shed load: precomputed, so refusing work costs next to nothing.
+        static const http::PreparedResponse& overload_response() {
+            static const http::PreparedResponse response(
+                    http::Response{{1, 1}, http::HttpStatus::SERVICE_UNAVAILABLE, {{"Retry-After", "1"}}, {}, {}});
+            return response;
+        }
+
+        // The response comes back later as a completion.
+        static void await_response(Connection& conn, uint32_t stream_id) {
+            if (stream_id) {
+                conn.h2->handler_started(stream_id);
+            } else {
+                conn.awaiting_handler = true;
+            }
+        }
+
+        static const http::PreparedResponse& timeout_response() {
+            static const http::PreparedResponse response(http::Response{{1, 1}, http::HttpStatus::REQUEST_TIMEOUT, {}, {}, {}});
+            return response;
+        }
+
+        // Root coroutine of an ASYNC request. Owns the request for as long as the handler runs.
+        static DetachedTask run_async(Worker* worker, int fd, uint64_t id, std::unique_ptr<http::Request> req,
+                                      uint32_t stream_id = 0) {
+            http::Response resp;
+            try {
+                resp = co_await worker->async_handler(*req);
+            } catch (const std::exception& e) {
+                FASTAPI_LOG_ERROR("Error handling request: ", e.what());
+                resp = http::HTTP_500_INTERNAL_SERVER_ERROR();
+            }
+            FASTAPI_LOG_INFO(http::method_to_string(req->method), " ", req->uri, " ", static_cast<int>(resp.status));
+            worker->async_completions.push_back({fd, id, std::move(resp), stream_id});
+        }
+
+        void accept_connections() {
+            while (true) {
+                int new_socket = accept(listen_fd, nullptr, nullptr);
+                if (new_socket < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        FASTAPI_LOG_ERROR("Accept failed: errno ", errno);
+                    }
+                    return;
+                }
+
+                if (!admit(new_socket)) continue;
+                set_nonblocking(new_socket);
+                add_connection(new_socket);
+                loop.add(new_socket);
+            }
+        }
+
+        // Over the connection limit a new socket gets the 503 in one non-blocking send, without
+        // ever being registered, and is closed.
+        bool admit(int socket_fd) {
+            if (max_connections == 0 || connections.size() < max_connections) return true;
+            const http::PreparedResponse& refusal = overload_response();
+            std::string bytes(refusal.head(false));
+            http::DateCache::instance().append_to(bytes);
+            bytes += "\r\n";
+            send(socket_fd, bytes.data(), bytes.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            close(socket_fd);
+            Metrics::instance().count_status(static_cast<int>(http::HttpStatus::SERVICE_UNAVAILABLE));
+            FASTAPI_LOG_DEBUG("Refused connection: ", connections.size(), " open");
+            return false;
+        }
+
+        Connection& add_connection(int socket_fd) {
+            int opt = 1;
+            setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+#if defined(SO_NOSIGPIPE)
+            setsockopt(socket_fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+#endif
+            auto [it, inserted] = connections.try_emplace(socket_fd, socket_fd,
+                    http::FramingLimits{config.max_header_size, config.max_body_size}, buffers);
+            it->second.id = next_connection_id++;
+            it->second.deadline.data = static_cast<uint64_t>(socket_fd);
+            it->second.framer.stop_at_head(body_reader_handler != nullptr);
+            if (Tracer::instance().enabled()) [[unlikely]] it->second.accepted_at = Tracer::now_ns();
+            Metrics::instance().connection_opened();
+            refresh_deadline(it->second);
+            return it->second;
+        }
+
+        void note_received(Connection& conn, size_t bytes) {
+            conn.bytes_received += bytes;
+            Metrics::instance().add_bytes_in(bytes);
+            if (Tracer::instance().enabled()) [[unlikely]] {
+                conn.last_received = Tracer::now_ns();
+                if (!conn.input_started) conn.input_started = conn.last_received;
+            }
+        }
+
+        // Dispatch is held up: a handler is running, or a response is still being sent. What
+        // the client sends meanwhile could only pile up in in_buffer.
+        bool dispatch_paused(const Connection& conn) const {
+            return conn.awaiting_handler || conn.body_stream || conn.pending_output() >= config.max_pending_output;
+        }
+
+        // The most input a paused connection may hold: a request of the largest size allowed.
+        size_t paused_input_limit() const { return config.max_header_size + config.max_body_size; }
+
+        // Stops reading the socket while dispatch is paused, so a client that pipelines
+        // requests to a slow route, or never reads its responses, is held back by TCP flow
+        // control instead of growing in_buffer. With io_uring the multishot receive is
+        // cancelled; bytes it delivers before the cancellation lands are still kept, up to
+        // paused_input_limit().
+        bool pause_reading(Connection& conn) {
+            if (conn.read_paused) return true;
+            if (!dispatch_paused(conn)) return false;
+            conn.read_paused = true;
+#if defined(FASTAPI_HAS_IO_URING)
+            if (ring && conn.recv_armed) ring->cancel(uring_tag(UringOp::RECV, conn.fd, conn.id), uring_tag(UringOp::CLOSE, conn.fd));
+#endif
+            return true;
+        }
+
+        // Reads again once dispatch has caught up with a connection whose reading was paused.
+        void resume_reading(Connection& conn) {
+            if (!conn.read_paused || conn.state == Connection::State::CLOSED || dispatch_paused(conn)) return;
+            conn.read_paused = false;
+#if defined(FASTAPI_HAS_IO_URING)
+            if (ring) {
+                // Otherwise the cancelled receive is re-armed when its last completion comes in.
+                if (!conn.recv_armed && !conn.peer_closed) arm_recv(conn);
+                return;
+            }
+#endif
+            on_readable(conn);
+        }
+
+        // Reads straight into the connection's pooled buffer. The buffer goes back to the pool
+        // once every request in it has been dispatched.
+        void on_readable(Connection& conn) {
+            constexpr size_t min_read = 4096;
+            while (true) {
+                if (pause_reading(conn)) break;
+                char* space = conn.in_buffer.prepare(min_read);
+                ssize_t n = recv(conn.fd, space, conn.in_buffer.writable(), 0);
+                if (n > 0) {
+                    conn.in_buffer.commit(n);
+                    note_received(conn, n);
+                    if (conn.in_buffer.size() >= Connection::upload_read_size) {
+                        process(conn);
+                        if (conn.state == Connection::State::CLOSED) return;
+                    }
+                    continue;
+                }
+                if (n == 0) {
+                    conn.peer_closed = true;
+                    break;
+                }
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                FASTAPI_LOG_ERROR("Read failed: errno ", errno);
+                conn.state = Connection::State::CLOSED;
+                return;
+            }
+            process(conn);
+            if (conn.in_buffer.empty()) conn.in_buffer.release();
+        }
+
+        // Dispatches every complete request in in_buffer, appending responses in order, until
+        // the buffer holds no full request or unsent output exceeds max_pending_output.
+        void process(Connection& conn) {
+            while (conn.state != Connection::State::CLOSED) {
+                if (conn.h2) {
+                    process_h2(conn);
+                    return;
+                }
+                bool dispatched = false;
+                bool need_input = false;
+                if (conn.body_stream) {
+                    pump_stream(conn);
+                    dispatched = true;
+                }
+                while ((!conn.close_after_write || conn.body_reader) && !conn.awaiting_handler && !conn.body_stream &&
+                       conn.pending_output() < config.max_pending_output) {
+                    if (!dispatch_one(conn)) {
+                        need_input = true;
+                        break;
+                    }
+                    dispatched = true;
+                }
+                if (conn.state == Connection::State::CLOSED) return;
+
+                if (conn.peer_closed && need_input) {
+                    conn.close_after_write = true;
+                }
+
+                if (conn.pending_output() > 0) {
+                    conn.state = Connection::State::WRITING;
+                    flush(conn);
+                    if (conn.state != Connection::State::READING) return;
+                } else if (conn.awaiting_handler || (conn.body_reader && !conn.peer_closed)) {
+                    return;
+                } else if (conn.close_after_write) {
+                    conn.state = Connection::State::CLOSED;
+                    return;
+                }
+                if (!dispatched) return;
+            }
+        }
+
+        // Frames and answers one request. Returns false when in_buffer needs more bytes.
+        bool dispatch_one(Connection& conn) {
+            if (conn.h2) return false;
+            if (conn.body_reader) return read_body(conn);
+            if (conn.requests_served == 0 && config.enable_http2) {
+                // HTTP/2 with prior knowledge: the client opens with the connection preface.
+                std::string_view input = conn.in_buffer.view();
+                std::string_view start = input.substr(0, http::http2_preface.size());
+                if (!start.empty() && http::http2_preface.starts_with(start)) {
+                    if (start.size() < http::http2_preface.size()) return false;
+                    conn.h2 = std::make_unique<http::Http2Session>(http2_limits());
+                    conn.h2->start();
+                    return true;
+                }
+            }
+            uint64_t parse_started = Metrics::instance().start();
+            auto status = conn.framer.feed(conn.in_buffer.view());
+            if (status == http::RequestFramer::Status::HEAD) {
+                if (open_upload(conn)) return read_body(conn);
+                status = conn.framer.feed(conn.in_buffer.view());
+            }
+            if (status == http::RequestFramer::Status::INCOMPLETE) return false;
+            conn.response_encoding = http::ContentEncoding::IDENTITY;
+
+            if (status == http::RequestFramer::Status::ERROR) {
+                FASTAPI_LOG_ERROR("Error framing request: ", static_cast<int>(conn.framer.error()));
+                conn.close_after_write = true;
+                queue_response(conn, http::custom_response(conn.framer.error()));
+                return true;
+            }
+
+            // Nothing from the previous request lives on: its response has been queued, and
+            // offloaded requests are copied out of the arena.
+            conn.request_arena.reset();
+            std::optional<http::Request> framed;
+            try {
+                framed.emplace(conn.framer.take_request(conn.in_buffer.view(), &conn.request_memory));
+            } catch (const std::exception& e) {
+                FASTAPI_LOG_ERROR("Error parsing request: ", e.what());
+                conn.close_after_write = true;
+                queue_response(conn, http::HTTP_400_BAD_REQUEST());
+                return true;
+            }
+            http::Request& req = *framed;
+            Metrics::instance().observe_since(Phase::PARSE, parse_started);
+            FASTAPI_LOG_DEBUG("Received request:\n", conn.in_buffer.view().substr(0, conn.framer.consumed()));
+            conn.in_buffer.consume(conn.framer.consumed());
+            conn.framer.reset();
+            if (config.enable_http2 && upgrade_h2(conn, req)) return true;
+
+            begin_request(conn, req);
+            bool tracing = conn.trace.started();
+            if (tracing) [[unlikely]] Tracer::current() = &conn.trace;
+            Dispatch result;
+            try {
+                result = handler(req);
+            } catch (const std::exception& e) {
+                FASTAPI_LOG_ERROR("Error handling request: ", e.what());
+                conn.close_after_write = true;
+                result.response = http::HTTP_500_INTERNAL_SERVER_ERROR();
+            }
+            if (tracing) [[unlikely]] Tracer::current() = nullptr;
+            if (result.execution == Execution::BLOCKING) {
+                offload(conn, http::Request(req, {}));
+                return true;
+            }
+            if (result.execution == Execution::ASYNC) {
+                conn.awaiting_handler = true;
+                run_async(this, conn.fd, conn.id, std::make_unique<http::Request>(req, http::Request::allocator_type()));
+                return true;
+            }
+            FASTAPI_LOG_INFO(http::method_to_string(req.method), " ", req.uri, " ", static_cast<int>(result.response.status));
+            queue_response(conn, std::move(result.response));
+            return true;
+        }
+
+        http::Http2Limits http2_limits() const {
+            return {config.http2_max_concurrent_streams, config.http2_initial_window_size, config.max_header_size,
+                    config.max_body_size};
+        }
+
+        // Switches to HTTP/2 for a request with "Upgrade: h2c" (RFC 7540 3.2): the 101 goes
+        // out, and the request is answered as stream 1. A request with an invalid
+        // HTTP2-Settings header is served over HTTP/1.1 instead.
+        bool upgrade_h2(Connection& conn, const http::Request& req) {
+            std::optional<std::string_view> settings = req.headers.find("HTTP2-Settings");
+            if (!settings || http::find_header(req, http::HeaderId::UPGRADE).find("h2c") == std::string_view::npos) return false;
+            auto session = std::make_unique<http::Http2Session>(http2_limits());
+            if (!session->upgrade(*settings)) return false;
+            conn.h2 = std::move(session);
+            std::string& tail = conn.output_tail();
+            size_t start = tail.size();
+            tail += "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+            conn.h2->take_output(tail);
+            conn.count_output(tail.size() - start);
+            http::Http2Session::Stream* stream = conn.h2->find(1);
+            stream->request = http::Request(req, {});
+            stream->request.version = {2, 0};
+            dispatch_stream(conn, 1);
+            return true;
+        }
+
+        // Reads the frames in in_buffer, dispatching each request they complete, then frames
+        // response data until stream_high_water bytes are pending or flow control stops it.
+        void process_h2(Connection& conn) {
+            http::Http2Session& session = *conn.h2;
+            auto on_event = [this, &conn](const http::Http2Session::Event& event) { on_stream_event(conn, event); };
+            while (conn.state != Connection::State::CLOSED) {
+                // Frames are taken only while their replies fit under max_pending_output; the
+                // rest wait in in_buffer, and reading pauses, until the client reads.
+                if (conn.pending_output() < config.max_pending_output) {
+                    size_t room = config.max_pending_output - conn.pending_output();
+                    conn.in_buffer.consume(session.feed(conn.in_buffer.view(), room, on_event));
+                }
+                if (conn.pending_output() < config.stream_high_water) {
+                    session.produce(config.stream_high_water - conn.pending_output());
+                }
+                if (session.has_output()) {
+                    if (conn.pending_output() == 0) conn.output_started = Metrics::instance().start();
+                    conn.queue_body(session.take_output());
+                }
+                if (session.finished() || conn.peer_closed) conn.close_after_write = true;
+                if (conn.pending_output() == 0) {
+                    if (conn.close_after_write) conn.state = Connection::State::CLOSED;
+                    return;
+                }
+                conn.state = Connection::State::WRITING;
+                flush(conn);
+                if (conn.state != Connection::State::READING) return;
+            }
+        }
+
+        void on_stream_event(Connection& conn, const http::Http2Session::Event& event) {
+            http::Http2Session& session = *conn.h2;
+            switch (event.kind) {
+                case http::Http2Session::EventKind::HEAD: {
+                    http::Http2Session::Stream* stream = session.find(event.stream_id);
+                    if (!body_reader_handler || !stream->body_pending()) return;
+                    std::optional<http::BodyReader> reader;
+                    try {
+                        reader = body_reader_handler(stream->request);
+                    } catch (const std::exception& e) {
+                        FASTAPI_LOG_ERROR("Error opening request body reader: ", e.what());
+                    }
+                    if (!reader) return;
+                    session.stream_body(event.stream_id);
+                    conn.stream_readers.emplace(event.stream_id, std::move(*reader));
+                    begin_stream(conn, *stream);
+                    return;
+                }
+                case http::Http2Session::EventKind::DATA: {
+                    auto it = conn.stream_readers.find(event.stream_id);
+                    if (it == conn.stream_readers.end()) return;
+                    try {
+                        it->second.on_data(event.data);
+                    } catch (const std::exception& e) {
+                        FASTAPI_LOG_ERROR("Error handling request: ", e.what());
+                        conn.stream_readers.erase(it);
+                        respond_h2(conn, event.stream_id, http::HTTP_500_INTERNAL_SERVER_ERROR());
+                    }
+                    return;
+                }
+                case http::Http2Session::EventKind::END: {
+                    auto it = conn.stream_readers.find(event.stream_id);
+                    if (it == conn.stream_readers.end()) {
+                        dispatch_stream(conn, event.stream_id);
+                        return;
+                    }
+                    http::Response resp;
+                    try {
+                        resp = it->second.on_end();
+                    } catch (const std::exception& e) {
+                        FASTAPI_LOG_ERROR("Error handling request: ", e.what());
+                        resp = http::HTTP_500_INTERNAL_SERVER_ERROR();
+                    }
+                    conn.stream_readers.erase(it);
+                    if (const http::Http2Session::Stream* stream = session.find(event.stream_id)) {
+                        FASTAPI_LOG_INFO(http::method_to_string(stream->request.method), " ", stream->request.uri, " ",
+                                         static_cast<int>(resp.status));
+                    }
+                    respond_h2(conn, event.stream_id, std::move(resp));
+                    return;
+                }
+                case http::Http2Session::EventKind::RESET:
+                    conn.stream_readers.erase(event.stream_id);
+                    return;
+            }
+        }
+
+        // Runs the handler for a stream whose request is complete. BLOCKING and ASYNC requests
+        // take the request out of the stream, which then only waits for its response.
+        void dispatch_stream(Connection& conn, uint32_t stream_id) {
+            http::Http2Session::Stream* stream = conn.h2->find(stream_id);
+            if (!stream) return;
+            begin_stream(conn, *stream);
+            http::Request& req = stream->request;
+            Dispatch result;
+            try {
+                result = handler(req);
+            } catch (const std::exception& e) {
+                FASTAPI_LOG_ERROR("Error handling request: ", e.what());
+                result.response = http::HTTP_500_INTERNAL_SERVER_ERROR();
+            }
+            if (result.execution == Execution::BLOCKING) {
+                offload(conn, std::move(req), stream_id);
+                return;
+            }
+            if (result.execution == Execution::ASYNC) {
+                await_response(conn, stream_id);
+                run_async(this, conn.fd, conn.id, std::make_unique<http::Request>(std::move(req)), stream_id);
+                return;
+            }
+            FASTAPI_LOG_INFO(http::method_to_string(req.method), " ", req.uri, " ", static_cast<int>(result.response.status));
+            respond_h2(conn, stream_id, std::move(result.response));
+        }
+
+        // begin_request for a stream. Past max_requests_per_connection the session sends
+        // GOAWAY, and the client opens a new connection for later requests.
+        void begin_stream(Connection& conn, http::Http2Session::Stream& stream) {
+            conn.requests_served++;
+            if (config.compression_min_size > 0) {
+                stream.response_encoding = http::negotiate_encoding(http::find_header(stream.request, http::HeaderId::ACCEPT_ENCODING));
+            }
+            if (conn.requests_served >= config.max_requests_per_connection) conn.h2->shutdown();
+        }
+
+        // queue_response for a stream: compresses the body as negotiated and hands the response
+        // to the session. Ignored for a stream the client has reset meanwhile.
+        void respond_h2(Connection& conn, uint32_t stream_id, http::Response resp) {
+            http::Http2Session::Stream* stream = conn.h2->find(stream_id);
+            if (!stream) return;
+            http::ContentEncoding encoding = std::exchange(stream->response_encoding, http::ContentEncoding::IDENTITY);
+            if (encoding != http::ContentEncoding::IDENTITY && wants_compression(resp)) {
+                if (resp.body.size() >= config.compression_offload_size && blocking_pool) {
+                    compress_on_pool(conn, std::move(resp), encoding, stream_id);
+                    return;
+                }
+                compress_body(resp, encoding);
+            }
+            if (resp.prepared) resp.prepared = encoded_variant(resp, encoding);
+            Metrics::instance().count_status(static_cast<int>(resp.status));
+            conn.h2->respond(stream_id, std::move(resp));
+        }
+
+        // Bookkeeping for a request whose head has been framed, buffered or streamed alike.
+        void begin_request(Connection& conn, const http::Request& req) {
+            conn.requests_served++;
+            conn.request_version = req.version;
+            if (config.compression_min_size > 0) {
+                conn.response_encoding = http::negotiate_encoding(http::find_header(req, http::HeaderId::ACCEPT_ENCODING));
+            }
+            if (!http::keep_alive(req) || conn.requests_served >= config.max_requests_per_connection) {
+                conn.close_after_write = true;
+            }
+            if (Tracer::instance().enabled()) [[unlikely]] begin_trace(conn, req);
+        }
+
+        // Offers a request whose head has just been framed to body_reader_handler. Returns
+        // false when it declines, and the body is then buffered as usual.
+        bool open_upload(Connection& conn) {
+            conn.request_arena.reset();
+            std::optional<http::BodyReader> reader;
+            try {
+                conn.upload.emplace(conn.framer.take_head(conn.in_buffer.view(), &conn.request_memory));
+                reader = body_reader_handler(*conn.upload);
+            } catch (const std::exception& e) {
+                FASTAPI_LOG_ERROR("Error opening request body reader: ", e.what());
+            }
+            if (!reader) {
+                conn.upload.reset();
+                return false;
+            }
+            conn.framer.stream_body();
+            conn.in_buffer.consume(conn.framer.consumed());
+            conn.body_reader = std::move(reader);
+            begin_request(conn, *conn.upload);
+            if (http::iequals(http::find_header(*conn.upload, http::HeaderId::EXPECT), "100-continue")) {
+                std::string& tail = conn.output_tail();
+                size_t start = tail.size();
+                tail += "HTTP/1.1 100 Continue\r\n\r\n";
+                conn.count_output(tail.size() - start);
+            }
+            return true;
+        }
+
+        // Passes the body bytes buffered so far to the connection's BodyReader and answers the
+        // request once the body is complete. Returns false when it needs more input.
+        bool read_body(Connection& conn) {
+            http::Response resp;
+            while (true) {
+                std::string_view piece;
+                auto status = conn.framer.feed_body(conn.in_buffer.view(), piece);
+                if (status == http::RequestFramer::Status::ERROR) {
+                    FASTAPI_LOG_ERROR("Error framing request: ", static_cast<int>(conn.framer.error()));
+                    conn.close_after_write = true;
+                    resp = http::custom_response(conn.framer.error());
+                    break;
+                }
+                if (!piece.empty()) {
+                    try {
+                        conn.body_reader->on_data(piece);
+                    } catch (const std::exception& e) {
+                        FASTAPI_LOG_ERROR("Error handling request: ", e.what());
+                        conn.close_after_write = true;
+                        resp = http::HTTP_500_INTERNAL_SERVER_ERROR();
+                        break;
+                    }
+                }
+                conn.in_buffer.consume(conn.framer.consumed());
+                if (status == http::RequestFramer::Status::COMPLETE) {
+                    try {
+                        resp = conn.body_reader->on_end();
+                    } catch (const std::exception& e) {
+                        FASTAPI_LOG_ERROR("Error handling request: ", e.what());
+                        conn.close_after_write = true;
+                        resp = http::HTTP_500_INTERNAL_SERVER_ERROR();
+                    }
+                    break;
+                }
+                if (piece.empty()) return false;
+            }
+
+            if (conn.trace.started()) [[unlikely]] {
+                conn.trace[TracePoint::HANDLED] = Tracer::now_ns();
+                conn.input_started = conn.in_buffer.empty() ? 0 : conn.last_received;
+            }
+            FASTAPI_LOG_INFO(http::method_to_string(conn.upload->method), " ", conn.upload->uri, " ", static_cast<int>(resp.status));
+            conn.body_reader.reset();
+            conn.upload.reset();
+            conn.framer.reset();
+            queue_response(conn, std::move(resp));
+            return true;
+        }
+
+        void queue_response(Connection& conn, http::Response resp) {
+            if (conn.response_encoding != http::ContentEncoding::IDENTITY && wants_compression(resp)) {
+                if (resp.body.size() >= config.compression_offload_size && blocking_pool) {
+                    compress_on_pool(conn, std::move(resp), std::exchange(conn.response_encoding, http::ContentEncoding::IDENTITY));
+                    return;
+                }
+                compress_body(resp, conn.response_encoding);
+            }
+            Metrics& metrics = Metrics::instance();
+            metrics.count_status(static_cast<int>(resp.status));
+            if (conn.pending_output() == 0) conn.output_started = metrics.start();
+
+            if (resp.prepared) {
+                // Before `retained` moves: a pool job building the variant keeps its own reference.
+                const http::PreparedResponse* prepared = encoded_variant(resp, conn.response_encoding);
+                if (resp.retained) conn.retained.push_back(std::move(resp.retained));
+                conn.queue_external(prepared->head(!conn.close_after_write));
+                std::string& tail = conn.output_tail();
+                size_t date_start = tail.size();
+                http::DateCache::instance().append_to(tail);
+                tail += "\r\n";
+                conn.count_output(tail.size() - date_start);
+                conn.queue_external(prepared->content());
+            } else {
+                // Without chunked coding the only way to end a streamed body is to close.
+                if (resp.stream && conn.request_version.major == 1 && conn.request_version.minor == 0) {
+                    resp.version = {1, 0};
+                    conn.close_after_write = true;
+                }
+                std::string& tail = conn.output_tail();
+                size_t head_start = tail.size();
+                http::append_response_head(resp, !conn.close_after_write, tail);
+                conn.count_output(tail.size() - head_start);
+                FASTAPI_LOG_DEBUG("Sending response:\n", std::string_view(tail).substr(head_start), resp.body);
+                if (resp.file.fd >= 0) {
+                    if (resp.retained) conn.retained.push_back(std::move(resp.retained));
+                    conn.queue_file(resp.file);
+                } else if (resp.stream) {
+                    conn.stream_chunked = resp.version.major > 1 || resp.version.minor >= 1;
+                    queue_chunk(conn, std::move(resp.body));
+                    conn.body_stream = std::move(resp.stream);
+                } else {
+                    conn.queue_body(std::move(resp.body));
+                }
+            }
+
+            if (conn.trace.started()) [[unlikely]] {
+                conn.trace[TracePoint::BUILT] = Tracer::now_ns();
+                conn.trace.status = static_cast<int>(resp.status);
+                conn.unsent_traces.push_back(conn.trace);
+                conn.trace = {};
+            }
+        }
+
+        // Asks the streamed response's producer for chunks until stream_high_water bytes are
+        // pending or the body is complete. A producer that throws leaves the body truncated,
+        // so the connection is closed without the terminating chunk.
+        void pump_stream(Connection& conn) {
+            while (conn.body_stream && conn.pending_output() < config.stream_high_water) {
+                std::string chunk;
+                bool more;
+                try {
+                    more = conn.body_stream(chunk);
+                } catch (const std::exception& e) {
+                    FASTAPI_LOG_ERROR("Error streaming response: ", e.what());
+                    conn.body_stream = nullptr;
+                    conn.state = Connection::State::CLOSED;
+                    return;
+                }
+                queue_chunk(conn, std::move(chunk));
+                if (!more) {
+                    conn.body_stream = nullptr;
+                    if (conn.stream_chunked) {
+                        conn.output_tail() += "0\r\n\r\n";
+                        conn.count_output(5);
+                    }
+                }
+            }
+        }
+
+        void queue_chunk(Connection& conn, std::string&& data) {
+            if (data.empty()) return;
+            if (!conn.stream_chunked) {
+                conn.queue_body(std::move(data));
+                return;
+            }
+            char size_line[24];
+            char* end = std::to_chars(size_line, size_line + sizeof(size_line) - 2, data.size(), 16).ptr;
+            *end++ = '\r';
+            *end++ = '\n';
+            conn.output_tail().append(size_line, end);
+            conn.count_output(end - size_line);
+            conn.queue_body(std::move(data));
+            conn.output_tail() += "\r\n";
+            conn.count_output(2);
+        }
+
+        bool wants_compression(const http::Response& resp) const {
+            if (resp.prepared || resp.stream || resp.body.size() < config.compression_min_size) return false;
+            if (resp.headers.contains("Content-Encoding")) return false;
+            const std::string* type = resp.headers.find("Content-Type");
+            return http::compressible_type(type ? std::string_view(*type) : resp.content_type);
+        }
+
+        // Leaves the body as it is when compressing would not make it smaller.
+        static void compress_body(http::Response& resp, http::ContentEncoding encoding) {
+            std::optional<std::string> compressed = http::compress(encoding, resp.body);
+            if (!compressed || compressed->size() >= resp.body.size()) return;
+            resp.body = std::move(*compressed);
+            http::PreparedResponse::mark_encoded(resp, encoding);
+        }
+
+        // The compressed variant of a prepared response, built on first use. Large bodies are
+        // compressed on the blocking pool, and the identity body is sent until that is done.
+        const http::PreparedResponse* encoded_variant(const http::Response& resp, http::ContentEncoding encoding) {
+            const http::PreparedResponse* prepared = resp.prepared;
+            if (encoding == http::ContentEncoding::IDENTITY || prepared->content().size() < config.compression_min_size) {
+                return prepared;
+            }
+            if (const http::PreparedResponse* encoded = prepared->encoded(encoding)) return encoded;
+            if (!prepared->claim_encoding(encoding)) return prepared;
+            if (prepared->content().size() >= config.compression_offload_size && blocking_pool) {
+                // `retained` keeps a cached entry alive until the job has run.
+                if (!blocking_pool->try_submit([prepared, encoding, owner = resp.retained] { prepared->build_encoded(encoding); })) {
+                    prepared->release_encoding(encoding);
+                }
+                return prepared;
+            }
+            const http::PreparedResponse* encoded = prepared->build_encoded(encoding);
+            return encoded ? encoded : prepared;
+        }
+
+        // Large bodies are compressed off the I/O thread; the result comes back as a completion
+        // and is queued like any other response. The connection waits for it, as it would for
+        // a BLOCKING handler, so responses stay in order.
+        void compress_on_pool(Connection& conn, http::Response&& resp, http::ContentEncoding encoding, uint32_t stream_id = 0) {
+            auto job = std::make_shared<http::Response>(std::move(resp));
+            bool accepted = blocking_pool->try_submit([this, fd = conn.fd, id = conn.id, encoding, stream_id, job] {
+                compress_body(*job, encoding);
+                post_completion({fd, id, std::move(*job), stream_id});
+            });
+            if (accepted) {
+                await_response(conn, stream_id);
+                return;
+            }
+            compress_body(*job, encoding);
+            if (stream_id) {
+                respond_h2(conn, stream_id, std::move(*job));
+            } else {
+                queue_response(conn, std::move(*job));
+            }
+        }
+
+        // Stamps a request that has just been framed. Bytes left in in_buffer arrived with the
+        // last read, which is as close as we get to the next pipelined request's first byte.
+        void begin_trace(Connection& conn, const http::Request& req) {
+            RequestTrace& trace = conn.trace;
+            trace = {};
+            trace.connection_id = conn.id;
+            trace.request_index = conn.requests_served;
+            trace.set_label(req.method, req.uri);
+            trace[TracePoint::ACCEPTED] = conn.accepted_at;
+            trace[TracePoint::FIRST_BYTE] = conn.input_started;
+            trace[TracePoint::PARSED] = Tracer::now_ns();
+            conn.input_started = conn.in_buffer.empty() ? 0 : conn.last_received;
+        }
+
+        void finish_traces(Connection& conn) {
+            uint64_t now = Tracer::now_ns();
+            for (RequestTrace& trace : conn.unsent_traces) {
+                trace[TracePoint::LAST_BYTE] = now;
+                Tracer::instance().finish(trace);
+            }
+            conn.unsent_traces.clear();
+        }
+
+        // Sends pending segments with scatter/gather I/O until the socket stops accepting; file
+        // segments go out with sendfile. Leaves the connection WRITING on EAGAIN; once drained
+        // it goes back to READING, or CLOSED after a final response.
+        void flush(Connection& conn) {
+#if defined(FASTAPI_HAS_IO_URING)
+            if (ring) {
+                submit_output(conn);
+                return;
+            }
+#endif
+#if defined(MSG_NOSIGNAL)
+            constexpr int send_flags = MSG_NOSIGNAL;
+#else
+            constexpr int send_flags = 0;
+#endif
+            while (conn.pending_output() > 0) {
+                ssize_t n;
+                if (conn.out_segments[conn.out_front].is_file()) {
+                    n = send_file(conn, conn.out_segments[conn.out_front].file, conn.out_offset);
+                    if (n == 0) {
+                        FASTAPI_LOG_ERROR("File shrank while being sent");
+                        conn.state = Connection::State::CLOSED;
+                        return;
+                    }
+                } else {
+                    iovec iov[max_send_iov];
+                    size_t count = 0;
+                    for (size_t i = conn.out_front; i < conn.out_segments.size() && count < max_send_iov; i++) {
+                        const OutputSegment& segment = conn.out_segments[i];
+                        if (segment.is_file()) break;
+                        size_t skip = i == conn.out_front ? conn.out_offset : 0;
+                        iov[count++] = {const_cast<char*>(segment.data()) + skip, segment.size() - skip};
+                    }
+                    msghdr message{};
+                    message.msg_iov = iov;
+                    message.msg_iovlen = count;
+                    n = sendmsg(conn.fd, &message, send_flags);
+                }
+                if (n >= 0) {
+                    conn.consume_output(n);
+                    Metrics::instance().add_bytes_out(n);
+                    continue;
+                }
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                FASTAPI_LOG_ERROR("Send failed: errno ", errno);
+                conn.state = Connection::State::CLOSED;
+                return;
+            }
+            output_drained(conn);
+        }
+
+        // Everything queued has been sent: the connection reads again, or closes after a
+        // final response.
+        void output_drained(Connection& conn) {
+            conn.clear_output();
+            if (conn.body_stream) {
+                // Drained mid-stream: process() asks the producer for more.
+                conn.state = Connection::State::READING;
+                return;
+            }
+            if (!conn.unsent_traces.empty()) [[unlikely]] finish_traces(conn);
+            Metrics::instance().observe_since(Phase::SEND, std::exchange(conn.output_started, 0));
+            conn.state = conn.close_after_write && !conn.awaiting_handler && !conn.body_reader ? Connection::State::CLOSED
+                                                                                                : Connection::State::READING;
+        }
+
+        // Sends part of a file segment from the page cache. Without sendfile (non-Linux) the
+        // bytes go through a stack buffer instead.
+        static ssize_t send_file(Connection& conn, const http::FileBody& file, size_t sent) {
+            constexpr size_t max_chunk = 1 << 20;
+            size_t remaining = std::min<uint64_t>(file.length - sent, max_chunk);
+#if defined(__linux__)
+            off_t offset = static_cast<off_t>(file.offset + sent);
+            return sendfile(conn.fd, file.fd, &offset, remaining);
+#else
+            char chunk[16 * 1024];
+            ssize_t n = pread(file.fd, chunk, std::min(remaining, sizeof(chunk)), static_cast<off_t>(file.offset + sent));
+            if (n <= 0) return n;
+            return send(conn.fd, chunk, n, 0);
+#endif
+        }
+
+        // Puts the connection under the deadline that fits what it is waiting for. IDLE and
+        // HEADER run from the moment they start, so trickling bytes cannot extend them; BODY
+        // and SEND are re-armed whenever bytes move, so they bound a stall, not a transfer.
+        void refresh_deadline(Connection& conn) {
+            ConnectionDeadline kind = ConnectionDeadline::NONE;
+            uint64_t progress = 0;
+            std::chrono::milliseconds timeout{0};
+            if (conn.pending_output() > 0 || conn.body_stream || (conn.h2 && conn.h2->sending_data())) {
+                kind = ConnectionDeadline::SEND;
+                progress = conn.bytes_sent;
+                timeout = config.send_timeout;
+            } else if (conn.awaiting_handler) {
+                kind = ConnectionDeadline::NONE;
+            } else if (conn.body_reader || conn.framer.in_body() || (conn.h2 && conn.h2->receiving())) {
+                kind = ConnectionDeadline::BODY;
+                progress = conn.bytes_received;
+                timeout = config.body_timeout;
+            } else if (conn.h2 && conn.h2->open_streams() > 0) {
+                kind = ConnectionDeadline::NONE;   // streams waiting for their handler
+            } else if (!conn.in_buffer.empty()) {
+                kind = ConnectionDeadline::HEADER;
+                progress = conn.requests_served;
+                timeout = config.header_timeout;
+            } else {
+                kind = ConnectionDeadline::IDLE;
+                progress = conn.requests_served;
+                timeout = config.keep_alive_timeout;
+            }
+            if (kind == conn.deadline_kind && progress == conn.deadline_progress) return;
+            conn.deadline_kind = kind;
+            conn.deadline_progress = progress;
+            if (kind == ConnectionDeadline::NONE) {
+                deadlines.cancel(conn.deadline);
+            } else {
+                deadlines.schedule(conn.deadline, std::chrono::steady_clock::now() + timeout);
+            }
+        }
+
+        void expire_deadlines(std::chrono::steady_clock::time_point now) {
+            deadlines.expire(now, [this](TimerWheel::Node& node) { expired.push_back(static_cast<int>(node.data)); });
+            for (int fd : expired) {
+                auto it = connections.find(fd);
+                if (it != connections.end()) on_deadline(it->second);
+            }
+            expired.clear();
+        }
+
+        // A request that stalled is answered with 408 when nothing else is queued ahead of it;
+        // an idle connection, or one whose client stopped reading, is just closed.
+        void on_deadline(Connection& conn) {
+            ConnectionDeadline kind = conn.deadline_kind;
+            conn.deadline_kind = ConnectionDeadline::NONE;
+            if (conn.state == Connection::State::CLOSED) return;
+            FASTAPI_LOG_DEBUG("Connection ", conn.id, " timed out in state ", static_cast<int>(kind));
+            if (conn.h2 && kind != ConnectionDeadline::SEND) {
+                // HTTP/2 has no 408: the stalled or idle connection is closed with a GOAWAY.
+                conn.h2->shutdown();
+                conn.queue_body(conn.h2->take_output());
+                conn.close_after_write = true;
+                conn.state = Connection::State::WRITING;
+                flush(conn);
+            } else if ((kind == ConnectionDeadline::HEADER || kind == ConnectionDeadline::BODY) && conn.pending_output() == 0) {
+                conn.body_reader.reset();
+                conn.upload.reset();
+                conn.framer.reset();
+                conn.close_after_write = true;
+                FASTAPI_LOG_INFO("Request timed out: 408");
+                queue_response(conn, timeout_response());
+                conn.state = Connection::State::WRITING;
+                flush(conn);
+            } else {
+                conn.state = Connection::State::CLOSED;
+            }
+            if (conn.state == Connection::State::CLOSED) {
+                close_connection(conn.fd);
+            } else {
+                refresh_deadline(conn);
+            }
+        }
+
+        void close_connection(int fd) {
+#if defined(FASTAPI_HAS_IO_URING)
+            if (ring) {
+                close_uring_connection(fd);
+                return;
+            }
+#endif
+            Metrics::instance().connection_closed();
+            loop.remove(fd);
+            close(fd);
+            connections.erase(fd);
+        }
+
+#if defined(FASTAPI_HAS_IO_URING)
+        static uint64_t uring_tag(UringOp op, int fd, uint64_t connection_id = 0) {
+            return static_cast<uint64_t>(op) << 56 | static_cast<uint64_t>(fd & 0xffffff) << 32 | (connection_id & 0xffffffff);
+        }
+
+        bool start_uring() {
+            try {
+                ring = std::make_unique<IoUring>(uring_entries, uring_buffer_count, uring_buffer_size);
+            } catch (const std::exception& e) {
+                FASTAPI_LOG_ERROR("io_uring unavailable, using the event loop: ", e.what());
+                return false;
+            }
+            loop.remove(listen_fd);
+            ring->accept_multishot(listen_fd, uring_tag(UringOp::ACCEPT, listen_fd));
+            ring->poll(loop.native_handle(), POLLIN, true, uring_tag(UringOp::EVENT_LOOP, loop.native_handle()));
+            return true;
+        }
+
+        void run_uring() {
+            std::vector<Event> events;
+            IoContext::current() = &io;
+            while (running) {
+                ring->wait(io.wait_timeout(deadline_tick.count(), std::chrono::steady_clock::now()));
+                http::DateCache::instance().refresh();
+                io.run_expired_timers(std::chrono::steady_clock::now());
+                ring->for_each_completion([&](const io_uring_cqe& cqe) { on_completion(cqe, events); });
+
+                deliver_async_completions();
+                expire_deadlines(std::chrono::steady_clock::now());
+            }
+            IoContext::current() = nullptr;
+        }
+
+        void on_completion(const io_uring_cqe& cqe, std::vector<Event>& events) {
+            auto op = static_cast<UringOp>(cqe.user_data >> 56);
+            int fd = static_cast<int>((cqe.user_data >> 32) & 0xffffff);
+            switch (op) {
+                case UringOp::ACCEPT:
+                    if (cqe.res >= 0) {
+                        if (admit(cqe.res)) {
+                            arm_recv(add_connection(cqe.res));
+                        }
+                    } else if (cqe.res != -EAGAIN && cqe.res != -EINTR) {
+                        FASTAPI_LOG_ERROR("Accept failed: errno ", -cqe.res);
+                    }
+                    if (!IoUring::more(cqe)) ring->accept_multishot(listen_fd, uring_tag(UringOp::ACCEPT, listen_fd));
+                    return;
+                case UringOp::EVENT_LOOP:
+                    while (loop.wait(events, 0) > 0) {
+                        for (const auto& event : events) {
+                            if (io.dispatch(event)) continue;
+                            if (event.fd == wake_read_fd) deliver_completions();
+                        }
+                    }
+                    if (!IoUring::more(cqe)) ring->poll(fd, POLLIN, true, uring_tag(UringOp::EVENT_LOOP, fd));
+                    return;
+                case UringOp::CLOSE:
+                    return;
+                default:
+                    break;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end() || (it->second.id & 0xffffffff) != (cqe.user_data & 0xffffffff)) {
+                if (IoUring::has_buffer(cqe)) ring->recycle(IoUring::buffer_id(cqe));
+                return;
+            }
+            Connection& conn = it->second;
+            if (op == UringOp::RECV) {
+                on_received(conn, cqe);
+            } else {
+                conn.send_in_flight = false;
+                if (op == UringOp::SEND && cqe.res >= 0) {
+                    conn.consume_output(cqe.res);
+                    Metrics::instance().add_bytes_out(cqe.res);
+                } else if (op == UringOp::SEND && cqe.res != -EINTR && cqe.res != -EAGAIN) {
+                    if (cqe.res != -ECANCELED) FASTAPI_LOG_ERROR("Send failed: errno ", -cqe.res);
+                    conn.state = Connection::State::CLOSED;
+                }
+                if (conn.state == Connection::State::WRITING) {
+                    flush(conn);
+                    process(conn);
+                    resume_reading(conn);
+                }
+            }
+            if (conn.state == Connection::State::CLOSED) {
+                close_connection(conn.fd);
+            } else {
+                refresh_deadline(conn);
+            }
+        }
+
+        // Counterpart of on_readable for one multishot receive completion. The bytes are
+        // copied out of the provided buffer so it can go straight back to the kernel.
+        void on_received(Connection& conn, const io_uring_cqe& cqe) {
+            if (!IoUring::more(cqe)) conn.recv_armed = false;
+            if (cqe.res > 0) {
+                unsigned id = IoUring::buffer_id(cqe);
+                conn.in_buffer.append(ring->buffer(id, cqe.res));
+                ring->recycle(id);
+                note_received(conn, cqe.res);
+                if (conn.read_paused && conn.in_buffer.size() > paused_input_limit()) {
+                    FASTAPI_LOG_ERROR("Connection ", conn.id, " sent too much input while paused");
+                    conn.state = Connection::State::CLOSED;
+                    return;
+                }
+                process(conn);
+                if (conn.in_buffer.empty()) conn.in_buffer.release();
+            } else if (cqe.res == 0) {
+                conn.peer_closed = true;
+                process(conn);
+            } else if (cqe.res == -ECANCELED && conn.state != Connection::State::CLOSED) {
+                // Cancelled by pause_reading; re-armed below if the pause is already over.
+            } else if (cqe.res != -ENOBUFS) {
+                if (cqe.res != -ECANCELED) FASTAPI_LOG_ERROR("Read failed: errno ", -cqe.res);
+                conn.state = Connection::State::CLOSED;
+                return;
+            }
+            if (conn.state == Connection::State::CLOSED || pause_reading(conn)) return;
+            // Re-armed when the kernel ended it early, e.g. for lack of provided buffers, or
+            // when it was cancelled by a pause that has since ended.
+            if (!conn.recv_armed && !conn.peer_closed) arm_recv(conn);
+        }
+
+        void arm_recv(Connection& conn) {
+            ring->recv_multishot(conn.fd, uring_tag(UringOp::RECV, conn.fd, conn.id));
+            conn.recv_armed = true;
+        }
+
+        // io_uring counterpart of flush(): queues one sendmsg for the pending segments and
+        // returns with the connection still WRITING; its completion consumes what was sent
+        // and calls flush() again. File segments still go out with sendfile, waiting on a
+        // poll request when the socket is full.
+        void submit_output(Connection& conn) {
+            if (conn.send_in_flight) return;
+            while (conn.pending_output() > 0 && conn.out_segments[conn.out_front].is_file()) {
+                ssize_t n = send_file(conn, conn.out_segments[conn.out_front].file, conn.out_offset);
+                if (n > 0) {
+                    conn.consume_output(n);
+                    Metrics::instance().add_bytes_out(n);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    ring->poll(conn.fd, POLLOUT, false, uring_tag(UringOp::POLL_OUT, conn.fd, conn.id));
+                    conn.send_in_flight = true;
+                    return;
+                }
+                if (n == 0) {
+                    FASTAPI_LOG_ERROR("File shrank while being sent");
+                } else {
+                    FASTAPI_LOG_ERROR("Send failed: errno ", errno);
+                }
+                conn.state = Connection::State::CLOSED;
+                return;
+            }
+            if (conn.pending_output() == 0) {
+                output_drained(conn);
+                return;
+            }
+
+            conn.send_iov.clear();
+            for (size_t i = conn.out_front; i < conn.out_segments.size() && conn.send_iov.size() < max_send_iov; i++) {
+                const OutputSegment& segment = conn.out_segments[i];
+                if (segment.is_file()) break;
+                size_t skip = i == conn.out_front ? conn.out_offset : 0;
+                conn.send_iov.push_back({const_cast<char*>(segment.data()) + skip, segment.size() - skip});
+            }
+            conn.send_message = {};
+            conn.send_message.msg_iov = conn.send_iov.data();
+            conn.send_message.msg_iovlen = conn.send_iov.size();
+            // Responses queued before the completion go into a new segment, not into this tail.
+            conn.tail_open = false;
+            ring->sendmsg(conn.fd, &conn.send_message, MSG_NOSIGNAL, uring_tag(UringOp::SEND, conn.fd, conn.id));
+            conn.send_in_flight = true;
+        }
+
+        void close_uring_connection(int fd) {
+            auto it = connections.find(fd);
+            if (it == connections.end()) return;
+            if (it->second.send_in_flight) {
+                // The kernel may still be reading this connection's output: cancel, and close
+                // once the completion is in.
+                it->second.state = Connection::State::CLOSED;
+                ring->cancel_fd(fd, uring_tag(UringOp::CLOSE, fd));
+                return;
+            }
+            Metrics::instance().connection_closed();
+            ring->cancel_and_close(fd, uring_tag(UringOp::CLOSE, fd));
+            connections.erase(it);
+        }
+#endif
+    };
+}
+
+#endif //SERVERC___WORKER_H
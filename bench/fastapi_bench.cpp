@@ -0,0 +1,522 @@
+// Tomas Costantino
+//
+// fastapi_bench: HTTP/1.1 load generator for a running FastAPI_CPP server.
+//
+//   fastapi_bench [--host 127.0.0.1] [--port 8000] [-t threads] [-c connections] [-p depth]
+//                 [-d seconds] [--warmup seconds] [-R requests_per_second]
+//                 [-r "weight:METHOD /path [body]"]... [--json]
+//
+// Closed loop (the default) keeps `depth` requests in flight on every connection and sends
+// the next one as soon as a response arrives. With -R the run is open loop: requests are
+// scheduled at a fixed total rate, and latency is measured from the scheduled send time, so
+// a server that falls behind shows it in the tail instead of silently slowing the client.
+// Without -r the mix exercises the routes registered in main.cpp.
+
+#include "../FastAPI_CPP/event_loop.h"
+#include "hdr_histogram.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+#include <vector>
+
+namespace fastapi_bench {
+
+    using Clock = std::chrono::steady_clock;
+
+    inline int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    struct RequestSpec {
+        unsigned weight = 1;
+        std::string method;
+        std::string target;
+        std::string body;
+        std::string wire;     // the serialized request, built once
+    };
+
+    struct Options {
+        std::string host = "127.0.0.1";
+        int port = 8000;
+        unsigned threads = 1;
+        unsigned connections = 16;
+        unsigned depth = 1;
+        double duration = 10;
+        double warmup = 1;
+        double rate = 0;      // total requests per second; 0 means closed loop
+        bool json = false;
+        std::vector<RequestSpec> mix;
+    };
+
+    struct Stats {
+        HdrHistogram latency{1, 60'000'000'000LL, 3};   // nanoseconds, up to one minute
+        uint64_t completed = 0;
+        uint64_t status_classes[6] = {};
+        uint64_t bytes = 0;
+        uint64_t socket_errors = 0;
+        uint64_t reconnects = 0;
+
+        void merge(const Stats& other) {
+            latency.merge(other.latency);
+            completed += other.completed;
+            for (int i = 0; i < 6; i++) status_classes[i] += other.status_classes[i];
+            bytes += other.bytes;
+            socket_errors += other.socket_errors;
+            reconnects += other.reconnects;
+        }
+    };
+
+    // "8:GET /users/1" or "1:POST /items {\"name\":\"x\",\"price\":1}"
+    inline RequestSpec parse_spec(std::string_view text) {
+        RequestSpec spec;
+        if (size_t colon = text.find(':'); colon != std::string_view::npos && colon < text.find(' ')) {
+            spec.weight = static_cast<unsigned>(std::strtoul(std::string(text.substr(0, colon)).c_str(), nullptr, 10));
+            text.remove_prefix(colon + 1);
+        }
+        size_t space = text.find(' ');
+        if (space == std::string_view::npos || spec.weight == 0) {
+            throw std::invalid_argument("Request spec must look like 'weight:METHOD /path [body]'");
+        }
+        spec.method = std::string(text.substr(0, space));
+        text.remove_prefix(space + 1);
+        size_t body_start = text.find(' ');
+        spec.target = std::string(text.substr(0, body_start));
+        if (body_start != std::string_view::npos) spec.body = std::string(text.substr(body_start + 1));
+        return spec;
+    }
+
+    inline std::vector<RequestSpec> default_mix() {
+        return {
+                parse_spec("6:GET /"),
+                parse_spec("1:GET /param_query?a=1&b=2"),
+                parse_spec("1:GET /echo/bench"),
+                parse_spec("1:GET /users/42/posts/hello-world"),
+                parse_spec(R"(1:POST /echo {"x":1,"y":"z"})"),
+                parse_spec(R"(1:POST /items {"name":"bench","price":9.5,"quantity":2,"tags":["a","b"]})"),
+        };
+    }
+
+    inline void serialize(RequestSpec& spec, const Options& options) {
+        spec.wire = spec.method + " " + spec.target + " HTTP/1.1\r\nHost: " + options.host + ":" +
+                    std::to_string(options.port) + "\r\nUser-Agent: fastapi_bench\r\nAccept: */*\r\n";
+        if (!spec.body.empty()) {
+            spec.wire += "Content-Type: application/json\r\nContent-Length: " + std::to_string(spec.body.size()) + "\r\n";
+        }
+        spec.wire += "\r\n";
+        spec.wire += spec.body;
+    }
+
+    inline bool iequals(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); i++) {
+            char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] + 32 : a[i];
+            char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] + 32 : b[i];
+            if (x != y) return false;
+        }
+        return true;
+    }
+
+    // Drives a share of the connections from one thread on its own event loop.
+    class LoadThread {
+    public:
+        LoadThread(const Options& run_options, const addrinfo& server_address, unsigned connection_count,
+                   unsigned seed, int64_t measure_start, int64_t measure_end)
+                : options(run_options), address(server_address), start_ns(measure_start), end_ns(measure_end) {
+            conns.resize(connection_count);
+            for (unsigned w = 0, i = 0; i < options.mix.size(); i++) {
+                w += options.mix[i].weight;
+                cumulative_weights.push_back(w);
+            }
+            double per_connection_rate = options.rate / (options.connections ? options.connections : 1);
+            interval_ns = options.rate > 0 ? static_cast<int64_t>(1e9 / per_connection_rate) : 0;
+            int64_t now = now_ns();
+            for (size_t i = 0; i < conns.size(); i++) {
+                conns[i].rng = 0x9E3779B97F4A7C15ull * (seed * 1000003ull + i + 1);
+                conns[i].next_send = now + (interval_ns ? static_cast<int64_t>(i) * interval_ns / static_cast<int64_t>(conns.size()) : 0);
+                open(conns[i]);
+            }
+        }
+
+        ~LoadThread() {
+            for (auto& conn : conns) {
+                if (conn.fd >= 0) close(conn.fd);
+            }
+        }
+
+        void run() {
+            std::vector<fastapi_cpp::Event> events;
+            while (true) {
+                int64_t now = now_ns();
+                if (now >= end_ns) break;
+                if (interval_ns) {
+                    for (auto& conn : conns) {
+                        while (conn.next_send <= now) {
+                            conn.backlog.push_back(conn.next_send);
+                            conn.next_send += interval_ns;
+                        }
+                        fill(conn, now);
+                    }
+                }
+                loop.wait(events, interval_ns ? 1 : 100);
+                for (const auto& event : events) {
+                    Conn* conn = find(event.fd);
+                    if (!conn) continue;
+                    if (event.flags & fastapi_cpp::EVENT_ERROR) {
+                        reconnect(*conn, true);
+                        continue;
+                    }
+                    if ((event.flags & fastapi_cpp::EVENT_WRITE) && !conn->connected && !finish_connect(*conn)) continue;
+                    if (event.flags & fastapi_cpp::EVENT_READ) read_responses(*conn);
+                    if (conn->fd >= 0) flush(*conn);
+                }
+            }
+        }
+
+        const Stats& stats() const { return totals; }
+
+    private:
+        struct InFlight {
+            size_t spec;
+            int64_t start;
+        };
+
+        struct Conn {
+            int fd = -1;
+            bool connected = false;
+            uint64_t rng = 1;
+            int64_t next_send = 0;
+            std::deque<int64_t> backlog;      // open loop: scheduled sends not yet issued
+            std::deque<InFlight> in_flight;
+            std::string out;
+            size_t out_offset = 0;
+            std::string in;
+        };
+
+        const Options& options;
+        const addrinfo& address;
+        int64_t start_ns;
+        int64_t end_ns;
+        int64_t interval_ns = 0;
+        fastapi_cpp::EventLoop loop;
+        std::vector<Conn> conns;
+        std::unordered_map<int, Conn*> by_fd;
+        std::vector<unsigned> cumulative_weights;
+        Stats totals;
+
+        Conn* find(int fd) {
+            auto it = by_fd.find(fd);
+            return it == by_fd.end() ? nullptr : it->second;
+        }
+
+        size_t pick(Conn& conn) {
+            conn.rng ^= conn.rng << 13;
+            conn.rng ^= conn.rng >> 7;
+            conn.rng ^= conn.rng << 17;
+            unsigned ticket = static_cast<unsigned>(conn.rng % cumulative_weights.back());
+            size_t i = 0;
+            while (cumulative_weights[i] <= ticket) i++;
+            return i;
+        }
+
+        void open(Conn& conn) {
+            conn.fd = socket(address.ai_family, address.ai_socktype, address.ai_protocol);
+            if (conn.fd < 0) throw std::runtime_error("socket() failed");
+            fastapi_cpp::set_nonblocking(conn.fd);
+            int one = 1;
+            setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (connect(conn.fd, address.ai_addr, address.ai_addrlen) < 0 && errno != EINPROGRESS) {
+                throw std::runtime_error(std::string("connect() failed: ") + std::strerror(errno));
+            }
+            conn.connected = false;
+            by_fd[conn.fd] = &conn;
+            loop.add(conn.fd);
+            fill(conn, now_ns());
+        }
+
+        bool finish_connect(Conn& conn) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0) {
+                reconnect(conn, true);
+                return false;
+            }
+            conn.connected = true;
+            return true;
+        }
+
+        // Requests that were sent but not answered are sent again on the new connection,
+        // keeping their original start times.
+        void reconnect(Conn& conn, bool failed) {
+            if (failed) totals.socket_errors++;
+            totals.reconnects++;
+            loop.remove(conn.fd);
+            by_fd.erase(conn.fd);
+            close(conn.fd);
+            conn.in.clear();
+            conn.out.clear();
+            conn.out_offset = 0;
+            std::deque<InFlight> unanswered;
+            unanswered.swap(conn.in_flight);
+            for (const auto& request : unanswered) {
+                conn.out += options.mix[request.spec].wire;
+                conn.in_flight.push_back(request);
+            }
+            if (failed) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            open(conn);
+        }
+
+        void fill(Conn& conn, int64_t now) {
+            while (conn.in_flight.size() < options.depth) {
+                int64_t start = now;
+                if (interval_ns) {
+                    if (conn.backlog.empty()) break;
+                    start = conn.backlog.front();
+                    conn.backlog.pop_front();
+                }
+                size_t spec = pick(conn);
+                conn.out += options.mix[spec].wire;
+                conn.in_flight.push_back({spec, start});
+            }
+            if (conn.connected) flush(conn);
+        }
+
+        void flush(Conn& conn) {
+            while (conn.out_offset < conn.out.size()) {
+                ssize_t n = send(conn.fd, conn.out.data() + conn.out_offset, conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+                if (n > 0) {
+                    conn.out_offset += n;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+                reconnect(conn, true);
+                return;
+            }
+            conn.out.clear();
+            conn.out_offset = 0;
+        }
+
+        void read_responses(Conn& conn) {
+            char chunk[65536];
+            bool closed = false;
+            while (true) {
+                ssize_t n = recv(conn.fd, chunk, sizeof(chunk), 0);
+                if (n > 0) {
+                    conn.in.append(chunk, n);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                closed = true;
+                break;
+            }
+
+            size_t offset = 0;
+            bool server_closing = false;
+            while (!server_closing) {
+                size_t consumed = 0;
+                int status = 0;
+                if (!parse_response(std::string_view(conn.in).substr(offset), consumed, status, server_closing)) break;
+                offset += consumed;
+                complete(conn, status, consumed);
+            }
+            conn.in.erase(0, offset);
+
+            if (closed || server_closing) {
+                reconnect(conn, !server_closing);
+                return;
+            }
+            fill(conn, now_ns());
+        }
+
+        void complete(Conn& conn, int status, size_t bytes) {
+            if (conn.in_flight.empty()) return;
+            InFlight request = conn.in_flight.front();
+            conn.in_flight.pop_front();
+            int64_t done = now_ns();
+            if (request.start < start_ns || done > end_ns) return;
+            totals.latency.record(done - request.start);
+            totals.completed++;
+            totals.bytes += bytes;
+            int status_class = status / 100;
+            totals.status_classes[status_class >= 1 && status_class <= 5 ? status_class : 0]++;
+        }
+
+        // Frames one response with a Content-Length body (or none). Returns false if more
+        // bytes are needed.
+        static bool parse_response(std::string_view data, size_t& consumed, int& status, bool& closing) {
+            size_t head_end = data.find("\r\n\r\n");
+            if (head_end == std::string_view::npos) return false;
+            std::string_view head = data.substr(0, head_end);
+            if (head.size() < 12 || head.substr(0, 5) != "HTTP/") {
+                throw std::runtime_error("Malformed response from server");
+            }
+            status = (head[9] - '0') * 100 + (head[10] - '0') * 10 + (head[11] - '0');
+
+            size_t content_length = 0;
+            size_t line = head.find("\r\n");
+            while (line != std::string_view::npos) {
+                line += 2;
+                size_t end = head.find("\r\n", line);
+                std::string_view field = head.substr(line, end == std::string_view::npos ? std::string_view::npos : end - line);
+                size_t colon = field.find(':');
+                if (colon != std::string_view::npos) {
+                    std::string_view name = field.substr(0, colon);
+                    std::string_view value = field.substr(colon + 1);
+                    while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+                    if (iequals(name, "Content-Length")) {
+                        content_length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+                    } else if (iequals(name, "Connection") && iequals(value, "close")) {
+                        closing = true;
+                    }
+                }
+                line = end;
+            }
+            size_t total = head_end + 4 + content_length;
+            if (data.size() < total) {
+                closing = false;
+                return false;
+            }
+            consumed = total;
+            return true;
+        }
+    };
+
+    inline void print_usage() {
+        std::fprintf(stderr,
+                     "usage: fastapi_bench [--host H] [--port P] [-t threads] [-c connections] [-p depth]\n"
+                     "                     [-d seconds] [--warmup seconds] [-R rate] [-r \"w:METHOD /path [body]\"]... [--json]\n");
+    }
+
+    inline Options parse_options(int argc, char** argv) {
+        Options options;
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg = argv[i];
+            auto value = [&]() -> std::string_view {
+                if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + std::string(arg));
+                return argv[++i];
+            };
+            if (arg == "--host") options.host = std::string(value());
+            else if (arg == "--port") options.port = std::atoi(std::string(value()).c_str());
+            else if (arg == "-t" || arg == "--threads") options.threads = std::atoi(std::string(value()).c_str());
+            else if (arg == "-c" || arg == "--connections") options.connections = std::atoi(std::string(value()).c_str());
+            else if (arg == "-p" || arg == "--pipeline") options.depth = std::atoi(std::string(value()).c_str());
+            else if (arg == "-d" || arg == "--duration") options.duration = std::atof(std::string(value()).c_str());
+            else if (arg == "--warmup") options.warmup = std::atof(std::string(value()).c_str());
+            else if (arg == "-R" || arg == "--rate") options.rate = std::atof(std::string(value()).c_str());
+            else if (arg == "-r" || arg == "--request") options.mix.push_back(parse_spec(value()));
+            else if (arg == "--json") options.json = true;
+            else throw std::invalid_argument("Unknown option " + std::string(arg));
+        }
+        if (options.threads == 0 || options.connections == 0 || options.depth == 0 || options.duration <= 0) {
+            throw std::invalid_argument("threads, connections, pipeline depth and duration must be positive");
+        }
+        options.threads = std::min(options.threads, options.connections);
+        if (options.mix.empty()) options.mix = default_mix();
+        for (auto& spec : options.mix) serialize(spec, options);
+        return options;
+    }
+
+    inline void report(const Options& options, const Stats& stats) {
+        const HdrHistogram& h = stats.latency;
+        double seconds = options.duration;
+        double reqs = static_cast<double>(stats.completed) / seconds;
+        double mbytes = static_cast<double>(stats.bytes) / seconds / (1024.0 * 1024.0);
+        auto us = [](int64_t ns) { return static_cast<double>(ns) / 1000.0; };
+        if (options.json) {
+            std::printf("{\"host\":\"%s\",\"port\":%d,\"threads\":%u,\"connections\":%u,\"pipeline\":%u,"
+                        "\"mode\":\"%s\",\"rate\":%.1f,\"duration_s\":%.3f,\"requests\":%llu,\"requests_per_s\":%.1f,"
+                        "\"mb_per_s\":%.3f,\"status\":{\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,\"5xx\":%llu,\"other\":%llu},"
+                        "\"socket_errors\":%llu,\"reconnects\":%llu,\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,"
+                        "\"p90\":%.1f,\"p99\":%.1f,\"p99_9\":%.1f,\"max\":%.1f}}\n",
+                        options.host.c_str(), options.port, options.threads, options.connections, options.depth,
+                        options.rate > 0 ? "open" : "closed", options.rate, seconds,
+                        static_cast<unsigned long long>(stats.completed), reqs, mbytes,
+                        static_cast<unsigned long long>(stats.status_classes[1]), static_cast<unsigned long long>(stats.status_classes[2]),
+                        static_cast<unsigned long long>(stats.status_classes[3]), static_cast<unsigned long long>(stats.status_classes[4]),
+                        static_cast<unsigned long long>(stats.status_classes[5]), static_cast<unsigned long long>(stats.status_classes[0]),
+                        static_cast<unsigned long long>(stats.socket_errors), static_cast<unsigned long long>(stats.reconnects),
+                        us(h.min()), h.mean() / 1000.0, us(h.value_at_percentile(50)), us(h.value_at_percentile(90)),
+                        us(h.value_at_percentile(99)), us(h.value_at_percentile(99.9)), us(h.max()));
+            return;
+        }
+        std::printf("fastapi_bench %s:%d  %u threads, %u connections, pipeline %u, %s loop",
+                    options.host.c_str(), options.port, options.threads, options.connections, options.depth,
+                    options.rate > 0 ? "open" : "closed");
+        if (options.rate > 0) std::printf(" at %.0f req/s", options.rate);
+        std::printf(", %.1fs\n", seconds);
+        std::printf("  requests   %llu  (%.1f req/s, %.2f MiB/s)\n", static_cast<unsigned long long>(stats.completed), reqs, mbytes);
+        std::printf("  status     2xx %llu  3xx %llu  4xx %llu  5xx %llu  other %llu\n",
+                    static_cast<unsigned long long>(stats.status_classes[2]), static_cast<unsigned long long>(stats.status_classes[3]),
+                    static_cast<unsigned long long>(stats.status_classes[4]), static_cast<unsigned long long>(stats.status_classes[5]),
+                    static_cast<unsigned long long>(stats.status_classes[0] + stats.status_classes[1]));
+        std::printf("  sockets    %llu errors, %llu reconnects\n",
+                    static_cast<unsigned long long>(stats.socket_errors), static_cast<unsigned long long>(stats.reconnects));
+        std::printf("  latency    min %.1fus  mean %.1fus  p50 %.1fus  p90 %.1fus  p99 %.1fus  p99.9 %.1fus  max %.1fus\n",
+                    us(h.min()), h.mean() / 1000.0, us(h.value_at_percentile(50)), us(h.value_at_percentile(90)),
+                    us(h.value_at_percentile(99)), us(h.value_at_percentile(99.9)), us(h.max()));
+    }
+}
+
+int main(int argc, char** argv) {
+    using namespace fastapi_bench;
+    try {
+        Options options = parse_options(argc, argv);
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* address = nullptr;
+        if (int rc = getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &address); rc != 0) {
+            throw std::runtime_error(std::string("Cannot resolve ") + options.host + ": " + gai_strerror(rc));
+        }
+
+        int64_t start = now_ns() + static_cast<int64_t>(options.warmup * 1e9);
+        int64_t end = start + static_cast<int64_t>(options.duration * 1e9);
+        std::vector<std::unique_ptr<LoadThread>> loads;
+        for (unsigned i = 0; i < options.threads; i++) {
+            unsigned share = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+            loads.push_back(std::make_unique<LoadThread>(options, *address, share, i, start, end));
+        }
+        std::vector<std::thread> threads;
+        std::vector<std::string> errors(loads.size());
+        for (size_t i = 0; i < loads.size(); i++) {
+            threads.emplace_back([&, i] {
+                try {
+                    loads[i]->run();
+                } catch (const std::exception& e) {
+                    errors[i] = e.what();
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        freeaddrinfo(address);
+        for (const auto& error : errors) {
+            if (!error.empty()) throw std::runtime_error(error);
+        }
+
+        Stats totals;
+        for (auto& load : loads) totals.merge(load->stats());
+        report(options, totals);
+        return totals.completed > 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "fastapi_bench: %s\n", e.what());
+        print_usage();
+        return 2;
+    }
+}
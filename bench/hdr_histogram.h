@@ -0,0 +1,134 @@
+// Tomas Costantino
+
+#ifndef SERVERC___HDR_HISTOGRAM_H
+#define SERVERC___HDR_HISTOGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace fastapi_bench {
+
+    // High dynamic range histogram (the HdrHistogram layout): values are bucketed by powers of
+    // two, and each bucket is split linearly into enough sub-buckets to keep
+    // `significant_figures` decimal digits of precision. Recording is an index computation
+    // plus an increment, so each load-generator thread keeps its own and they are merged when
+    // the run ends.
+    class HdrHistogram {
+    public:
+        HdrHistogram(int64_t lowest_trackable, int64_t highest_trackable, int significant_figures = 3)
+                : highest(highest_trackable) {
+            if (lowest_trackable < 1 || highest_trackable < 2 * lowest_trackable ||
+                significant_figures < 1 || significant_figures > 5) {
+                throw std::invalid_argument("Invalid histogram range");
+            }
+            int64_t single_unit_limit = 2 * static_cast<int64_t>(std::pow(10, significant_figures));
+            int sub_bucket_count_magnitude = static_cast<int>(std::ceil(std::log2(static_cast<double>(single_unit_limit))));
+            sub_bucket_half_count_magnitude = std::max(sub_bucket_count_magnitude, 1) - 1;
+            unit_magnitude = static_cast<int>(std::floor(std::log2(static_cast<double>(lowest_trackable))));
+            sub_bucket_count = int64_t(1) << (sub_bucket_half_count_magnitude + 1);
+            sub_bucket_half_count = sub_bucket_count / 2;
+            sub_bucket_mask = (sub_bucket_count - 1) << unit_magnitude;
+
+            int64_t smallest_untrackable = sub_bucket_count << unit_magnitude;
+            bucket_count = 1;
+            while (smallest_untrackable <= highest_trackable) {
+                if (smallest_untrackable > std::numeric_limits<int64_t>::max() / 2) {
+                    bucket_count++;
+                    break;
+                }
+                smallest_untrackable <<= 1;
+                bucket_count++;
+            }
+            counts.assign(static_cast<size_t>((bucket_count + 1) * sub_bucket_half_count), 0);
+        }
+
+        // Values above the trackable range are clamped to it rather than dropped.
+        void record(int64_t value) {
+            value = std::clamp<int64_t>(value, 0, highest);
+            counts[index_of(value)]++;
+            total++;
+            sum += value;
+            min_seen = std::min(min_seen, value);
+            max_seen = std::max(max_seen, value);
+        }
+
+        void merge(const HdrHistogram& other) {
+            if (other.counts.size() != counts.size()) throw std::invalid_argument("Histogram layouts differ");
+            for (size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+            total += other.total;
+            sum += other.sum;
+            min_seen = std::min(min_seen, other.min_seen);
+            max_seen = std::max(max_seen, other.max_seen);
+        }
+
+        // Smallest recorded-equivalent value that `percentile` percent of samples are at or below.
+        int64_t value_at_percentile(double percentile) const {
+            if (total == 0) return 0;
+            percentile = std::clamp(percentile, 0.0, 100.0);
+            auto target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(total)));
+            target = std::max<uint64_t>(target, 1);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                seen += counts[i];
+                if (seen >= target) {
+                    return std::min(highest_equivalent(value_at_index(i)), max_seen);
+                }
+            }
+            return max_seen;
+        }
+
+        uint64_t count() const { return total; }
+        int64_t min() const { return total ? min_seen : 0; }
+        int64_t max() const { return total ? max_seen : 0; }
+        double mean() const { return total ? static_cast<double>(sum) / static_cast<double>(total) : 0.0; }
+
+    private:
+        int64_t highest;
+        int unit_magnitude = 0;
+        int sub_bucket_half_count_magnitude = 0;
+        int64_t sub_bucket_count = 0;
+        int64_t sub_bucket_half_count = 0;
+        int64_t sub_bucket_mask = 0;
+        int64_t bucket_count = 0;
+        std::vector<uint64_t> counts;
+        uint64_t total = 0;
+        int64_t sum = 0;
+        int64_t min_seen = std::numeric_limits<int64_t>::max();
+        int64_t max_seen = 0;
+
+        int bucket_index(int64_t value) const {
+            int pow2_ceiling = 64 - __builtin_clzll(static_cast<uint64_t>(value | sub_bucket_mask));
+            return pow2_ceiling - unit_magnitude - (sub_bucket_half_count_magnitude + 1);
+        }
+
+        size_t index_of(int64_t value) const {
+            int bucket = bucket_index(value);
+            int64_t sub_bucket = value >> (bucket + unit_magnitude);
+            return static_cast<size_t>(((int64_t(bucket) + 1) << sub_bucket_half_count_magnitude) + (sub_bucket - sub_bucket_half_count));
+        }
+
+        int64_t value_at_index(size_t index) const {
+            int64_t bucket = (static_cast<int64_t>(index) >> sub_bucket_half_count_magnitude) - 1;
+            int64_t sub_bucket = (static_cast<int64_t>(index) & (sub_bucket_half_count - 1)) + sub_bucket_half_count;
+            if (bucket < 0) {
+                sub_bucket -= sub_bucket_half_count;
+                bucket = 0;
+            }
+            return sub_bucket << (bucket + unit_magnitude);
+        }
+
+        int64_t highest_equivalent(int64_t value) const {
+            int bucket = bucket_index(value);
+            int64_t sub_bucket = value >> (bucket + unit_magnitude);
+            int adjusted_bucket = sub_bucket >= sub_bucket_count ? bucket + 1 : bucket;
+            int64_t lowest_equivalent = (value >> (bucket + unit_magnitude)) << (bucket + unit_magnitude);
+            return lowest_equivalent + (int64_t(1) << (unit_magnitude + adjusted_bucket)) - 1;
+        }
+    };
+}
+
+#endif //SERVERC___HDR_HISTOGRAM_H
@@ -0,0 +1,208 @@
+// Tomas Costantino
+//
+// Component microbenchmarks (Google Benchmark). Results go to stdout as JSON unless a
+// --benchmark_format is given, so CI can diff runs:
+//
+//   fastapi_micro_bench > micro.json
+//   fastapi_micro_bench --benchmark_filter=Route --benchmark_format=console
+
+#include "../FastAPI_CPP/FastAPI_CPP.h"
+#include "../FastAPI_CPP/json_document.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+    const std::string curl_request =
+            "GET /users/42/posts/hello?page=2&limit=10 HTTP/1.1\r\n"
+            "Host: localhost:8000\r\n"
+            "User-Agent: curl/8.4.0\r\n"
+            "Accept: */*\r\n"
+            "\r\n";
+
+    const std::string browser_request =
+            "GET /users/42/posts/hello?page=2&limit=10&sort=desc HTTP/1.1\r\n"
+            "Host: api.example.com\r\n"
+            "Connection: keep-alive\r\n"
+            "sec-ch-ua: \"Chromium\";v=\"122\", \"Not(A:Brand\";v=\"24\", \"Google Chrome\";v=\"122\"\r\n"
+            "sec-ch-ua-mobile: ?0\r\n"
+            "sec-ch-ua-platform: \"Linux\"\r\n"
+            "Upgrade-Insecure-Requests: 1\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/122.0.0.0 Safari/537.36\r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+            "Sec-Fetch-Site: none\r\n"
+            "Sec-Fetch-Mode: navigate\r\n"
+            "Sec-Fetch-User: ?1\r\n"
+            "Sec-Fetch-Dest: document\r\n"
+            "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+            "Accept-Language: en-US,en;q=0.9,es;q=0.8\r\n"
+            "Cookie: session=7d1f0b7c9a4e4e21b6b1d2c3e4f5a6b7; theme=dark; _ga=GA1.1.123456789.1700000000\r\n"
+            "\r\n";
+
+    const std::string& request_for(int kind) {
+        return kind == 0 ? curl_request : browser_request;
+    }
+
+    void BM_ParseRequest(benchmark::State& state) {
+        const std::string& raw = request_for(static_cast<int>(state.range(0)));
+        for (auto _ : state) {
+            http::Request request = http::parse_request(raw);
+            benchmark::DoNotOptimize(request);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * raw.size()));
+        state.SetLabel(state.range(0) == 0 ? "curl" : "browser");
+    }
+    BENCHMARK(BM_ParseRequest)->Arg(0)->Arg(1);
+
+    // The worker's path: framing from the receive buffer into a reused per-connection arena.
+    void BM_FrameRequestInArena(benchmark::State& state) {
+        const std::string& raw = request_for(static_cast<int>(state.range(0)));
+        http::RequestFramer framer;
+        http::Arena arena;
+        http::ArenaResource memory(arena);
+        for (auto _ : state) {
+            arena.reset();
+            framer.feed(raw);
+            http::Request request = framer.take_request(raw, &memory);
+            benchmark::DoNotOptimize(request);
+            framer.reset();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * raw.size()));
+        state.SetLabel(state.range(0) == 0 ? "curl" : "browser");
+    }
+    BENCHMARK(BM_FrameRequestInArena)->Arg(0)->Arg(1);
+
+    void BM_QueryParams(benchmark::State& state) {
+        std::string query;
+        for (int64_t i = 0; i < state.range(0); i++) {
+            if (i) query += '&';
+            query += "key" + std::to_string(i) + "=value" + std::to_string(i * 7919);
+        }
+        for (auto _ : state) {
+            http::QueryParams params(query);
+            benchmark::DoNotOptimize(params);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * query.size()));
+    }
+    BENCHMARK(BM_QueryParams)->Arg(2)->Arg(8)->Arg(32);
+
+    // Object with `items` entries of mixed scalar types plus a nested array each.
+    std::string make_document(int64_t items) {
+        http::JSON::Array records;
+        for (int64_t i = 0; i < items; i++) {
+            records.push_back(http::JSON::object({
+                    {"id", static_cast<double>(i)},
+                    {"name", "item-" + std::to_string(i) + " with \"quotes\" and unicode \xc3\xa9"},
+                    {"price", 19.99 + static_cast<double>(i)},
+                    {"active", i % 2 == 0},
+                    {"tags", http::JSON::Array{http::JSON("alpha"), http::JSON("beta"), http::JSON("gamma")}},
+                    {"parent", http::JSON()},
+            }));
+        }
+        return http::JSON::object({{"count", static_cast<double>(items)}, {"records", records}}).stringify();
+    }
+
+    // 1 record is about 150 bytes, 100 about 15 KB, 10000 about 1.5 MB.
+    constexpr int64_t small_doc = 1;
+    constexpr int64_t medium_doc = 100;
+    constexpr int64_t large_doc = 10000;
+
+    void BM_JSONParse(benchmark::State& state) {
+        std::string text = make_document(state.range(0));
+        for (auto _ : state) {
+            http::JSON value = http::JSON::parse(text);
+            benchmark::DoNotOptimize(value);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+    }
+    BENCHMARK(BM_JSONParse)->Arg(small_doc)->Arg(medium_doc)->Arg(large_doc);
+
+    // Parsing into a reused JSONDocument, without converting to the owning JSON tree.
+    void BM_JSONDocumentParse(benchmark::State& state) {
+        std::string text = make_document(state.range(0));
+        http::JSONDocument document;
+        for (auto _ : state) {
+            const http::JSONValue& root = document.parse(text);
+            benchmark::DoNotOptimize(&root);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+    }
+    BENCHMARK(BM_JSONDocumentParse)->Arg(small_doc)->Arg(medium_doc)->Arg(large_doc);
+
+    void BM_JSONStringify(benchmark::State& state) {
+        std::string text = make_document(state.range(0));
+        http::JSON value = http::JSON::parse(text);
+        std::string out;
+        for (auto _ : state) {
+            out.clear();
+            value.stringify(out);
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+    }
+    BENCHMARK(BM_JSONStringify)->Arg(small_doc)->Arg(medium_doc)->Arg(large_doc);
+
+    // An app with `count` routes spread over static, single-parameter and two-parameter
+    // shapes, probed with requests that hit routes near the start, middle and end.
+    struct RoutedApp {
+        fastapi_cpp::FastAPI app;
+        std::vector<http::Request> probes;
+
+        explicit RoutedApp(int64_t count) {
+            static const http::PreparedResponse ok(http::HTTP_200_OK(http::JSON::object({{"ok", true}})));
+            auto handler = [](const fastapi_cpp::Request&, const fastapi_cpp::Params&) -> http::Response { return ok; };
+            for (int64_t i = 0; i < count; i++) {
+                std::string base = "/api/v1/resource" + std::to_string(i);
+                switch (i % 3) {
+                    case 0: app.get(base, handler); break;
+                    case 1: app.get(base + "/{id}", handler); break;
+                    default: app.post(base + "/{id}/children/{child}", handler); break;
+                }
+            }
+            for (int64_t i : {int64_t(0), count / 2, count - 1}) {
+                std::string target = "/api/v1/resource" + std::to_string(i);
+                std::string method = "GET";
+                if (i % 3 == 1) target += "/12345";
+                if (i % 3 == 2) {
+                    target += "/12345/children/abc";
+                    method = "POST";
+                }
+                probes.push_back(http::parse_request(method + " " + target + "?verbose=1 HTTP/1.1\r\nHost: x\r\n\r\n"));
+            }
+        }
+    };
+
+    void BM_RouteLookup(benchmark::State& state) {
+        fastapi_cpp::Logger::instance().set_level(fastapi_cpp::LogLevel::ERROR);
+        RoutedApp routed(state.range(0));
+        size_t next = 0;
+        for (auto _ : state) {
+            http::Response response = routed.app.handle_request(routed.probes[next]);
+            benchmark::DoNotOptimize(response);
+            next = next + 1 == routed.probes.size() ? 0 : next + 1;
+        }
+        state.counters["routes"] = static_cast<double>(state.range(0));
+    }
+    BENCHMARK(BM_RouteLookup)->Arg(10)->Arg(100)->Arg(1000);
+}
+
+int main(int argc, char** argv) {
+    std::vector<char*> args(argv, argv + argc);
+    bool has_format = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--benchmark_format", 18) == 0) has_format = true;
+    }
+    char json_format[] = "--benchmark_format=json";
+    if (!has_format) args.push_back(json_format);
+    int count = static_cast<int>(args.size());
+
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
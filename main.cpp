@@ -1,42 +1,53 @@
 // Tomas Costantino
 #include "FastAPI_CPP/FastAPI_CPP.h"
+#include "FastAPI_CPP/json_bind.h"
+#include "FastAPI_CPP/json_document.h"
+#include "FastAPI_CPP/http_client.h"
+
+struct Item {
+    std::string name;
+    double price = 0;
+    int quantity = 1;
+    std::optional<std::string> description;
+    std::vector<std::string> tags;
+};
+FASTAPI_JSON(Item, name, price, quantity, description, tags)
 
 int main() {
     fastapi_cpp::FastAPI app;
+    app.enable_metrics();
+    app.enable_tracing(std::chrono::milliseconds(10));
+    app.static_files("/static", "static");
 
-    app.get("/", [](const fastapi_cpp::Request& request, const std::map<std::string, std::string>& params) {
-        return http::HTTP_200_OK(http::JSON::object({{"message", "Welcome"}}));
+    static const http::PreparedResponse welcome(http::HTTP_200_OK(http::JSON::object({{"message", "Welcome"}})));
+    app.get("/", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) -> http::Response {
+        return welcome;
     });
 
-    app.get("/param_query", [](const fastapi_cpp::Request& request, const std::map<std::string, std::string>& params) {
+    app.get("/param_query", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
         http::JSON::Object response_data;
         for (const auto& [key, value] : params) {
-            response_data[key] = value;
+            response_data[std::string(key)] = std::string(value);
         }
         return http::HTTP_200_OK(response_data);
-    });
+    }, std::chrono::seconds(30));
 
-    app.get("/echo", [](const fastapi_cpp::Request& request, const std::map<std::string, std::string>& params) {
+    app.get("/echo", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
         return http::HTTP_200_OK(http::JSON::object({{"message", "Echo"}}));
     });
 
-    app.post("/echo", [](const fastapi_cpp::Request& request, const std::map<std::string, std::string>& params) {
+    app.post("/echo", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
         try {
-            http::JSON parsed_json = http::JSON::parse(request.body);
-            std::map<std::string, http::JSON> parsed_body = http::JSON::json_to_map(parsed_json);
+            http::JSONDocument document;
+            const http::JSONValue& parsed_body = document.parse(request.body);
+            if (!parsed_body.is_object()) {
+                throw std::runtime_error("JSON value is not an object");
+            }
 
             http::JSON::Object response_body;
-            for (const auto& [key, value] : parsed_body) {
-                if (std::holds_alternative<std::string>(value.get_value())) {
-                    response_body[key] = std::get<std::string>(value.get_value());
-                } else if (std::holds_alternative<int>(value.get_value())) {
-                    response_body[key] = std::get<int>(value.get_value());
-                } else if (std::holds_alternative<double>(value.get_value())) {
-                    response_body[key] = std::get<double>(value.get_value());
-                } else if (std::holds_alternative<bool>(value.get_value())) {
-                    response_body[key] = std::get<bool>(value.get_value());
-                } else if (std::holds_alternative<std::nullptr_t>(value.get_value())) {
-                    response_body[key] = nullptr;
+            for (const auto& [key, value] : parsed_body.object_members()) {
+                if (!value.is_array() && !value.is_object()) {
+                    response_body.insert_or_assign(std::string(key), value.to_json());
                 }
             }
 
@@ -47,15 +58,63 @@ int main() {
         }
     });
 
-    app.get("/test", [](const fastapi_cpp::Request& request, const std::map<std::string, std::string>& params) {
+    app.get("/test", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
         return http::HTTP_200_OK(http::JSON::object({{"message", "Testing"}}));
     });
 
-    app.get("/echo/{echo}", [](const fastapi_cpp::Request& request, const std::map<std::string, std::string>& params) {
-        auto to_echo = params.at("echo");
+    app.get("/echo/{echo}", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
+        std::string to_echo(params.at("echo"));
         return http::HTTP_200_OK(http::JSON::object({{"Echo route", to_echo}}));
     });
 
+    app.post("/items", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
+        try {
+            auto item = http::from_json<Item>(request.body);
+            item.tags.push_back("created");
+            return http::HTTP_201_CREATED(item);
+        } catch (const std::exception& e) {
+            return http::HTTP_400_BAD_REQUEST(http::JSON::object({{"error", e.what()}}));
+        }
+    });
+
+    app.get("/slow", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        return http::HTTP_200_OK(http::JSON::object({{"message", "Done"}}));
+    }, fastapi_cpp::Execution::BLOCKING);
+
+    app.get("/export", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
+        return http::streaming_response(http::HttpStatus::OK, "text/csv", [row = 0](std::string& out) mutable {
+            for (int end = row + 1000; row < end; row++) {
+                out += std::to_string(row);
+                out += ",item-";
+                out += std::to_string(row * 7);
+                out += '\n';
+            }
+            return row < 100000;
+        });
+    });
+
+    app.post_upload("/upload", [](const fastapi_cpp::Request& request, const fastapi_cpp::Params& params) {
+        auto received = std::make_shared<size_t>(0);
+        return http::BodyReader{
+                [received](std::string_view piece) { *received += piece.size(); },
+                [received] { return http::HTTP_200_OK(http::JSON::object({{"received_bytes", std::to_string(*received)}})); }};
+    });
+
+    app.get<"/users/{id:int}/posts/{slug}">([](const fastapi_cpp::Request& request, int id, std::string_view slug) {
+        return http::HTTP_200_OK(http::JSON::object({{"user", id}, {"post", std::string(slug)}}));
+    });
+
+    app.get("/async", [](const fastapi_cpp::Request& request) -> fastapi_cpp::Task<http::Response> {
+        co_await fastapi_cpp::sleep_for(std::chrono::milliseconds(50));
+        co_return http::HTTP_200_OK(http::JSON::object({{"message", "Done"}}));
+    });
+
+    app.get<"/proxy/{port:int}">([](const fastapi_cpp::Request& request, int port) -> fastapi_cpp::Task<http::Response> {
+        auto upstream = co_await fastapi_cpp::http_get("127.0.0.1", port, "/");
+        co_return http::HTTP_200_OK(http::JSON::object({{"upstream_status", upstream.status}, {"upstream_body", upstream.body}}));
+    });
+
     app.run(8000);
 
     return 0;